@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+#include <optional>
+#include <string>
+
+#include "ast_arena.h"
+#include "gen.h"
+#include "lexer.h"
+#include "parser.h"
+
+// Expression-heavy statements, so the run is dominated by node allocation.
+static auto makeScript() -> const std::string& {
+    static const auto script = [] {
+        std::string source { "counter := 0;\n" };
+        for (int i = 0; i < 97; ++i) {
+            source += fmt::format("value_{} := {};\n", i, i);
+        }
+        for (int i = 0; source.size() < 2 * 1024 * 1024; ++i) {
+            source += fmt::format("value_{} := value_{} * 31 + {} - value_{} / 7 + 2 * {};\n", i % 97, i % 89, i, i % 13, i % 5);
+            source += fmt::format("if value_{} != 1048576 then print 3.25 + value_{}; else print counter; end\n", i % 97, i % 7);
+        }
+        return source;
+    }();
+    return script;
+}
+
+// Parses the script and drops the tree, with nodes from the heap or from an
+// AstArena. Teardown includes destroying the arena itself.
+static void BM_ParseAndFree(benchmark::State& state, const bool useArena) {
+    const auto& source = makeScript();
+    const auto tokens = Lexer(source).lexBuffer();
+
+    for (auto _ : state) {
+        std::optional<AstArena> arena;
+        if (useArena) {
+            arena.emplace();
+            benchmark::DoNotOptimize(Parser(tokens, *arena).parse());
+        } else {
+            benchmark::DoNotOptimize(Parser(tokens).parse());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK_CAPTURE(BM_ParseAndFree, heap, false)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ParseAndFree, arena, true)->Unit(benchmark::kMillisecond);
+
+// Only the teardown of the tree.
+static void BM_Free(benchmark::State& state, const bool useArena) {
+    const auto& source = makeScript();
+    const auto tokens = Lexer(source).lexBuffer();
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::optional<AstArena> arena;
+        auto statements = useArena ? Parser(tokens, arena.emplace()).parse() : Parser(tokens).parse();
+        state.ResumeTiming();
+
+        statements.clear();
+        arena.reset();
+    }
+}
+BENCHMARK_CAPTURE(BM_Free, heap, false)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Free, arena, true)->Unit(benchmark::kMillisecond);
+
+// Generating bytecode from the pointer tree and from the flat AST.
+static void BM_Generate(benchmark::State& state, const bool flat) {
+    const auto& source = makeScript();
+    const auto tokens = Lexer(source).lexBuffer();
+
+    AstArena arena;
+    auto tree = Parser(tokens, arena).parse();
+    const auto ast = Parser(tokens, FlatAst::Builder {}).parse();
+
+    for (auto _ : state) {
+        if (flat) {
+            benchmark::DoNotOptimize(BytecodeGenerator(ast).generate());
+        } else {
+            benchmark::DoNotOptimize(BytecodeGenerator(tree).generate());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.counters["ast_bytes"] = static_cast<double>(flat ? ast.bytes() : arena.bytes());
+}
+BENCHMARK_CAPTURE(BM_Generate, tree, false)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Generate, flat, true)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseFlat(benchmark::State& state) {
+    const auto& source = makeScript();
+    const auto tokens = Lexer(source).lexBuffer();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Parser(tokens, FlatAst::Builder {}).parse());
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_ParseFlat)->Unit(benchmark::kMillisecond);
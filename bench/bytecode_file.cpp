@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "bytecode_file.h"
+#include "gen.h"
+#include "parser.h"
+#include "peephole.h"
+#include "type_checker.h"
+#include "vm.h"
+
+// Startup of a short script: everything from its text, or from its .hbc
+// bytes, up to a VirtualMachine ready to run it.
+static constexpr auto script = R"(
+    a := 1; b := 2;
+    c := a * 3 + b;
+    if c == 5 then
+        d := c / 2;
+    else
+        d := c - 1;
+    end
+    print d * 2 + a;
+)";
+
+static auto compile(const std::string_view source) -> ByteCode::Chunk {
+    Lexer l(source);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+    TypeChecker().run(stmts);
+
+    auto chunk = BytecodeGenerator(stmts).generate();
+    ByteCode::Peephole().run(chunk);
+    ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(chunk);
+    return chunk;
+}
+
+static void BM_StartFromSource(benchmark::State& state) {
+    for (auto _ : state) {
+        const auto chunk = compile(script);
+        const VirtualMachine vm(chunk);
+        benchmark::DoNotOptimize(vm.hadError());
+    }
+}
+BENCHMARK(BM_StartFromSource);
+
+static void BM_StartFromBytecode(benchmark::State& state) {
+    const auto bytes = ByteCode::encode(compile(script));
+
+    for (auto _ : state) {
+        ByteCode::Chunk chunk;
+        const auto error = ByteCode::decode(bytes, chunk);
+        const VirtualMachine vm(chunk);
+        benchmark::DoNotOptimize(error.has_value() || vm.hadError());
+    }
+    state.counters["bytes"] = static_cast<double>(bytes.size());
+}
+BENCHMARK(BM_StartFromBytecode);
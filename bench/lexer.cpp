@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "lexer.h"
+#include "parallel_lexer.h"
+#include "parser.h"
+
+// A few megabytes of the kind of script our generators produce.
+static auto makeScript() -> const std::string& {
+    static const auto script = [] {
+        std::string source;
+        for (int i = 0; source.size() < 4 * 1024 * 1024; ++i) {
+            source += fmt::format("    accumulated_value_{} := previous_value_{} * 31 + {};\n", i % 97, i % 89, i);
+            source += fmt::format("    if accumulated_value_{} != 1048576 then print 3.25; else print counter; end\n", i % 97);
+        }
+        return source;
+    }();
+    return script;
+}
+
+static void BM_Lex(benchmark::State& state, const Lexer::Mode mode) {
+    const auto& source = makeScript();
+
+    for (auto _ : state) {
+        Lexer l(source, mode);
+        benchmark::DoNotOptimize(l.lex());
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK_CAPTURE(BM_Lex, simple, Lexer::Mode::Simple)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Lex, fast, Lexer::Mode::Fast)->Unit(benchmark::kMillisecond);
+
+static void BM_LexBuffer(benchmark::State& state) {
+    const auto& source = makeScript();
+
+    double bytesPerToken { 0 };
+    for (auto _ : state) {
+        Lexer l(source);
+        const auto buffer = l.lexBuffer();
+        bytesPerToken = static_cast<double>(buffer.bytes()) / buffer.size();
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    // Against sizeof(Token) for the list from lex().
+    state.counters["bytes/token"] = bytesPerToken;
+}
+BENCHMARK(BM_LexBuffer)->Unit(benchmark::kMillisecond);
+
+static void BM_LexAndParseList(benchmark::State& state) {
+    const auto& source = makeScript();
+
+    for (auto _ : state) {
+        Lexer l(source);
+        auto tokens = l.lex();
+        benchmark::DoNotOptimize(Parser(tokens).parse());
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+static void BM_LexAndParseStream(benchmark::State& state) {
+    const auto& source = makeScript();
+
+    for (auto _ : state) {
+        Lexer l(source);
+        benchmark::DoNotOptimize(Parser(l).parse());
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+static void BM_LexAndParseBuffer(benchmark::State& state) {
+    const auto& source = makeScript();
+
+    for (auto _ : state) {
+        Lexer l(source);
+        const auto buffer = l.lexBuffer();
+        benchmark::DoNotOptimize(Parser(buffer).parse());
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_LexAndParseList)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LexAndParseBuffer)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LexAndParseStream)->Unit(benchmark::kMillisecond);
+
+static void BM_LexParallel(benchmark::State& state) {
+    const auto& source = makeScript();
+    ThreadPool pool(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lexParallel(source, pool));
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_LexParallel)->RangeMultiplier(2)->Range(1, std::max(1u, std::thread::hardware_concurrency()))->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,10 @@
+#include <benchmark/benchmark.h>
+#include <spdlog/spdlog.h>
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::off);
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -0,0 +1,162 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "ast_arena.h"
+#include "lexer.h"
+#include "parser.h"
+
+// The recursive descent chain the Pratt parser replaced, kept to compare
+// against: assignment -> equality -> term -> factor -> primary for every
+// operand. It has no unary operators or grouping.
+class ChainParser {
+public:
+    ChainParser(Lexer::TokenList& tokens, AstArena& arena) : tokens { tokens }, builder { arena } {}
+
+    [[nodiscard]] auto parse() -> TreeBuilder::Result {
+        while (peek().ttype != TokenType::Eof) {
+            // The statement keywords Parser::statement() looks for.
+            std::ignore = checkAndAdvance(TokenType::If) || checkAndAdvance(TokenType::Print);
+            auto expr = assignment();
+            std::ignore = checkAndAdvance(TokenType::Semicolon);
+            this->builder.root(this->builder.expressionStatement(std::move(expr)));
+        }
+        return this->builder.finish();
+    }
+
+private:
+    using Expr = TreeBuilder::Expression;
+
+    [[nodiscard]] auto assignment() -> Expr {
+        auto expr = equality();
+        if (checkAndAdvance(TokenType::Assign)) {
+            auto value = assignment();
+            return this->builder.assign(std::move(expr), std::move(value));
+        }
+        return expr;
+    }
+
+    [[nodiscard]] auto equality() -> Expr {
+        auto expr = term();
+        while (checkAndAdvance(TokenType::EqualEqual, TokenType::BangEqual)) {
+            auto op = previous();
+            expr = this->builder.logical(std::move(expr), op, term());
+        }
+        return expr;
+    }
+
+    [[nodiscard]] auto term() -> Expr {
+        auto expr = factor();
+        while (checkAndAdvance(TokenType::Plus, TokenType::Minus)) {
+            auto op = previous();
+            expr = this->builder.binary(std::move(expr), op, factor());
+        }
+        return expr;
+    }
+
+    [[nodiscard]] auto factor() -> Expr {
+        auto expr = primary();
+        while (checkAndAdvance(TokenType::Star, TokenType::Slash)) {
+            auto op = previous();
+            expr = this->builder.binary(std::move(expr), op, primary());
+        }
+        return expr;
+    }
+
+    [[nodiscard]] auto primary() -> Expr {
+        if (checkAndAdvance(TokenType::INumber)) {
+            return this->builder.integer(previous());
+        }
+        if (checkAndAdvance(TokenType::DNumber)) {
+            return this->builder.real(previous());
+        }
+        std::ignore = checkAndAdvance(TokenType::Identifier);
+        return this->builder.variable(previous());
+    }
+
+    template <typename ...Tokens>
+    [[nodiscard]] auto checkAndAdvance(Tokens&& ...ttypes) -> bool {
+        const bool found = ((peek().ttype == ttypes) || ...);
+        if (found) {
+            this->tokens.advance();
+        }
+        return found;
+    }
+
+    [[nodiscard]] auto peek() const -> Token {
+        return this->tokens.peek();
+    }
+
+    [[nodiscard]] auto previous() const -> Token {
+        return this->tokens.previous();
+    }
+
+    TokenSpan tokens;
+    TreeBuilder builder;
+};
+
+// One statement with `terms` operands mixing every precedence level.
+static auto longExpression(const int terms) -> std::string {
+    std::string source { "x := 1" };
+    constexpr std::array operators = { " + ", " * ", " - ", " / ", " == " };
+    for (int i = 0; i < terms; ++i) {
+        source += operators[i % operators.size()];
+        source += std::to_string(i % 100);
+    }
+    return source + ";";
+}
+
+// `depth` right-nested assignments, a := a := ... := 1, which both parsers
+// accept and which nest as deep as the source.
+static auto nestedAssignments(const int depth) -> std::string {
+    std::string source;
+    for (int i = 0; i < depth; ++i) {
+        source += "a := ";
+    }
+    return source + "1;";
+}
+
+// Many short statements, like a generated script.
+static auto manyStatements(const int count) -> std::string {
+    std::string source;
+    for (int i = 0; i < count; ++i) {
+        source += fmt::format("v{} := v{} * 31 + {} == v{};\n", i % 97, i % 89, i, i % 13);
+    }
+    return source;
+}
+
+template<typename Make>
+static void BM_Parse(benchmark::State& state, Make make, const bool pratt) {
+    const auto source = make(static_cast<int>(state.range(0)));
+    auto tokens = Lexer(source).lex();
+
+    for (auto _ : state) {
+        AstArena arena;
+        if (pratt) {
+            benchmark::DoNotOptimize(Parser(tokens, arena).parse());
+        } else {
+            benchmark::DoNotOptimize(ChainParser(tokens, arena).parse());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(tokens.size()));
+}
+BENCHMARK_CAPTURE(BM_Parse, long_chain, longExpression, false)->Arg(100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Parse, long_pratt, longExpression, true)->Arg(100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Parse, nested_chain, nestedAssignments, false)->Arg(2'000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Parse, nested_pratt, nestedAssignments, true)->Arg(2'000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Parse, statements_chain, manyStatements, false)->Arg(50'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Parse, statements_pratt, manyStatements, true)->Arg(50'000)->Unit(benchmark::kMillisecond);
+
+// Deeply parenthesized operands, which only the Pratt parser supports: each
+// level costs one prefix() and one expression() frame.
+static void BM_ParseParenthesized(benchmark::State& state) {
+    const auto depth = static_cast<int>(state.range(0));
+    const auto source = "x := " + std::string(depth, '(') + "1" + std::string(depth, ')') + " + -(2 * 3);";
+    auto tokens = Lexer(source).lex();
+
+    for (auto _ : state) {
+        AstArena arena;
+        benchmark::DoNotOptimize(Parser(tokens, arena).parse());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(tokens.size()));
+}
+BENCHMARK(BM_ParseParenthesized)->Arg(2'000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "execution_service.h"
+#include "gen.h"
+#include "parser.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+// Enough straight-line work per job that the queueing overhead does not
+// dominate, parameterized on the input so no two jobs are identical.
+static auto makeJob() -> std::string {
+    std::string source = "a := x; b := 2;\n";
+    for (int i = 0; i < 50; ++i) {
+        source += "a := a + b * 3 - 1; b := a / 2 + b;\n";
+    }
+    return source;
+}
+
+static void BM_ServiceThroughput(benchmark::State& state) {
+    static constexpr std::array inputs = { "x"sv };
+    const auto source = makeJob();
+
+    Lexer l(source);
+    auto tokens = l.lex();
+    Parser p(tokens);
+    auto stmts = p.parse();
+    BytecodeGenerator g(stmts, inputs);
+    const auto program = g.generate();
+    const VirtualMachine vm(program);
+
+    ExecutionService service(state.range(0));
+
+    constexpr int batch = 1024;
+    std::vector<std::future<JobResult>> jobs;
+    jobs.reserve(batch);
+
+    for (auto _ : state) {
+        for (int i = 0; i < batch; ++i) {
+            jobs.push_back(service.submit(vm, { i }));
+        }
+        for (auto& job : jobs) {
+            benchmark::DoNotOptimize(job.get());
+        }
+        jobs.clear();
+    }
+
+    state.counters["jobs/s"] = benchmark::Counter(static_cast<double>(state.iterations() * batch), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_ServiceThroughput)->RangeMultiplier(2)->Range(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
@@ -0,0 +1,116 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "gen.h"
+#include "parser.h"
+#include "register_gen.h"
+#include "register_vm.h"
+#include "type_checker.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+// The stack and register machines on the same programs. Both are given the
+// TypeChecker's annotations, so they differ only in their instructions;
+// `instructions` counts what each one executes per run.
+
+// Straight-line arithmetic, as in vm.cpp.
+static auto makeSource(const std::size_t statements) -> std::string {
+    std::string source = "a := 1; b := 2;\n";
+    for (std::size_t i = 0; i < statements; ++i) {
+        source += "a := a + b * 3 - 1; b := a / 2 + b;\n";
+    }
+    return source;
+}
+
+// A script run with many inputs, taking a different branch each time.
+static constexpr auto servedScript = R"(
+    y := x * 3 + 1;
+    if y == 10 then
+        z := y / 2;
+    else
+        z := y - 1;
+    end
+)";
+
+static constexpr std::array servedInputs = { "x"sv };
+
+struct Compiled {
+    ByteCode::Chunk stack;
+    RegisterCode::Chunk registers;
+};
+
+static auto compile(const std::string_view source, std::span<const std::string_view> inputs = {}) -> Compiled {
+    Lexer l(source);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+    TypeChecker().run(stmts);
+
+    return { BytecodeGenerator(stmts, inputs).generate(), RegisterGenerator(stmts, inputs).generate() };
+}
+
+static void BM_StackMachine(benchmark::State& state) {
+    const auto program = compile(makeSource(state.range(0))).stack;
+
+    const VirtualMachine vm(program);
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["instructions"] = static_cast<double>(program.instructionCount());
+}
+BENCHMARK(BM_StackMachine)->Arg(100)->Arg(1000);
+
+static void BM_RegisterMachine(benchmark::State& state) {
+    const auto program = compile(makeSource(state.range(0))).registers;
+
+    const RegisterMachine vm(program);
+    RegisterContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["instructions"] = static_cast<double>(program.code.size());
+}
+BENCHMARK(BM_RegisterMachine)->Arg(100)->Arg(1000);
+
+static void BM_StackMachineServed(benchmark::State& state) {
+    const auto program = compile(servedScript, servedInputs).stack;
+
+    const VirtualMachine vm(program);
+    ExecutionContext context(program);
+    const auto x = *vm.slot("x");
+    const auto z = *vm.slot("z");
+
+    int input { 0 };
+    for (auto _ : state) {
+        context.setSlot(x, input++ % 6);
+        vm.run(context);
+        benchmark::DoNotOptimize(context.getSlot(z));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StackMachineServed);
+
+static void BM_RegisterMachineServed(benchmark::State& state) {
+    const auto program = compile(servedScript, servedInputs).registers;
+
+    const RegisterMachine vm(program);
+    RegisterContext context(program);
+    const auto x = *vm.slot("x");
+    const auto z = *vm.slot("z");
+
+    int input { 0 };
+    for (auto _ : state) {
+        context.setSlot(x, input++ % 6);
+        vm.run(context);
+        benchmark::DoNotOptimize(context.getSlot(z));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RegisterMachineServed);
@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+#include "value.h"
+
+// Operand stacks of mixed values, as the VM would see them.
+template<typename V>
+static auto makeValues(const std::size_t count, const bool doubles) -> std::vector<V> {
+    std::mt19937 rng { 42 };
+    std::uniform_int_distribution<int> dist { -1000, 1000 };
+
+    std::vector<V> values;
+    values.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        if (doubles) {
+            values.emplace_back(static_cast<double>(dist(rng)) + 0.5);
+        } else {
+            values.emplace_back(dist(rng));
+        }
+    }
+    return values;
+}
+
+// The hot path of doBinaryOperation: test both tags, extract, add, rebox.
+template<typename V>
+static void BM_AddInts(benchmark::State& state) {
+    const auto values = makeValues<V>(state.range(0), false);
+
+    for (auto _ : state) {
+        V acc { 0 };
+        for (const auto& v : values) {
+            if (V::bothInts(acc, v)) [[likely]] {
+                acc = V { acc.asInt() + v.asInt() };
+            }
+        }
+        benchmark::DoNotOptimize(acc);
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+    state.counters["bytes/value"] = sizeof(V);
+}
+
+template<typename V>
+static void BM_AddDoubles(benchmark::State& state) {
+    const auto values = makeValues<V>(state.range(0), true);
+
+    for (auto _ : state) {
+        V acc { 0.0 };
+        for (const auto& v : values) {
+            if (V::bothDoubles(acc, v)) [[likely]] {
+                acc = V { acc.asDouble() + v.asDouble() };
+            }
+        }
+        benchmark::DoNotOptimize(acc);
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+    state.counters["bytes/value"] = sizeof(V);
+}
+
+// Push/pop traffic on a std::vector stack, the VM's other per-op cost.
+template<typename V>
+static void BM_StackTraffic(benchmark::State& state) {
+    const auto values = makeValues<V>(state.range(0), false);
+    std::vector<V> stack;
+    stack.reserve(values.size());
+
+    for (auto _ : state) {
+        for (const auto& v : values) {
+            stack.push_back(v);
+        }
+        while (not stack.empty()) {
+            benchmark::DoNotOptimize(stack.back());
+            stack.pop_back();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * values.size() * sizeof(V));
+}
+
+BENCHMARK_TEMPLATE(BM_AddInts, Values::Variant)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_AddInts, Values::Boxed)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_AddDoubles, Values::Variant)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_AddDoubles, Values::Boxed)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_StackTraffic, Values::Variant)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_StackTraffic, Values::Boxed)->Arg(1 << 16);
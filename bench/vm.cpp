@@ -0,0 +1,177 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "gen.h"
+#include "jit.h"
+#include "parser.h"
+#include "peephole.h"
+#include "type_checker.h"
+#include "vm.h"
+
+// Straight-line arithmetic: the language has no loops, so the work per run
+// scales with the number of statements.
+static auto makeSource(const std::size_t statements) -> std::string {
+    std::string source = "a := 1; b := 2;\n";
+    for (std::size_t i = 0; i < statements; ++i) {
+        source += "a := a + b * 3 - 1; b := a / 2 + b;\n";
+    }
+    return source;
+}
+
+// With `typed`, the TypeChecker lets the generator emit the opcodes
+// specialized for ints.
+static auto compile(const std::string_view source, const bool typed = false) -> ByteCode::Chunk {
+    Lexer l(source);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+    if (typed) {
+        TypeChecker().run(stmts);
+    }
+
+    BytecodeGenerator g(stmts);
+    return g.generate();
+}
+
+static auto reportSize(benchmark::State& state, const ByteCode::Chunk& program) -> void {
+    const auto instructions = program.instructionCount();
+    state.SetItemsProcessed(state.iterations() * instructions);
+    state.counters["bytes/instruction"] = static_cast<double>(program.code.size()) / instructions;
+}
+
+static void BM_DispatchSwitch(benchmark::State& state) {
+    const auto source = makeSource(state.range(0));
+    auto program = compile(source);
+
+    VirtualMachine vm(program);
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context, VirtualMachine::Dispatch::Switch);
+    }
+    reportSize(state, program);
+}
+
+#if ACOMPILER_COMPUTED_GOTO
+static void BM_DispatchThreaded(benchmark::State& state) {
+    const auto source = makeSource(state.range(0));
+    auto program = compile(source);
+
+    VirtualMachine vm(program);
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context, VirtualMachine::Dispatch::Threaded);
+    }
+    reportSize(state, program);
+}
+BENCHMARK(BM_DispatchThreaded)->Arg(100)->Arg(1000);
+#endif
+
+BENCHMARK(BM_DispatchSwitch)->Arg(100)->Arg(1000);
+
+static void BM_DispatchTyped(benchmark::State& state) {
+    const auto source = makeSource(state.range(0));
+    auto program = compile(source, true);
+
+    VirtualMachine vm(program);
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context);
+    }
+    reportSize(state, program);
+}
+BENCHMARK(BM_DispatchTyped)->Arg(100)->Arg(1000);
+
+// The typed program after the peephole pass, with and without fusion.
+static void BM_DispatchPeephole(benchmark::State& state) {
+    const auto source = makeSource(state.range(0));
+    auto program = compile(source, true);
+    ByteCode::Peephole().run(program);
+    if (state.range(1) != 0) {
+        ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(program);
+    }
+
+    VirtualMachine vm(program);
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        vm.run(context);
+    }
+    reportSize(state, program);
+}
+BENCHMARK(BM_DispatchPeephole)->ArgNames({ "statements", "fused" })->Args({ 1000, 0 })->Args({ 1000, 1 });
+
+static void BM_Jit(benchmark::State& state) {
+    const auto source = makeSource(state.range(0));
+    auto program = compile(source);
+
+    const JitMachine jit(program);
+    if (not jit.isCompiled()) {
+        state.SkipWithError("program not supported by the JIT");
+        return;
+    }
+    ExecutionContext context(program);
+
+    for (auto _ : state) {
+        jit.run(context);
+    }
+    reportSize(state, program);
+}
+BENCHMARK(BM_Jit)->Arg(100)->Arg(1000);
+
+// One script served with many inputs: compile once, then run the same
+// VirtualMachine and context repeatedly, against recompiling every time.
+static constexpr auto servedScript = R"(
+    y := x * 3 + 1;
+    if y == 10 then
+        z := y / 2;
+    else
+        z := y - 1;
+    end
+)";
+
+static constexpr std::array servedInputs = { "x"sv };
+
+static void BM_RunCompiled(benchmark::State& state) {
+    Lexer l(servedScript);
+    auto tokens = l.lex();
+    Parser p(tokens);
+    auto stmts = p.parse();
+    const auto program = BytecodeGenerator(stmts, servedInputs).generate();
+
+    const VirtualMachine vm(program);
+    ExecutionContext context(program);
+    const auto x = *vm.slot("x");
+
+    int input { 0 };
+    for (auto _ : state) {
+        context.setSlot(x, input++);
+        vm.run(context);
+        benchmark::DoNotOptimize(context.getSlot(*vm.slot("z")));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_CompileAndRun(benchmark::State& state) {
+    int input { 0 };
+    for (auto _ : state) {
+        Lexer l(servedScript);
+        auto tokens = l.lex();
+        Parser p(tokens);
+        auto stmts = p.parse();
+        const auto program = BytecodeGenerator(stmts, servedInputs).generate();
+
+        const VirtualMachine vm(program);
+        ExecutionContext context(program);
+        context.setSlot(*vm.slot("x"), input++);
+        vm.run(context);
+        benchmark::DoNotOptimize(context.getSlot(*vm.slot("z")));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_RunCompiled);
+BENCHMARK(BM_CompileAndRun);
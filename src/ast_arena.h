@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// Bump allocator for the AST of one compilation. Nodes are carved out of
+// large blocks and all of them are released together when the arena goes
+// away, instead of one malloc and one free per node.
+//
+// make() still hands out std::unique_ptr, so the trees look exactly like
+// heap-allocated ones to the generator and to visitors. Deleting an arena
+// node is a no-op (see Expression::operator delete): neither the node nor
+// its children are destroyed, which is fine because nodes own nothing but
+// their children and the parser builds a tree entirely in one arena. The
+// arena must outlive every tree made from it.
+// ============================================================================
+class AstArena {
+public:
+    explicit AstArena(const std::size_t blockSize = 64 * 1024) : blockSize { blockSize } {}
+
+    AstArena(const AstArena&) = delete;
+    auto operator=(const AstArena&) -> AstArena& = delete;
+
+    ~AstArena() {
+        for (auto* block : this->blocks) {
+            ::operator delete(block);
+        }
+    }
+
+    [[nodiscard]] auto allocate(const std::size_t size, const std::size_t alignment) -> void* {
+        auto offset = (this->used + alignment - 1) & ~(alignment - 1);
+        if (this->blocks.empty() || offset + size > this->capacity) {
+            // Oversized nodes get a block of their own.
+            this->capacity = std::max(this->blockSize, size);
+            this->blocks.push_back(static_cast<std::byte*>(::operator new(this->capacity)));
+            offset = 0;
+        }
+        this->used = offset + size;
+        this->allocated += size;
+        return this->blocks.back() + offset;
+    }
+
+    // Constructs a node in the arena. T derives from Expressions::Expression
+    // or Statements::Statement.
+    template<typename T, typename... Args>
+    [[nodiscard]] auto make(Args&&... args) -> std::unique_ptr<T> {
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "blocks are only aligned for the default new alignment");
+        auto* node = ::new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        node->arenaOwned = true;
+        return std::unique_ptr<T>(node);
+    }
+
+    // Bytes handed out so far, alignment padding excluded.
+    [[nodiscard]] auto bytes() const -> std::size_t {
+        return this->allocated;
+    }
+
+    [[nodiscard]] auto blockCount() const -> std::size_t {
+        return this->blocks.size();
+    }
+
+private:
+    std::size_t blockSize;
+    std::vector<std::byte*> blocks;
+    // Size of the last block and bytes used in it.
+    std::size_t capacity { 0 };
+    std::size_t used { 0 };
+    std::size_t allocated { 0 };
+};
+
+// Makes an AST node in `arena`, or on the heap when there is none. Passes that
+// add nodes to a parsed tree must use the arena the tree came from.
+template<typename T, typename... Args>
+[[nodiscard]] auto makeNode(AstArena* arena, Args&&... args) -> std::unique_ptr<T> {
+    if (arena != nullptr) {
+        return arena->make<T>(std::forward<Args>(args)...);
+    }
+    return std::make_unique<T>(std::forward<Args>(args)...);
+}
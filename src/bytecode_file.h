@@ -0,0 +1,201 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include "chunk.h"
+
+namespace ByteCode {
+
+    // ============================================================================
+    // The .hbc file format: a compiled Chunk, so a script can be run without
+    // lexing, parsing or generating it again.
+    //
+    //   Header     magic, version, opcode count, inputs, maxStack and the
+    //              offset and size of every section
+    //   Integers   int32 constant pool
+    //   Doubles    float64 constant pool
+    //   Names      uint32 length of each slot's name
+    //   Strings    the slot names, back to back
+    //   Code       Chunk::code, byte for byte
+    //
+    // Every field is little-endian and every section starts 8-byte aligned.
+    // Loading copies each section out of the mapped file in one piece; the
+    // code is never decoded instruction by instruction. The loader only checks the
+    // layout; the VirtualMachine verifies the code before running it, as it
+    // does for any chunk, including that the specialized opcodes, which
+    // trust the TypeChecker rather than the tags, only see operands of
+    // their type.
+    //
+    // formatVersion must change whenever the opcodes or their encoding do.
+    // ============================================================================
+    constexpr std::array<char, 4> fileMagic = { 'H', 'B', 'C', '\0' };
+    constexpr std::uint16_t formatVersion = 2;
+
+    namespace File {
+        enum SectionId : std::size_t {
+            Integers,
+            Doubles,
+            Names,
+            Strings,
+            Code,
+            SectionCount,
+        };
+
+        struct Section {
+            std::uint32_t offset;
+            std::uint32_t size;
+        };
+
+        struct Header {
+            std::array<char, 4> magic;
+            std::uint16_t version;
+            std::uint16_t opcodes;
+            std::uint32_t inputs;
+            std::uint32_t maxStack;
+            std::array<Section, SectionCount> sections;
+        };
+        static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) == 56);
+
+        constexpr std::size_t alignment = 8;
+
+        [[nodiscard]] static constexpr auto aligned(const std::size_t offset) -> std::size_t {
+            return (offset + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    // Whether `bytes` start like a bytecode file rather than a script.
+    [[nodiscard]] inline auto isBytecode(const std::string_view bytes) -> bool {
+        return bytes.size() >= fileMagic.size() && std::memcmp(bytes.data(), fileMagic.data(), fileMagic.size()) == 0;
+    }
+
+    [[nodiscard]] inline auto encode(const Chunk& chunk) -> std::string {
+        assert(std::endian::native == std::endian::little && "bytecode files are little-endian");
+        using namespace File;
+
+        std::vector<std::uint32_t> lengths;
+        std::string strings;
+        for (const auto& name : chunk.slots) {
+            lengths.push_back(static_cast<std::uint32_t>(name.size()));
+            strings += name;
+        }
+
+        Header header { fileMagic, formatVersion, static_cast<std::uint16_t>(opCodeCount), static_cast<std::uint32_t>(chunk.inputs), static_cast<std::uint32_t>(chunk.maxStack), {} };
+        std::string out(sizeof(Header), '\0');
+
+        const auto append = [&](const SectionId id, const void* data, const std::size_t size) {
+            assert(out.size() + size <= std::numeric_limits<std::uint32_t>::max() && "bytecode file too large");
+            out.resize(aligned(out.size()), '\0');
+            header.sections[id] = { static_cast<std::uint32_t>(out.size()), static_cast<std::uint32_t>(size) };
+            if (size > 0) {
+                out.append(static_cast<const char*>(data), size);
+            }
+        };
+        append(Integers, chunk.integers.data(), chunk.integers.size() * sizeof(int));
+        append(Doubles, chunk.doubles.data(), chunk.doubles.size() * sizeof(double));
+        append(Names, lengths.data(), lengths.size() * sizeof(std::uint32_t));
+        append(Strings, strings.data(), strings.size());
+        append(Code, chunk.code.data(), chunk.code.size());
+
+        std::memcpy(out.data(), &header, sizeof(Header));
+        return out;
+    }
+
+    // Rebuilds the chunk stored in `bytes`, typically a mapped .hbc file.
+    // Returns a description of the first problem found, leaving `chunk`
+    // unspecified.
+    [[nodiscard]] inline auto decode(const std::string_view bytes, Chunk& chunk) -> std::optional<std::string> {
+        using namespace File;
+        if constexpr (std::endian::native != std::endian::little) {
+            return "bytecode files are little-endian";
+        }
+
+        if (not isBytecode(bytes)) {
+            return "not a bytecode file";
+        }
+        if (bytes.size() < sizeof(Header)) {
+            return "truncated header";
+        }
+        Header header;
+        std::memcpy(&header, bytes.data(), sizeof(Header));
+        if (header.version != formatVersion || header.opcodes != opCodeCount) {
+            return fmt::format("bytecode format {} with {} opcodes, expected format {} with {}", header.version, header.opcodes, formatVersion, opCodeCount);
+        }
+
+        for (const auto& section : header.sections) {
+            if (section.offset % alignment != 0 || section.offset < sizeof(Header) || section.offset > bytes.size() || section.size > bytes.size() - section.offset) {
+                return "section outside the file";
+            }
+        }
+
+        const auto view = [&](const SectionId id) {
+            return bytes.substr(header.sections[id].offset, header.sections[id].size);
+        };
+        // Copies a whole section into a vector of T, or fails if it does not
+        // hold a whole number of them.
+        const auto load = [&]<typename T>(const SectionId id, std::vector<T>& into) {
+            const auto section = view(id);
+            if (section.size() % sizeof(T) != 0) {
+                return false;
+            }
+            into.resize(section.size() / sizeof(T));
+            if (not section.empty()) {
+                std::memcpy(into.data(), section.data(), section.size());
+            }
+            return true;
+        };
+
+        std::vector<std::uint32_t> lengths;
+        if (not load(Integers, chunk.integers) || not load(Doubles, chunk.doubles) || not load(Names, lengths) || not load(Code, chunk.code)) {
+            return "section size is not a multiple of its element size";
+        }
+
+        // Every instruction pushes at most two values, so anything deeper is
+        // corrupt, and would size the operand stack before verification.
+        if (header.maxStack > 2 * chunk.code.size()) {
+            return "maximum stack depth larger than the code can reach";
+        }
+
+        auto strings = view(Strings);
+        chunk.slots.clear();
+        for (const auto length : lengths) {
+            if (length > strings.size()) {
+                return "slot names overrun the string table";
+            }
+            chunk.slots.emplace_back(strings.substr(0, length));
+            strings.remove_prefix(length);
+        }
+        if (not strings.empty()) {
+            return "string table has unused bytes";
+        }
+
+        chunk.inputs = header.inputs;
+        chunk.maxStack = header.maxStack;
+        return std::nullopt;
+    }
+
+    [[nodiscard]] inline auto writeFile(const Chunk& chunk, const std::string_view path) -> bool {
+        const auto bytes = encode(chunk);
+        std::ofstream out { std::string { path }, std::ios::binary | std::ios::trunc };
+        if (out) {
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+        if (not out) {
+            spdlog::error(fmt::format("Cannot write '{}': {}", path, std::strerror(errno)));
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// SSE2 is part of x86-64; AVX2 is used when the compiler targets it
+// (-mavx2 or -march=native). -DACOMPILER_LEXER_SIMD=0 forces the scalar loop.
+#ifndef ACOMPILER_LEXER_SIMD
+#if defined(__SSE2__)
+#define ACOMPILER_LEXER_SIMD 1
+#else
+#define ACOMPILER_LEXER_SIMD 0
+#endif
+#endif
+
+#if ACOMPILER_LEXER_SIMD
+#include <immintrin.h>
+#endif
+
+namespace CharClass {
+    using Mask = std::uint8_t;
+
+    constexpr Mask Space      = 1 << 0; // ' ', '\t' and '\r'; '\n' is handled apart
+    constexpr Mask Digit      = 1 << 1;
+    constexpr Mask Alpha      = 1 << 2;
+    constexpr Mask Underscore = 1 << 3;
+
+    // Characters that continue an identifier after its first letter.
+    constexpr Mask IdentifierTail = Alpha | Digit | Underscore;
+
+    // Class of every byte. Matches the "C" locale's isdigit/isalpha, so bytes
+    // outside ASCII belong to no class.
+    constexpr auto table = [] {
+        std::array<Mask, 256> classes {};
+        classes[' '] = classes['\t'] = classes['\r'] = Space;
+        for (int c = '0'; c <= '9'; ++c) {
+            classes[c] = Digit;
+        }
+        for (int c = 'a'; c <= 'z'; ++c) {
+            classes[c] = Alpha;
+            classes[c - 'a' + 'A'] = Alpha;
+        }
+        classes['_'] = Underscore;
+        return classes;
+    }();
+
+    [[nodiscard]] constexpr auto is(const char c, const Mask mask) -> bool {
+        return (table[static_cast<unsigned char>(c)] & mask) != 0;
+    }
+
+#if ACOMPILER_LEXER_SIMD
+    namespace Detail {
+#if defined(__AVX2__)
+        using Vector = __m256i;
+
+        inline auto load(const char* p) -> Vector { return _mm256_loadu_si256(reinterpret_cast<const Vector*>(p)); }
+        inline auto zero() -> Vector { return _mm256_setzero_si256(); }
+        inline auto splat(const char c) -> Vector { return _mm256_set1_epi8(c); }
+        inline auto equal(const Vector a, const Vector b) -> Vector { return _mm256_cmpeq_epi8(a, b); }
+        inline auto either(const Vector a, const Vector b) -> Vector { return _mm256_or_si256(a, b); }
+        inline auto sub(const Vector a, const Vector b) -> Vector { return _mm256_sub_epi8(a, b); }
+        inline auto min(const Vector a, const Vector b) -> Vector { return _mm256_min_epu8(a, b); }
+        inline auto bits(const Vector v) -> std::uint32_t { return static_cast<std::uint32_t>(_mm256_movemask_epi8(v)); }
+#else
+        using Vector = __m128i;
+
+        inline auto load(const char* p) -> Vector { return _mm_loadu_si128(reinterpret_cast<const Vector*>(p)); }
+        inline auto zero() -> Vector { return _mm_setzero_si128(); }
+        inline auto splat(const char c) -> Vector { return _mm_set1_epi8(c); }
+        inline auto equal(const Vector a, const Vector b) -> Vector { return _mm_cmpeq_epi8(a, b); }
+        inline auto either(const Vector a, const Vector b) -> Vector { return _mm_or_si128(a, b); }
+        inline auto sub(const Vector a, const Vector b) -> Vector { return _mm_sub_epi8(a, b); }
+        inline auto min(const Vector a, const Vector b) -> Vector { return _mm_min_epu8(a, b); }
+        inline auto bits(const Vector v) -> std::uint32_t { return static_cast<std::uint32_t>(_mm_movemask_epi8(v)) | 0xffff'0000u; }
+#endif
+        constexpr std::size_t width = sizeof(Vector);
+
+        // Lanes holding a byte in [lo, hi]: unsigned (c - lo) <= hi - lo.
+        inline auto inRange(const Vector v, const char lo, const char hi) -> Vector {
+            const auto offset = sub(v, splat(lo));
+            return equal(min(offset, splat(static_cast<char>(hi - lo))), offset);
+        }
+
+        template<Mask mask>
+        auto matches(const Vector v) -> Vector {
+            auto result = zero();
+            if constexpr ((mask & Space) != 0) {
+                result = either(result, either(equal(v, splat(' ')), either(equal(v, splat('\t')), equal(v, splat('\r')))));
+            }
+            if constexpr ((mask & Digit) != 0) {
+                result = either(result, inRange(v, '0', '9'));
+            }
+            if constexpr ((mask & Alpha) != 0) {
+                // Setting bit 5 maps 'A'..'Z' onto 'a'..'z' and no other byte
+                // into that range.
+                result = either(result, inRange(either(v, splat(0x20)), 'a', 'z'));
+            }
+            if constexpr ((mask & Underscore) != 0) {
+                result = either(result, equal(v, splat('_')));
+            }
+            return result;
+        }
+    }
+#endif
+
+    // Returns the first position in [p, end) whose byte is not in `mask`.
+    template<Mask mask>
+    [[nodiscard]] auto skip(const char* p, const char* const end) -> const char* {
+#if ACOMPILER_LEXER_SIMD
+        while (static_cast<std::size_t>(end - p) >= Detail::width) {
+            const auto inClass = Detail::bits(Detail::matches<mask>(Detail::load(p)));
+            if (inClass != 0xffff'ffffu) {
+                return p + __builtin_ctz(~inClass);
+            }
+            p += Detail::width;
+        }
+#endif
+        while (p != end && is(*p, mask)) {
+            ++p;
+        }
+        return p;
+    }
+}
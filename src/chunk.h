@@ -0,0 +1,261 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+
+namespace ByteCode {
+    using Type = std::uint8_t;
+
+    // Operand widths of the encoded stream.
+    using Index = std::uint16_t;
+    using Offset = std::int32_t;
+
+    // Every opcode except Halt, which the interpreter handles itself, followed
+    // by the number of operand bytes stored inline after it and the number of
+    // values it pops from and pushes onto the operand stack.
+    //
+    //   PushInt / PushDouble   index into Chunk::integers / Chunk::doubles
+    //   StoreSlot / LoadSlot   variable slot, named by Chunk::slots
+    //   Jz / Jmp               offset relative to the end of the jump
+    //   Shl                    shift count, below 32; doubles are scaled by 2^count
+    //   AddSlotInt             slot, then index into Chunk::integers
+    //   LoadLoad               two slots, pushed in order
+    //   StoreKeep              variable slot
+    //   EqJz / NEqJz           offset relative to the end of the jump
+    //   EqIJz / NEqIJz         offset relative to the end of the jump
+    //
+    // The I and D forms of the arithmetic and comparison opcodes take two ints
+    // and two doubles respectively. The generator only emits them where the
+    // TypeChecker proved the operand types, and they never check the tags.
+    //
+    // The last group are superinstructions, each doing the work of a sequence
+    // the fusion rules of the Peephole pass replace: EqJz is Eq; Jz, NEqJz is
+    // NEq; Jz, EqIJz and NEqIJz are the same with EqI and NEqI, AddSlotInt s
+    // k is LoadSlot s; PushInt k; Add; StoreSlot s, LoadLoad a b is LoadSlot
+    // a; LoadSlot b and StoreKeep s is Dup; StoreSlot s.
+#define BYTECODE_INSTRUCTIONS(X)                     \
+    X(Print,      0,                           1, 0) \
+    X(Pop,        0,                           1, 0) \
+    X(Dup,        0,                           1, 2) \
+    X(Add,        0,                           2, 1) \
+    X(Sub,        0,                           2, 1) \
+    X(Mul,        0,                           2, 1) \
+    X(Div,        0,                           2, 1) \
+    X(Eq,         0,                           2, 1) \
+    X(NEq,        0,                           2, 1) \
+    X(AddI,       0,                           2, 1) \
+    X(SubI,       0,                           2, 1) \
+    X(MulI,       0,                           2, 1) \
+    X(DivI,       0,                           2, 1) \
+    X(EqI,        0,                           2, 1) \
+    X(NEqI,       0,                           2, 1) \
+    X(AddD,       0,                           2, 1) \
+    X(SubD,       0,                           2, 1) \
+    X(MulD,       0,                           2, 1) \
+    X(DivD,       0,                           2, 1) \
+    X(EqD,        0,                           2, 1) \
+    X(NEqD,       0,                           2, 1) \
+    X(Neg,        0,                           1, 1) \
+    X(Not,        0,                           1, 1) \
+    X(Shl,        sizeof(ByteCode::Index),     1, 1) \
+    X(Jz,         sizeof(ByteCode::Offset),    1, 0) \
+    X(Jmp,        sizeof(ByteCode::Offset),    0, 0) \
+    X(PushInt,    sizeof(ByteCode::Index),     0, 1) \
+    X(PushDouble, sizeof(ByteCode::Index),     0, 1) \
+    X(PushTrue,   0,                           0, 1) \
+    X(PushFalse,  0,                           0, 1) \
+    X(StoreSlot,  sizeof(ByteCode::Index),     1, 0) \
+    X(LoadSlot,   sizeof(ByteCode::Index),     0, 1) \
+    X(EqJz,       sizeof(ByteCode::Offset),    2, 0) \
+    X(NEqJz,      sizeof(ByteCode::Offset),    2, 0) \
+    X(EqIJz,      sizeof(ByteCode::Offset),    2, 0) \
+    X(NEqIJz,     sizeof(ByteCode::Offset),    2, 0) \
+    X(AddSlotInt, 2 * sizeof(ByteCode::Index), 0, 0) \
+    X(LoadLoad,   2 * sizeof(ByteCode::Index), 0, 2) \
+    X(StoreKeep,  sizeof(ByteCode::Index),     1, 1)
+
+#define BYTECODE_OPCODES(X) \
+    X(Halt, 0, 0, 0)        \
+    BYTECODE_INSTRUCTIONS(X)
+
+    enum class OpCode : Type {
+#define X(name, operands, pops, pushes) name,
+        BYTECODE_OPCODES(X)
+#undef X
+    };
+
+    constexpr std::array opCodeNames = {
+#define X(name, operands, pops, pushes) #name,
+        BYTECODE_OPCODES(X)
+#undef X
+    };
+
+    constexpr std::array<std::size_t, opCodeNames.size()> operandBytes = {
+#define X(name, operands, pops, pushes) operands,
+        BYTECODE_OPCODES(X)
+#undef X
+    };
+
+    constexpr std::array<std::size_t, opCodeNames.size()> stackPops = {
+#define X(name, operands, pops, pushes) pops,
+        BYTECODE_OPCODES(X)
+#undef X
+    };
+
+    constexpr std::array<std::size_t, opCodeNames.size()> stackPushes = {
+#define X(name, operands, pops, pushes) pushes,
+        BYTECODE_OPCODES(X)
+#undef X
+    };
+
+    constexpr auto opCodeCount = opCodeNames.size();
+
+    [[nodiscard]] static constexpr auto getOpCodeName(const OpCode op) -> std::string_view {
+        return opCodeNames.at(static_cast<Type>(op));
+    }
+
+    [[nodiscard]] static constexpr auto instructionLength(const OpCode op) -> std::size_t {
+        return 1 + operandBytes.at(static_cast<Type>(op));
+    }
+
+    // Whether the operand of `op` is a jump offset.
+    [[nodiscard]] static constexpr auto isJump(const OpCode op) -> bool {
+        return op == OpCode::Jz || op == OpCode::Jmp || op == OpCode::EqJz || op == OpCode::NEqJz || op == OpCode::EqIJz || op == OpCode::NEqIJz;
+    }
+
+    // ============================================================================
+    // A compiled program: one contiguous stream of opcodes with their operands
+    // inline, plus the pools the operands index into.
+    // ============================================================================
+    struct Chunk {
+        std::vector<Type> code;
+        std::vector<int> integers;
+        std::vector<double> doubles;
+        // One entry per variable slot, holding the variable's name.
+        std::vector<std::string> slots;
+        // The first `inputs` slots are set by the caller before each run.
+        std::size_t inputs { 0 };
+        // Deepest the operand stack gets on any path through the code.
+        std::size_t maxStack { 0 };
+
+        auto write(const OpCode op) -> std::size_t {
+            const auto offset = code.size();
+            code.push_back(static_cast<Type>(op));
+            return offset;
+        }
+
+        template<typename T>
+        auto writeOperand(const T value) -> void {
+            const auto offset = code.size();
+            code.resize(offset + sizeof(T));
+            std::memcpy(code.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename T>
+        auto patchOperand(const std::size_t offset, const T value) -> void {
+            assert(offset + sizeof(T) <= code.size());
+            std::memcpy(code.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename T>
+        [[nodiscard]] auto readOperand(const std::size_t offset) const -> T {
+            T value;
+            assert(offset + sizeof(T) <= code.size());
+            std::memcpy(&value, code.data() + offset, sizeof(T));
+            return value;
+        }
+
+        [[nodiscard]] auto opAt(const std::size_t offset) const -> OpCode {
+            return static_cast<OpCode>(code[offset]);
+        }
+
+        [[nodiscard]] auto addInteger(const int value) -> Index {
+            return append(integers, value);
+        }
+
+        [[nodiscard]] auto addDouble(const double value) -> Index {
+            return append(doubles, value);
+        }
+
+        // Calls f(offset, op) for every instruction in order.
+        template<typename F>
+        auto forEachInstruction(F&& f) const -> void {
+            for (std::size_t offset = 0; offset < code.size(); offset += instructionLength(opAt(offset))) {
+                f(offset, opAt(offset));
+            }
+        }
+
+        [[nodiscard]] auto instructionCount() const -> std::size_t {
+            std::size_t count { 0 };
+            forEachInstruction([&](std::size_t, OpCode) { count++; });
+            return count;
+        }
+
+    private:
+        template<typename T>
+        [[nodiscard]] static auto append(std::vector<T>& pool, T value) -> Index {
+            assert(pool.size() < std::numeric_limits<Index>::max() && "constant pool overflow");
+            pool.push_back(std::move(value));
+            return static_cast<Index>(pool.size() - 1);
+        }
+    };
+
+    [[nodiscard]] inline auto disassemble(const Chunk& chunk) -> std::string {
+        std::string out;
+        chunk.forEachInstruction([&](const std::size_t offset, const OpCode op) {
+            out += fmt::format("{:04} {:<10}", offset, getOpCodeName(op));
+            const auto operand = offset + 1;
+
+            switch (op) {
+            case OpCode::Jz:
+            case OpCode::Jmp:
+            case OpCode::EqJz:
+            case OpCode::NEqJz:
+            case OpCode::EqIJz:
+            case OpCode::NEqIJz: {
+                const auto target = operand + sizeof(Offset) + chunk.readOperand<Offset>(operand);
+                out += fmt::format(" -> {:04}", target);
+                break;
+            }
+            case OpCode::PushInt:
+                out += fmt::format(" {}", chunk.integers[chunk.readOperand<Index>(operand)]);
+                break;
+            case OpCode::Shl:
+                out += fmt::format(" {}", chunk.readOperand<Index>(operand));
+                break;
+            case OpCode::PushDouble:
+                out += fmt::format(" {}", chunk.doubles[chunk.readOperand<Index>(operand)]);
+                break;
+            case OpCode::StoreSlot:
+            case OpCode::LoadSlot:
+            case OpCode::StoreKeep: {
+                const auto slot = chunk.readOperand<Index>(operand);
+                out += fmt::format(" {} ({})", slot, chunk.slots[slot]);
+                break;
+            }
+            case OpCode::AddSlotInt: {
+                const auto slot = chunk.readOperand<Index>(operand);
+                out += fmt::format(" {} ({}) {}", slot, chunk.slots[slot], chunk.integers[chunk.readOperand<Index>(operand + sizeof(Index))]);
+                break;
+            }
+            case OpCode::LoadLoad: {
+                const auto first = chunk.readOperand<Index>(operand);
+                const auto second = chunk.readOperand<Index>(operand + sizeof(Index));
+                out += fmt::format(" {} ({}) {} ({})", first, chunk.slots[first], second, chunk.slots[second]);
+                break;
+            }
+            default:
+                break;
+            }
+            out.erase(out.find_last_not_of(' ') + 1);
+            out += '\n';
+        });
+        return out;
+    }
+}
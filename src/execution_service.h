@@ -0,0 +1,85 @@
+#pragma once
+#include <algorithm>
+#include <future>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+#include "vm.h"
+
+struct JobResult {
+    std::optional<std::string> error;
+    std::string output;
+    // Every variable slot of the program after the run.
+    std::vector<Value> slots;
+};
+
+// ============================================================================
+// Runs many independent evaluations of compiled programs on a ThreadPool.
+// Programs are shared read-only between workers; each worker owns one
+// ExecutionContext and output buffer that it reuses for every job, so running
+// a job takes no locks and, once the buffers have grown, no allocations
+// besides the result.
+// ============================================================================
+class ExecutionService {
+public:
+    explicit ExecutionService(std::size_t threads = std::thread::hardware_concurrency())
+        : workers(std::max<std::size_t>(threads, 1)), pool { std::max<std::size_t>(threads, 1) } {}
+
+    // Runs `program` with its input slots set to `inputs`, in order. The
+    // program must outlive the returned future.
+    [[nodiscard]] auto submit(const VirtualMachine& program, std::vector<Value> inputs) -> std::future<JobResult> {
+        return this->pool.submit([this, &program, inputs = std::move(inputs)] {
+            return run(program, inputs);
+        });
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t {
+        return this->pool.size();
+    }
+
+private:
+    struct alignas(64) WorkerState {
+        std::optional<ExecutionContext> context;
+        std::ostringstream out;
+    };
+
+    auto run(const VirtualMachine& program, const std::vector<Value>& inputs) -> JobResult {
+        auto& state = this->workers[*this->pool.currentWorker()];
+        const auto& chunk = program.getChunk();
+
+        if (inputs.size() != chunk.inputs) {
+            return { .error = fmt::format("expected {} inputs, got {}", chunk.inputs, inputs.size()), .output = {}, .slots = {} };
+        }
+        if (program.hadError()) {
+            return { .error = program.getError(), .output = {}, .slots = {} };
+        }
+
+        if (state.context.has_value()) {
+            state.context->bind(chunk);
+        } else {
+            state.context.emplace(chunk, state.out);
+        }
+
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            state.context->setSlot(static_cast<ByteCode::Index>(i), inputs[i]);
+        }
+        state.out.str({});
+
+        std::ignore = program.run(*state.context);
+
+        const auto slots = state.context->getSlots();
+        return {
+            .error = std::nullopt,
+            .output = state.out.str(),
+            .slots = { slots.begin(), slots.end() },
+        };
+    }
+
+private:
+    // Declared before the pool so it outlives the worker threads.
+    std::vector<WorkerState> workers;
+    ThreadPool pool;
+};
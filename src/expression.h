@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <new>
 
 #include "token.h"
 
@@ -15,6 +17,8 @@ namespace Expressions {
     struct Variable; // variable lookup not assign
     struct Logical;
     struct Assign;
+    struct Unary;
+    struct Boolean;
 
     struct ExpressionVisitor {
         virtual void visit(BinaryOperator& expression) = 0;
@@ -23,6 +27,17 @@ namespace Expressions {
         virtual void visit(Variable& expression) = 0;
         virtual void visit(Logical& expression) = 0;
         virtual void visit(Assign& expression) = 0;
+        virtual void visit(Unary& expression) = 0;
+        virtual void visit(Boolean& expression) = 0;
+    };
+
+    // Type of an expression's value as found by the TypeChecker. Unknown
+    // before it runs, and for values whose type is only known at run time.
+    enum class StaticType : std::uint8_t {
+        Unknown,
+        Int,
+        Double,
+        Bool,
     };
 
     // ============================================================================
@@ -33,6 +48,18 @@ namespace Expressions {
         virtual ~Expression() = default;
         virtual void accept(ExpressionVisitor& visitor) = 0;
         [[nodiscard]] virtual auto to_string(std::size_t offset = 0) -> std::string const = 0;
+
+        // Nodes made by an AstArena are released with the arena, see ast_arena.h.
+        static void operator delete(Expression* expression, std::destroying_delete_t) {
+            if (expression->arenaOwned) {
+                return;
+            }
+            expression->~Expression();
+            ::operator delete(expression);
+        }
+
+        bool arenaOwned { false };
+        StaticType type { StaticType::Unknown };
     };
 
     template<typename T>
@@ -55,6 +82,7 @@ namespace Expressions {
         INumber(std::string_view sv) {
             value = std::stoi(std::string { sv });
         };
+        explicit INumber(const int value) : value { value } {};
         INumber(INumber&& other) noexcept = default;
         [[nodiscard]] auto to_string(std::size_t offset = 0) -> std::string const final { return "INumber " + std::to_string(value); };
 
@@ -65,6 +93,7 @@ namespace Expressions {
         DNumber(std::string_view sv) {
             value = std::stod(std::string { sv });
         };
+        explicit DNumber(const double value) : value { value } {};
         DNumber(DNumber&& other) noexcept = default;
         [[nodiscard]] auto to_string(std::size_t offset = 0) -> std::string const final { return "DNumber " + std::to_string(value); };
 
@@ -97,4 +126,21 @@ namespace Expressions {
         Token name;
         std::unique_ptr<Expression> value;
     };
+
+    struct Unary : public ExpressionAcceptor<Unary> {
+        Unary(Token operator_type, std::unique_ptr<Expression> operand) : operator_type { operator_type }, operand { std::move(operand) } {};
+        Unary(Unary&& other) noexcept = default;
+        [[nodiscard]] auto to_string(std::size_t offset = 0) -> std::string const final { return "Unary " + std::string { operator_type.getLexeme() } + " " + operand->to_string(); };
+
+        Token operator_type;
+        std::unique_ptr<Expression> operand;
+    };
+
+    // Not written in source; the optimizer folds comparisons into it.
+    struct Boolean : public ExpressionAcceptor<Boolean> {
+        explicit Boolean(const bool value) : value { value } {};
+        [[nodiscard]] auto to_string(std::size_t offset = 0) -> std::string const final { return value ? "Boolean true" : "Boolean false"; };
+
+        bool value;
+    };
 }
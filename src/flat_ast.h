@@ -0,0 +1,265 @@
+#pragma once
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fmt/core.h>
+
+#include "token.h"
+
+// ============================================================================
+// The AST as flat arrays. Nodes are small plain structs in one vector per
+// kind of node and refer to each other by 32-bit index; there are no vtables,
+// no owning pointers and no Token copies. Passes walk it with a switch on
+// the node's kind, see BytecodeGenerator.
+//
+// Parse into it with Parser(tokens, FlatAst::Builder {}). It prints like the
+// pointer tree, so both can be compared through to_string().
+// ============================================================================
+namespace FlatAst {
+    using Id = std::uint32_t;
+
+    // A missing child, such as an if without an else.
+    constexpr Id None = std::numeric_limits<Id>::max();
+
+    enum class ExpressionKind : std::uint8_t {
+        Integer,
+        Double,
+        Variable,
+        Binary,
+        Logical,
+        Assign,
+        Unary,
+    };
+
+    // What lhs and rhs hold depends on the kind:
+    //
+    //   kind       lhs                    rhs
+    //   Integer    the value's bits       -
+    //   Double     index into doubles     -
+    //   Variable   index into names       -
+    //   Binary     left operand           right operand
+    //   Logical    left operand           right operand
+    //   Assign     index into names       value
+    //   Unary      operand                -
+    struct Expression {
+        ExpressionKind kind;
+        // Binary, Logical and Unary: the operator's TokenType.
+        std::uint8_t op { 0 };
+        Id lhs { None };
+        Id rhs { None };
+
+        [[nodiscard]] auto operatorType() const -> TokenType {
+            return static_cast<TokenType>(this->op);
+        }
+    };
+    static_assert(sizeof(Expression) == 12);
+
+    enum class StatementKind : std::uint8_t {
+        Expression,
+        Print,
+        If,
+    };
+
+    struct Statement {
+        StatementKind kind;
+        Id expression { None };
+        // If only: statements run when the condition holds and when it does not.
+        Id then { None };
+        Id otherwise { None };
+    };
+    static_assert(sizeof(Statement) == 16);
+
+    // One use of an identifier. The parser numbers distinct identifiers, so
+    // passes can key on `symbol` instead of hashing the text.
+    struct Name {
+        // Index into Ast::symbols.
+        Id symbol;
+        // Kept for error messages.
+        TokenPosition position;
+    };
+
+    struct Ast {
+        std::vector<Expression> expressions;
+        std::vector<Statement> statements;
+        std::vector<Name> names;
+        // Text of every distinct identifier.
+        std::vector<std::string_view> symbols;
+        std::vector<double> doubles;
+        // Top level statements, in program order.
+        std::vector<Id> roots;
+
+        [[nodiscard]] auto integer(const Expression& expression) const -> int {
+            return std::bit_cast<int>(expression.lhs);
+        }
+
+        [[nodiscard]] auto lexeme(const Name& name) const -> std::string_view {
+            return this->symbols[name.symbol];
+        }
+
+        [[nodiscard]] auto token(const Name& name) const -> Token {
+            return { .ttype = TokenType::Identifier, .lexeme = lexeme(name), .position = name.position };
+        }
+
+        [[nodiscard]] auto bytes() const -> std::size_t {
+            return this->expressions.size() * sizeof(Expression) + this->statements.size() * sizeof(Statement)
+                 + this->names.size() * sizeof(Name) + this->symbols.size() * sizeof(std::string_view)
+                 + this->doubles.size() * sizeof(double) + this->roots.size() * sizeof(Id);
+        }
+
+        // Same text as Statements::Statement::to_string() for the same code.
+        [[nodiscard]] auto to_string(const Id id) const -> std::string {
+            const auto& statement = this->statements[id];
+            switch (statement.kind) {
+                case StatementKind::Expression:
+                    return "ExpressionStatement " + expressionString(statement.expression);
+                case StatementKind::Print:
+                    return "PrintStatement " + expressionString(statement.expression);
+                case StatementKind::If:
+                    return fmt::format("IfStatement {} then {} otherwise", expressionString(statement.expression), to_string(statement.then));
+            }
+            assert(false && "unknown statement kind");
+            return {};
+        }
+
+        [[nodiscard]] auto expressionString(const Id id) const -> std::string {
+            const auto& expression = this->expressions[id];
+            switch (expression.kind) {
+                case ExpressionKind::Integer:
+                    return "INumber " + std::to_string(integer(expression));
+                case ExpressionKind::Double:
+                    return "DNumber " + std::to_string(this->doubles[expression.lhs]);
+                case ExpressionKind::Variable:
+                    return "Variable " + std::string { lexeme(this->names[expression.lhs]) };
+                case ExpressionKind::Binary:
+                    return "BinaryOperator " + expressionString(expression.lhs) + " " + std::string { spelling(expression.operatorType()) } + " " + expressionString(expression.rhs);
+                case ExpressionKind::Logical:
+                    return "Logical " + expressionString(expression.lhs) + " " + std::string { spelling(expression.operatorType()) } + " " + expressionString(expression.rhs);
+                case ExpressionKind::Assign:
+                    return "Assign " + std::string { lexeme(this->names[expression.lhs]) } + " " + expressionString(expression.rhs);
+                case ExpressionKind::Unary:
+                    return "Unary " + std::string { spelling(expression.operatorType()) } + " " + expressionString(expression.lhs);
+            }
+            assert(false && "unknown expression kind");
+            return {};
+        }
+
+        [[nodiscard]] static auto spelling(const TokenType op) -> std::string_view {
+            switch (op) {
+                case TokenType::Plus:       return "+";
+                case TokenType::Minus:      return "-";
+                case TokenType::Star:       return "*";
+                case TokenType::Slash:      return "/";
+                case TokenType::EqualEqual: return "==";
+                case TokenType::BangEqual:  return "!=";
+                case TokenType::Bang:       return "!";
+                default:                    return "?";
+            }
+        }
+    };
+
+    // ========================================================================
+    // Parser builder appending to an Ast; see TreeBuilder for the interface.
+    // ========================================================================
+    class Builder {
+    public:
+        using Expression = Id;
+        using Statement = Id;
+        using Result = Ast;
+
+        [[nodiscard]] auto integer(const Token& token) -> Id {
+            return expression({ .kind = ExpressionKind::Integer, .lhs = std::bit_cast<Id>(std::stoi(std::string { token.lexeme })) });
+        }
+
+        [[nodiscard]] auto real(const Token& token) -> Id {
+            this->ast.doubles.push_back(std::stod(std::string { token.lexeme }));
+            return expression({ .kind = ExpressionKind::Double, .lhs = index(this->ast.doubles) });
+        }
+
+        [[nodiscard]] auto variable(const Token& token) -> Id {
+            const auto [found, added] = this->symbols.try_emplace(token.lexeme, static_cast<Id>(this->ast.symbols.size()));
+            if (added) {
+                this->ast.symbols.push_back(token.lexeme);
+            }
+            this->ast.names.push_back({ .symbol = found->second, .position = token.position });
+            return expression({ .kind = ExpressionKind::Variable, .lhs = index(this->ast.names) });
+        }
+
+        [[nodiscard]] auto binary(const Id lhs, const Token& op, const Id rhs) -> Id {
+            return expression({ .kind = ExpressionKind::Binary, .op = static_cast<std::uint8_t>(op.ttype), .lhs = lhs, .rhs = rhs });
+        }
+
+        [[nodiscard]] auto logical(const Id lhs, const Token& op, const Id rhs) -> Id {
+            return expression({ .kind = ExpressionKind::Logical, .op = static_cast<std::uint8_t>(op.ttype), .lhs = lhs, .rhs = rhs });
+        }
+
+        [[nodiscard]] auto unary(const Token& op, const Id operand) -> Id {
+            return expression({ .kind = ExpressionKind::Unary, .op = static_cast<std::uint8_t>(op.ttype), .lhs = operand });
+        }
+
+        [[nodiscard]] auto assignable(const Id expression) const -> bool {
+            return this->ast.expressions[expression].kind == ExpressionKind::Variable;
+        }
+
+        // Turns the target variable node into the assignment, reusing its name.
+        [[nodiscard]] auto assign(const Id target, const Id value) -> Id {
+            assert(assignable(target) && "assignment target must be a variable");
+            auto& node = this->ast.expressions[target];
+            node.kind = ExpressionKind::Assign;
+            node.rhs = value;
+            return target;
+        }
+
+        [[nodiscard]] auto expressionStatement(const Id expression) -> Id {
+            return statement({ .kind = StatementKind::Expression, .expression = expression });
+        }
+
+        [[nodiscard]] auto print(const Id expression) -> Id {
+            return statement({ .kind = StatementKind::Print, .expression = expression });
+        }
+
+        [[nodiscard]] auto ifStatement(const Id condition, const Id then, const Id otherwise) -> Id {
+            return statement({ .kind = StatementKind::If, .expression = condition, .then = then, .otherwise = otherwise });
+        }
+
+        [[nodiscard]] static auto noStatement() -> Id {
+            return None;
+        }
+
+        auto root(const Id statement) -> void {
+            this->ast.roots.push_back(statement);
+        }
+
+        [[nodiscard]] auto describe(const Id statement) const -> std::string {
+            return this->ast.to_string(statement);
+        }
+
+        [[nodiscard]] auto finish() -> Ast {
+            return std::move(this->ast);
+        }
+
+    private:
+        template<typename T>
+        [[nodiscard]] static auto index(const std::vector<T>& nodes) -> Id {
+            assert(nodes.size() <= None && "too many AST nodes for 32-bit indices");
+            return static_cast<Id>(nodes.size() - 1);
+        }
+
+        [[nodiscard]] auto expression(const FlatAst::Expression node) -> Id {
+            this->ast.expressions.push_back(node);
+            return index(this->ast.expressions);
+        }
+
+        [[nodiscard]] auto statement(const FlatAst::Statement node) -> Id {
+            this->ast.statements.push_back(node);
+            return index(this->ast.statements);
+        }
+
+        Ast ast;
+        std::unordered_map<std::string_view, Id> symbols;
+    };
+}
@@ -1,199 +1,449 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <variant>
 
+#include "chunk.h"
 #include "expression.h"
+#include "flat_ast.h"
 #include "statement.h"
+#include "trace.h"
 
-namespace ByteCode {
-    using Type = std::uint8_t;
-
-    struct Instruction {
-        virtual ~Instruction() {}
-        const char *const type = "Default";
-    };
+class BytecodeGenerator : public Expressions::ExpressionVisitor, Statements::StatementVisitor {
+    using LabelId = std::uint32_t;
 
-    struct Print : Instruction {
-        const char *const type = "Print";
-    };
-    struct Add : Instruction {
-        const char *const type = "Add";
-    };
-    struct Sub : Instruction {
-        const char *const type = "Sub";
-    };
-    struct Mul : Instruction {
-        const char *const type = "Mul";
-    };
-    struct Div : Instruction {
-        const char *const type = "Div";
-    };
-    struct Eq : Instruction {
-        const char *const type = "Eq";
-    };
-    struct NEq : Instruction {
-        const char *const type = "NEq";
+    struct LabelState {
+        std::optional<std::size_t> target;
+        // Operand offsets of jumps waiting for the target.
+        std::vector<std::size_t> fixups;
     };
-    struct Jz : Instruction {
-        Jz(std::string_view label, int offset) : label { label }, offset { offset } {}
-        const char *const type = "Jz";
-        std::string_view label;
-        int offset;
-    };
-    struct Jmp : Instruction {
-        Jmp(std::string_view label, int offset) : label { label }, offset { offset } {}
-        const char *const type = "Jmp";
-        std::string_view label;
-        int offset;
-    };
-    struct Label : Instruction {
-        Label(std::string_view label) : label { label } {}
-        const char *const type = "Label";
-        std::string_view label;
-    };
-    struct PushInt : Instruction {
-        PushInt(int value) : value { value } {}
-        const char *const type = "PushInt";
-        int value;
-    };
-    struct PushDouble : Instruction {
-        PushDouble(double value) : value { value } {}
-        const char *const type = "PushDouble";
-        double value;
-    };
-    struct Assign : Instruction {
-        Assign(std::string_view name) : name { name } {}
-        std::string_view name;
-        const char *const type = "Assign";
-    };
-    struct Variable : Instruction {
-        Variable(std::string_view name) : name { name } {}
-        const char *const type = "Variable";
-        std::string_view name;
-    };
-}
-
-namespace Label {
-
-    [[nodiscard]] static auto generate(const auto& tag) -> std::string_view {
-        static auto index = 0;
-        return std::string_view { std::string { ".Label_" } + tag + std::to_string(index++) };
-    }
-}
-
-class BytecodeGenerator : public Expressions::ExpressionVisitor, Statements::StatementVisitor {
-    using Value = std::variant<int, double, std::string>;
 
 public:
-  BytecodeGenerator(std::span<std::unique_ptr<Statements::Statement>> statements)
-      : statements{ std::move(statements) } {}
+  // Inputs are variables the caller sets before each run; they get the first
+  // slots and count as defined everywhere.
+  BytecodeGenerator(std::span<std::unique_ptr<Statements::Statement>> statements, std::span<const std::string_view> inputs = {})
+      : statements{ std::move(statements) } {
+      declare_inputs(inputs);
+  }
 
-  [[nodiscard]] auto generate() -> std::vector<std::unique_ptr<ByteCode::Instruction>> {
-      spdlog::warn("=== Start Generating ===");
+  // Generates from a flat AST, which has to outlive the generator.
+  BytecodeGenerator(const FlatAst::Ast& ast, std::span<const std::string_view> inputs = {})
+      : ast { &ast } {
+      declare_inputs(inputs);
+  }
+
+  [[nodiscard]] auto generate() -> ByteCode::Chunk {
+      TRACE(Generator, "=== Start Generating ===");
+      if (this->ast != nullptr) {
+          for (const auto root : this->ast->roots) {
+              generate_statement(root);
+          }
+      }
       for (auto &statement : this->statements) {
           statement->accept(*this);
       }
 
-      return std::move(this->instructions);
+      add_instruction(ByteCode::OpCode::Halt);
+
+      assert(std::ranges::all_of(this->labels, [](const auto& label) { return label.fixups.empty(); }) && "unbound label");
+      return std::move(this->chunk);
+  }
+
+  [[nodiscard]] auto hadError() const -> bool {
+      return not this->errors.empty();
+  }
+
+  [[nodiscard]] auto getErrors() const -> const std::vector<std::string>& {
+      return this->errors;
   }
 
 private:
+    auto declare_inputs(const std::span<const std::string_view> inputs) -> void {
+        for (const auto input : inputs) {
+            this->defined[slot(input)] = true;
+        }
+        this->chunk.inputs = this->chunk.slots.size();
+    }
+
+    auto add_instruction(const ByteCode::OpCode op) -> void {
+        TRACE(Generator, "Add instruction {}", ByteCode::getOpCodeName(op));
+        this->chunk.write(op);
+
+        const auto index = static_cast<ByteCode::Type>(op);
+        // Operands skipped because of an error can make the count come up short.
+        assert(this->depth >= ByteCode::stackPops[index] || hadError());
+        this->depth = std::max(this->depth, ByteCode::stackPops[index]) - ByteCode::stackPops[index] + ByteCode::stackPushes[index];
+        this->chunk.maxStack = std::max(this->chunk.maxStack, this->depth);
+    }
+
     template<typename T>
-    auto add_instruction(const T& instruction) -> void {
-        spdlog::info(fmt::format("Add instruction {}", instruction.type));
-        this->instructions.emplace_back(std::make_unique<T>(instruction));
+    auto add_instruction(const ByteCode::OpCode op, const T operand) -> void {
+        add_instruction(op);
+        this->chunk.writeOperand(operand);
+    }
+
+    [[nodiscard]] auto constant(const int value) -> ByteCode::Index {
+        return intern(this->integers_index, value, [&] { return this->chunk.addInteger(value); });
+    }
+
+    [[nodiscard]] auto constant(const double value) -> ByteCode::Index {
+        // Keyed on the bit pattern so 0.0 and -0.0 stay distinct.
+        return intern(this->doubles_index, std::bit_cast<std::uint64_t>(value), [&] { return this->chunk.addDouble(value); });
+    }
+
+    [[nodiscard]] auto slot(const std::string_view name) -> ByteCode::Index {
+        if (const auto found = this->variables_index.find(name); found != this->variables_index.end()) {
+            return found->second;
+        }
+        assert(this->chunk.slots.size() < std::numeric_limits<ByteCode::Index>::max() && "too many variables");
+        const auto index = static_cast<ByteCode::Index>(this->chunk.slots.size());
+        this->chunk.slots.emplace_back(name);
+        this->variables_index.emplace(name, index);
+        this->defined.push_back(false);
+        return index;
     }
 
     // ------------------------------------------------------------------------
-    // Statements
+    // Labels: jumps to a label that is not bound yet are recorded and patched
+    // once bind_label() knows the target, so every jump is written once and
+    // patched at most once.
     // ------------------------------------------------------------------------
-    auto visit(Statements::ExpressionStatement& statement) -> void override {
-        statement.expression->accept(*this);
+    [[nodiscard]] auto new_label() -> LabelId {
+        this->labels.emplace_back();
+        return static_cast<LabelId>(this->labels.size() - 1);
     }
 
-    auto visit(Statements::Print&               statement) -> void override {
-        statement.expression->accept(*this);
-        add_instruction(ByteCode::Print {});
+    auto emit_jump(const ByteCode::OpCode op, const LabelId label) -> void {
+        add_instruction(op);
+        const auto operand = this->chunk.code.size();
+        this->chunk.writeOperand(ByteCode::Offset { 0 });
+
+        auto& state = this->labels[label];
+        if (state.target.has_value()) {
+            patch_jump(operand, *state.target);
+        } else {
+            state.fixups.push_back(operand);
+        }
     }
 
-    auto visit(Statements::IfStatement&         statement) -> void override {
-        statement.condition->accept(*this);
+    auto bind_label(const LabelId label) -> void {
+        auto& state = this->labels[label];
+        assert(not state.target.has_value() && "label bound twice");
+        state.target = this->chunk.code.size();
+
+        for (const auto operand : state.fixups) {
+            patch_jump(operand, *state.target);
+        }
+        state.fixups.clear();
+    }
+
+    auto patch_jump(const std::size_t operand, const std::size_t target) -> void {
+        const auto offset = static_cast<std::ptrdiff_t>(target) - static_cast<std::ptrdiff_t>(operand + sizeof(ByteCode::Offset));
+        assert(offset >= std::numeric_limits<ByteCode::Offset>::min() && offset <= std::numeric_limits<ByteCode::Offset>::max());
+        this->chunk.patchOperand(operand, static_cast<ByteCode::Offset>(offset));
+    }
+
+    auto error(const Token& token, const std::string& message) -> void {
+        this->errors.push_back(fmt::format("[line {}] Error at '{}': {}", token.position.line, token.getLexeme(), message));
+    }
+
+    template<typename Key, typename Append>
+    [[nodiscard]] static auto intern(std::unordered_map<Key, ByteCode::Index>& index, Key key, Append&& append) -> ByteCode::Index {
+        if (const auto found = index.find(key); found != index.end()) {
+            return found->second;
+        }
+        const auto added = append();
+        index.emplace(std::move(key), added);
+        return added;
+    }
+
+    // ------------------------------------------------------------------------
+    // Code shared by both ASTs. Children are generated by the callables.
+    // ------------------------------------------------------------------------
+    template<typename Expression>
+    auto expression_statement(Expression&& expression) -> void {
+        // Statements leave the stack as they found it, so discard the value
+        // of anything other than an assignment.
+        const auto before = this->depth;
+        expression();
+        if (this->depth > before) {
+            add_instruction(ByteCode::OpCode::Pop);
+        }
+    }
+
+    template<typename Condition, typename Then, typename Otherwise>
+    auto if_statement(Condition&& condition, Then&& then, Otherwise&& otherwise) -> void {
+        condition();
+
+        const auto else_label = new_label();
+        const auto end_if_label = new_label();
+
+        emit_jump(ByteCode::OpCode::Jz, else_label);
 
-        auto else_label = Label::generate("else");
-        auto end_if_label = Label::generate("end_if");
+        // A variable is only defined after the if when both branches define it.
+        const auto defined_before = this->defined;
 
-        add_instruction(ByteCode::Jz(else_label, 0));
+        then();
 
-        statement.then->accept(*this);
+        auto defined_after_then = this->defined;
+        this->defined = defined_before;
+        this->defined.resize(defined_after_then.size(), false);
 
-        add_instruction(ByteCode::Jmp(end_if_label, 0));
-        add_instruction(ByteCode::Label(else_label));
+        emit_jump(ByteCode::OpCode::Jmp, end_if_label);
+        bind_label(else_label);
 
-        if (statement.otherwise != nullptr) {
-            statement.otherwise->accept(*this);
+        otherwise();
+
+        defined_after_then.resize(this->defined.size(), false);
+        for (std::size_t i = 0; i < this->defined.size(); ++i) {
+            this->defined[i] = this->defined[i] && defined_after_then[i];
+        }
+
+        bind_label(end_if_label);
+    }
+
+    // `operands` is the type of both operands when the TypeChecker proved
+    // it, which selects the opcode that skips the VM's tag checks.
+    auto binary(const TokenType op, const Expressions::StaticType operands = Expressions::StaticType::Unknown) -> void {
+        using enum ByteCode::OpCode;
+        switch (op) {
+            case TokenType::Plus:  return add_instruction(specialized(operands, Add, AddI, AddD));
+            case TokenType::Minus: return add_instruction(specialized(operands, Sub, SubI, SubD));
+            case TokenType::Star:  return add_instruction(specialized(operands, Mul, MulI, MulD));
+            case TokenType::Slash: return add_instruction(specialized(operands, Div, DivI, DivD));
+            default: break;
+        };
+    }
+
+    auto logical(const TokenType op, const Expressions::StaticType operands = Expressions::StaticType::Unknown) -> void {
+        using enum ByteCode::OpCode;
+        switch (op) {
+            case TokenType::EqualEqual:
+                return add_instruction(specialized(operands, Eq, EqI, EqD));
+            case TokenType::BangEqual:
+                return add_instruction(specialized(operands, NEq, NEqI, NEqD));
+            default:
+                assert(false);
+        }
+    }
+
+    [[nodiscard]] static auto specialized(const Expressions::StaticType operands, const ByteCode::OpCode generic, const ByteCode::OpCode ints, const ByteCode::OpCode doubles) -> ByteCode::OpCode {
+        switch (operands) {
+            case Expressions::StaticType::Int:    return ints;
+            case Expressions::StaticType::Double: return doubles;
+            default:                              return generic;
+        }
+    }
+
+    // The common type of two operands, or Unknown.
+    [[nodiscard]] static auto operand_type(const Expressions::Expression& lhs, const Expressions::Expression& rhs) -> Expressions::StaticType {
+        return lhs.type == rhs.type ? lhs.type : Expressions::StaticType::Unknown;
+    }
+
+    auto unary(const TokenType op) -> void {
+        switch (op) {
+            case TokenType::Minus:
+                return add_instruction(ByteCode::OpCode::Neg);
+            case TokenType::Bang:
+                return add_instruction(ByteCode::OpCode::Not);
+            default:
+                assert(false);
+        }
+    }
+
+    // `found` is the variable's slot, if it has one.
+    auto load(const Token& name, const std::optional<ByteCode::Index> found) -> void {
+        TRACE(Generator, "Variable expr pushing: {}", name.getLexeme());
+
+        if (not found.has_value()) {
+            return error(name, "Undefined variable.");
         }
+        if (not this->defined[*found]) {
+            return error(name, "Variable might not be defined on every path.");
+        }
+
+        add_instruction(ByteCode::OpCode::LoadSlot, *found);
+    }
+
+    // An assignment whose value is used, as in `print a := 5;` or
+    // `a := b := 3;`, leaves it on the stack.
+    auto store(const ByteCode::Index index, const bool keep) -> void {
+        this->defined[index] = true;
+        add_instruction(ByteCode::OpCode::StoreSlot, index);
+        if (keep) {
+            add_instruction(ByteCode::OpCode::LoadSlot, index);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Pointer tree: Statements
+    // ------------------------------------------------------------------------
+    auto visit(Statements::ExpressionStatement& statement) -> void override {
+        this->discarded = statement.expression.get();
+        expression_statement([&] { statement.expression->accept(*this); });
+    }
 
-        add_instruction(ByteCode::Label(end_if_label));
+    auto visit(Statements::Print&               statement) -> void override {
+        statement.expression->accept(*this);
+        add_instruction(ByteCode::OpCode::Print);
+    }
+
+    auto visit(Statements::IfStatement&         statement) -> void override {
+        if_statement(
+            [&] { statement.condition->accept(*this); },
+            [&] {
+                if (statement.then != nullptr) {
+                    statement.then->accept(*this);
+                }
+            },
+            [&] {
+                if (statement.otherwise != nullptr) {
+                    statement.otherwise->accept(*this);
+                }
+            });
     }
 
     // ------------------------------------------------------------------------
-    // Expressions
+    // Pointer tree: Expressions
     // ------------------------------------------------------------------------
     auto visit(Expressions::BinaryOperator&     expression) -> void override {
         expression.lhs->accept(*this);
         expression.rhs->accept(*this);
-
-        switch (expression.operator_type.getLexeme()[0]) {
-            case '+': return add_instruction(ByteCode::Add {});
-            case '-': return add_instruction(ByteCode::Sub {});
-            case '*': return add_instruction(ByteCode::Mul {});
-            case '/': return add_instruction(ByteCode::Div {});
-        };
+        binary(expression.operator_type.ttype, operand_type(*expression.lhs, *expression.rhs));
     }
 
     auto visit(Expressions::INumber&            expression) -> void override {
-        add_instruction(ByteCode::PushInt(expression.value));
+        add_instruction(ByteCode::OpCode::PushInt, constant(expression.value));
     }
     auto visit(Expressions::DNumber&            expression) -> void override {
-        add_instruction(ByteCode::PushDouble(expression.value));
+        add_instruction(ByteCode::OpCode::PushDouble, constant(expression.value));
     }
 
     auto visit(Expressions::Variable&            expression) -> void override {
-        spdlog::info(fmt::format("Variable expr pushing: {}", expression.name.getLexeme()));
-        add_instruction(ByteCode::Variable(expression.name.getLexeme()));
-        //add_instruction(ByteCode::Instruction::PUSH_DOUBLE);
-        //add_instruction(expression.value);
+        const auto found = this->variables_index.find(expression.name.getLexeme());
+        if (found == this->variables_index.end()) {
+            return load(expression.name, std::nullopt);
+        }
+        load(expression.name, found->second);
     }
 
     auto visit(Expressions::Logical&             expression) -> void override {
         expression.lhs->accept(*this);
         expression.rhs->accept(*this);
-        switch (expression.operator_type.ttype) {
-            case TokenType::EqualEqual:
-                return add_instruction(ByteCode::Eq {});
-            case TokenType::BangEqual:
-                return add_instruction(ByteCode::NEq {});
-            default:
-                assert(false);
-        }
+        logical(expression.operator_type.ttype, operand_type(*expression.lhs, *expression.rhs));
     }
 
     auto visit(Expressions::Assign&            expression) -> void override {
         expression.value->accept(*this);
-        add_instruction(ByteCode::Assign(expression.name.getLexeme()));
-        // OLD
-        //if (!variables_index.contains(expression.name.getLexeme())) {
-            //variables_index.emplace(expression.name.getLexeme(), variables_index.size());
-        //}
-        //add_instruction(variables_index.at(expression.name.getLexeme()));
+        store(slot(expression.name.getLexeme()), &expression != this->discarded);
+    }
+
+    auto visit(Expressions::Boolean&           expression) -> void override {
+        add_instruction(expression.value ? ByteCode::OpCode::PushTrue : ByteCode::OpCode::PushFalse);
+    }
+
+    auto visit(Expressions::Unary&             expression) -> void override {
+        expression.operand->accept(*this);
+        unary(expression.operator_type.ttype);
+    }
+
+    // ------------------------------------------------------------------------
+    // Flat AST: one switch per node, no virtual calls
+    // ------------------------------------------------------------------------
+    auto generate_statement(const FlatAst::Id id) -> void {
+        const auto& statement = this->ast->statements[id];
+        switch (statement.kind) {
+            case FlatAst::StatementKind::Expression:
+                this->discarded_id = statement.expression;
+                return expression_statement([&] { generate_expression(statement.expression); });
+            case FlatAst::StatementKind::Print:
+                generate_expression(statement.expression);
+                return add_instruction(ByteCode::OpCode::Print);
+            case FlatAst::StatementKind::If:
+                return if_statement(
+                    [&] { generate_expression(statement.expression); },
+                    [&] { generate_statement(statement.then); },
+                    [&] {
+                        if (statement.otherwise != FlatAst::None) {
+                            generate_statement(statement.otherwise);
+                        }
+                    });
+        }
+    }
+
+    auto generate_expression(const FlatAst::Id id) -> void {
+        const auto& expression = this->ast->expressions[id];
+        switch (expression.kind) {
+            case FlatAst::ExpressionKind::Integer:
+                return add_instruction(ByteCode::OpCode::PushInt, constant(this->ast->integer(expression)));
+            case FlatAst::ExpressionKind::Double:
+                return add_instruction(ByteCode::OpCode::PushDouble, constant(this->ast->doubles[expression.lhs]));
+            case FlatAst::ExpressionKind::Variable: {
+                const auto& name = this->ast->names[expression.lhs];
+                return load(this->ast->token(name), symbol_slot(name.symbol, false));
+            }
+            case FlatAst::ExpressionKind::Binary:
+                generate_expression(expression.lhs);
+                generate_expression(expression.rhs);
+                return binary(expression.operatorType());
+            case FlatAst::ExpressionKind::Logical:
+                generate_expression(expression.lhs);
+                generate_expression(expression.rhs);
+                return logical(expression.operatorType());
+            case FlatAst::ExpressionKind::Assign:
+                generate_expression(expression.rhs);
+                return store(*symbol_slot(this->ast->names[expression.lhs].symbol, true), id != this->discarded_id);
+            case FlatAst::ExpressionKind::Unary:
+                generate_expression(expression.lhs);
+                return unary(expression.operatorType());
+        }
+    }
+
+    // Slot of an identifier of the flat AST, given a slot first if `create`.
+    // Cached per symbol, so each distinct name is hashed once.
+    [[nodiscard]] auto symbol_slot(const FlatAst::Id symbol, const bool create) -> std::optional<ByteCode::Index> {
+        if (this->symbol_slots.empty()) {
+            this->symbol_slots.resize(this->ast->symbols.size());
+        }
+        auto& cached = this->symbol_slots[symbol];
+        if (cached.has_value()) {
+            return cached;
+        }
+
+        const auto name = this->ast->symbols[symbol];
+        if (const auto found = this->variables_index.find(name); found != this->variables_index.end()) {
+            cached = found->second;
+        } else if (create) {
+            cached = slot(name);
+        }
+        return cached;
     }
 private:
-    std::unordered_map<std::string_view, int> variables_index;
-    //std::unordered_map<std::string, Value> variables_values;
-    std::vector<std::unique_ptr<ByteCode::Instruction>> instructions;
+    std::unordered_map<std::string_view, ByteCode::Index> variables_index;
+    // Per slot: is the variable assigned on every path reaching this point?
+    std::vector<bool> defined;
+    std::vector<std::string> errors;
+    std::unordered_map<int, ByteCode::Index> integers_index;
+    std::unordered_map<std::uint64_t, ByteCode::Index> doubles_index;
+    // The expression of the current expression statement, whose value is
+    // discarded, in either AST.
+    const Expressions::Expression* discarded { nullptr };
+    FlatAst::Id discarded_id { FlatAst::None };
+    std::vector<LabelState> labels;
+    // Operand stack depth at the end of the code emitted so far.
+    std::size_t depth { 0 };
+    ByteCode::Chunk chunk;
     std::span<std::unique_ptr<Statements::Statement>> statements;
+    const FlatAst::Ast* ast { nullptr };
+    // Per symbol of `ast`: its slot, once looked up.
+    std::vector<std::optional<ByteCode::Index>> symbol_slots;
 };
@@ -0,0 +1,704 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "chunk.h"
+#include "trace.h"
+#include "vm.h"
+
+// The JIT emits x86-64 machine code into mmap'd memory, so it is only built
+// on Linux x86-64; -DACOMPILER_JIT=0 turns it off anywhere.
+#ifndef ACOMPILER_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define ACOMPILER_JIT 1
+#else
+#define ACOMPILER_JIT 0
+#endif
+#endif
+
+#if ACOMPILER_JIT
+#include <sys/mman.h>
+#endif
+
+namespace Jit {
+
+    // ============================================================================
+    // Static types of slots and stack entries. Each is a set of the types it
+    // may hold, so merging two paths is their union; the JIT only compiles
+    // code where every value read has exactly one type.
+    // ============================================================================
+    using Types = std::uint8_t;
+
+    constexpr Types Undefined = 1 << 0;
+    constexpr Types Int       = 1 << 1;
+    constexpr Types Boolean   = 1 << 2;
+
+    [[nodiscard]] constexpr auto known(const Types types) -> bool {
+        return types == Int || types == Boolean;
+    }
+
+    struct State {
+        std::vector<Types> stack;
+        std::vector<Types> slots;
+
+        // Returns true if the merge changed this state.
+        auto merge(const State& other) -> bool {
+            assert(stack.size() == other.stack.size());
+            bool changed { false };
+            for (std::size_t i = 0; i < stack.size(); ++i) {
+                changed |= (stack[i] | other.stack[i]) != stack[i];
+                stack[i] |= other.stack[i];
+            }
+            for (std::size_t i = 0; i < slots.size(); ++i) {
+                changed |= (slots[i] | other.slots[i]) != slots[i];
+                slots[i] |= other.slots[i];
+            }
+            return changed;
+        }
+    };
+
+    struct Analysis {
+        // State on entry to each instruction; empty for unreachable ones.
+        std::vector<std::optional<State>> states;
+        // Slot types when the program halts.
+        std::vector<Types> result;
+    };
+
+    // Infers the type of every value in a verified chunk. Returns nothing if
+    // the chunk uses doubles or anything else the JIT cannot compile.
+    [[nodiscard]] static auto analyze(const ByteCode::Chunk& chunk) -> std::optional<Analysis> {
+        using enum ByteCode::OpCode;
+
+        Analysis analysis;
+        analysis.states.resize(chunk.code.size());
+        analysis.result.assign(chunk.slots.size(), 0);
+
+        State entry { {}, std::vector<Types>(chunk.slots.size(), Undefined) };
+        std::fill_n(entry.slots.begin(), chunk.inputs, Int);
+        analysis.states[0] = std::move(entry);
+
+        std::vector<std::size_t> worklist { 0 };
+
+        const auto flowTo = [&](const std::size_t target, const State& state) {
+            auto& existing = analysis.states[target];
+            if (not existing.has_value()) {
+                existing = state;
+                worklist.push_back(target);
+            } else if (existing->merge(state)) {
+                worklist.push_back(target);
+            }
+        };
+
+        while (not worklist.empty()) {
+            const auto offset = worklist.back();
+            worklist.pop_back();
+
+            auto state = *analysis.states[offset];
+            auto& stack = state.stack;
+            const auto op = chunk.opAt(offset);
+            const auto next = offset + ByteCode::instructionLength(op);
+
+            const auto pop = [&] {
+                const auto top = stack.back();
+                stack.pop_back();
+                return top;
+            };
+
+            switch (op) {
+            case Halt:
+                for (std::size_t i = 0; i < state.slots.size(); ++i) {
+                    analysis.result[i] |= state.slots[i];
+                }
+                continue;
+            case Print:
+            case StoreSlot: {
+                const auto value = pop();
+                if (not known(value)) {
+                    TRACE(VM, "JIT: {:04}: {} of a value of unknown type", offset, ByteCode::getOpCodeName(op));
+                    return std::nullopt;
+                }
+                if (op == StoreSlot) {
+                    state.slots[chunk.readOperand<ByteCode::Index>(offset + 1)] = value;
+                }
+                break;
+            }
+            case Pop:
+                std::ignore = pop();
+                break;
+            case Dup:
+                stack.push_back(stack.back());
+                break;
+            case Add:
+            case Sub:
+            case Mul:
+            case Div:
+            case Eq:
+            case NEq:
+            case AddI:
+            case SubI:
+            case MulI:
+            case DivI:
+            case EqI:
+            case NEqI: {
+                const auto b = pop();
+                const auto a = pop();
+                // Like the interpreter, only ints are compared.
+                if (a != Int || b != Int) {
+                    TRACE(VM, "JIT: {:04}: unsupported operand types for {}", offset, ByteCode::getOpCodeName(op));
+                    return std::nullopt;
+                }
+                stack.push_back(op == Eq || op == NEq || op == EqI || op == NEqI ? Boolean : Int);
+                break;
+            }
+            case AddD:
+            case SubD:
+            case MulD:
+            case DivD:
+            case EqD:
+            case NEqD:
+                TRACE(VM, "JIT: {:04}: doubles are not supported", offset);
+                return std::nullopt;
+            case Neg:
+            case Not:
+            case Shl: {
+                const auto value = pop();
+                if (value != (op == Not ? Boolean : Int)) {
+                    TRACE(VM, "JIT: {:04}: unsupported operand type for {}", offset, ByteCode::getOpCodeName(op));
+                    return std::nullopt;
+                }
+                stack.push_back(value);
+                break;
+            }
+            case Jz:
+                if (pop() != Boolean) {
+                    TRACE(VM, "JIT: {:04}: Jz on a non-boolean", offset);
+                    return std::nullopt;
+                }
+                break;
+            case Jmp:
+                break;
+            case PushInt:
+                stack.push_back(Int);
+                break;
+            case PushDouble:
+                TRACE(VM, "JIT: {:04}: doubles are not supported", offset);
+                return std::nullopt;
+            case PushTrue:
+            case PushFalse:
+                stack.push_back(Boolean);
+                break;
+            case LoadSlot:
+            case LoadLoad: {
+                const std::size_t count = op == LoadLoad ? 2 : 1;
+                for (std::size_t i = 0; i < count; ++i) {
+                    const auto value = state.slots[chunk.readOperand<ByteCode::Index>(offset + 1 + i * sizeof(ByteCode::Index))];
+                    if (not known(value)) {
+                        TRACE(VM, "JIT: {:04}: load of a slot of unknown type", offset);
+                        return std::nullopt;
+                    }
+                    stack.push_back(value);
+                }
+                break;
+            }
+            case EqJz:
+            case NEqJz:
+            case EqIJz:
+            case NEqIJz: {
+                const auto b = pop();
+                const auto a = pop();
+                if (a != Int || b != Int) {
+                    TRACE(VM, "JIT: {:04}: unsupported operand types for {}", offset, ByteCode::getOpCodeName(op));
+                    return std::nullopt;
+                }
+                break;
+            }
+            case AddSlotInt:
+                if (state.slots[chunk.readOperand<ByteCode::Index>(offset + 1)] != Int) {
+                    TRACE(VM, "JIT: {:04}: AddSlotInt on a slot that is not an int", offset);
+                    return std::nullopt;
+                }
+                break;
+            case StoreKeep:
+                if (not known(stack.back())) {
+                    TRACE(VM, "JIT: {:04}: {} of a value of unknown type", offset, ByteCode::getOpCodeName(op));
+                    return std::nullopt;
+                }
+                state.slots[chunk.readOperand<ByteCode::Index>(offset + 1)] = stack.back();
+                break;
+            }
+
+            if (ByteCode::isJump(op)) {
+                flowTo(next + chunk.readOperand<ByteCode::Offset>(offset + 1), state);
+            }
+            if (op != Jmp) {
+                flowTo(next, state);
+            }
+        }
+
+        // The result could not be written back with the right type.
+        for (const auto types : analysis.result) {
+            if ((types & Int) && (types & Boolean)) {
+                TRACE(VM, "JIT: a slot holds an int on one path and a bool on another");
+                return std::nullopt;
+            }
+        }
+
+        return analysis;
+    }
+
+#if ACOMPILER_JIT
+    // ============================================================================
+    // Owns a page-aligned block of read-only, executable memory.
+    // ============================================================================
+    class ExecutableMemory {
+    public:
+        ExecutableMemory() = default;
+
+        // Copies `code` into fresh pages, then flips them from writable to
+        // executable. Empty on failure.
+        explicit ExecutableMemory(std::span<const std::uint8_t> code) : length { code.size() } {
+            void* memory = mmap(nullptr, this->length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                this->length = 0;
+                return;
+            }
+            std::memcpy(memory, code.data(), code.size());
+            if (mprotect(memory, this->length, PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, this->length);
+                this->length = 0;
+                return;
+            }
+            this->memory = memory;
+        }
+
+        ExecutableMemory(ExecutableMemory&& other) noexcept
+            : memory { std::exchange(other.memory, nullptr) }, length { std::exchange(other.length, 0) } {}
+
+        auto operator=(ExecutableMemory&& other) noexcept -> ExecutableMemory& {
+            std::swap(this->memory, other.memory);
+            std::swap(this->length, other.length);
+            return *this;
+        }
+
+        ~ExecutableMemory() {
+            if (this->memory != nullptr) {
+                munmap(this->memory, this->length);
+            }
+        }
+
+        [[nodiscard]] auto get() const -> const void* {
+            return this->memory;
+        }
+
+    private:
+        void* memory { nullptr };
+        std::size_t length { 0 };
+    };
+
+    // ============================================================================
+    // Append-only buffer of machine code.
+    // ============================================================================
+    class Assembler {
+    public:
+        auto emit(std::initializer_list<std::uint8_t> bytes) -> void {
+            this->code.insert(this->code.end(), bytes);
+        }
+
+        template<typename T>
+        auto emitValue(const T value) -> void {
+            const auto offset = this->code.size();
+            this->code.resize(offset + sizeof(T));
+            std::memcpy(this->code.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename T>
+        auto patch(const std::size_t offset, const T value) -> void {
+            std::memcpy(this->code.data() + offset, &value, sizeof(T));
+        }
+
+        [[nodiscard]] auto position() const -> std::size_t {
+            return this->code.size();
+        }
+
+        std::vector<std::uint8_t> code;
+    };
+
+    // Called from generated code to print; their output matches PrintVisitor.
+    static auto printInt(std::ostream* out, const std::int32_t value) -> void {
+        *out << value << '\n';
+    }
+
+    static auto printBool(std::ostream* out, const std::int32_t value) -> void {
+        *out << (value != 0 ? "true" : "false") << '\n';
+    }
+
+    // ============================================================================
+    // A chunk compiled to native code.
+    //
+    // The generated function takes a frame of 32-bit words and the output
+    // stream. The frame holds every slot followed by the operand stack; as
+    // the stack depth at each instruction is known statically, every value
+    // lives at a fixed frame offset and no stack pointer is kept. Ints are
+    // stored as themselves and bools as 0 or 1. The function returns 0, or 1
+    // if it stopped on a division by zero.
+    //
+    // Registers: rbx points at the frame and r12 holds the output stream,
+    // both callee saved so they survive the calls to the print helpers.
+    // ============================================================================
+    class Program {
+        using Entry = std::int32_t (*)(std::int32_t* frame, std::ostream* out);
+
+    public:
+        [[nodiscard]] static auto compile(const ByteCode::Chunk& chunk) -> std::optional<Program> {
+            using enum ByteCode::OpCode;
+
+            auto analysis = analyze(chunk);
+            if (not analysis.has_value()) {
+                return std::nullopt;
+            }
+
+            const auto slots = chunk.slots.size();
+            // [rbx + disp32] addressing of frame word i.
+            const auto disp = [](const std::size_t word) { return static_cast<std::int32_t>(word * sizeof(std::int32_t)); };
+
+            Assembler a;
+            // Every memory operand below is [rbx + disp32], ModRM mod=10 rm=011.
+            const auto memory = [&](std::initializer_list<std::uint8_t> opcode, const std::uint8_t reg, const std::size_t word) {
+                a.emit(opcode);
+                a.emit({ static_cast<std::uint8_t>(0x83 | (reg << 3)) });
+                a.emitValue(disp(word));
+            };
+            constexpr std::uint8_t eax = 0;
+            constexpr std::uint8_t ecx = 1;
+            constexpr std::uint8_t esi = 6;
+            const auto load = [&](const std::size_t word) { memory({ 0x8b }, eax, word); };
+            const auto store = [&](const std::size_t word) { memory({ 0x89 }, eax, word); };
+
+            // push rbx; push r12; sub rsp, 8 (realigns the stack for calls);
+            // mov rbx, rdi; mov r12, rsi
+            a.emit({ 0x53, 0x41, 0x54, 0x48, 0x83, 0xec, 0x08, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4 });
+
+            std::vector<std::size_t> native(chunk.code.size(), 0);
+            // (position of a rel32, bytecode target)
+            std::vector<std::pair<std::size_t, std::size_t>> fixups;
+            // Positions of the rel32s of jumps to the division by zero exit.
+            std::vector<std::size_t> divisionByZero;
+
+            chunk.forEachInstruction([&](const std::size_t offset, const ByteCode::OpCode op) {
+                native[offset] = a.position();
+                const auto& state = analysis->states[offset];
+                if (not state.has_value()) {
+                    return;
+                }
+
+                // Frame words of the top two stack entries.
+                const auto depth = state->stack.size();
+                const auto top = slots + depth - 1;
+                const auto second = slots + depth - 2;
+                const auto operand = offset + 1;
+                const auto next = offset + ByteCode::instructionLength(op);
+
+                switch (op) {
+                case Halt:
+                    // xor eax, eax; add rsp, 8; pop r12; pop rbx; ret
+                    a.emit({ 0x31, 0xc0, 0x48, 0x83, 0xc4, 0x08, 0x41, 0x5c, 0x5b, 0xc3 });
+                    break;
+                case Print: {
+                    const auto helper = state->stack.back() == Int ? &printInt : &printBool;
+                    // mov rdi, r12; mov esi, [top]; mov rax, helper; call rax
+                    a.emit({ 0x4c, 0x89, 0xe7 });
+                    memory({ 0x8b }, esi, top);
+                    a.emit({ 0x48, 0xb8 });
+                    a.emitValue(reinterpret_cast<std::uint64_t>(helper));
+                    a.emit({ 0xff, 0xd0 });
+                    break;
+                }
+                case Pop:
+                    break;
+                case Dup:
+                    load(top);
+                    store(top + 1);
+                    break;
+                case Add:
+                case AddI:
+                    load(second);
+                    memory({ 0x03 }, eax, top);
+                    store(second);
+                    break;
+                case Sub:
+                case SubI:
+                    load(second);
+                    memory({ 0x2b }, eax, top);
+                    store(second);
+                    break;
+                case Mul:
+                case MulI:
+                    load(second);
+                    memory({ 0x0f, 0xaf }, eax, top);
+                    store(second);
+                    break;
+                case Div:
+                case DivI:
+                    // mov ecx, [top]; test ecx, ecx; jz division_by_zero
+                    load(second);
+                    memory({ 0x8b }, ecx, top);
+                    a.emit({ 0x85, 0xc9, 0x0f, 0x84 });
+                    divisionByZero.push_back(a.position());
+                    a.emitValue<std::int32_t>(0);
+                    // idiv traps on INT_MIN / -1, so x / -1 is a wrapping
+                    // negation: cmp ecx, -1; jne idiv; neg eax; jmp done;
+                    // idiv: cdq; idiv ecx; done:
+                    a.emit({ 0x83, 0xf9, 0xff, 0x75, 0x04, 0xf7, 0xd8, 0xeb, 0x03, 0x99, 0xf7, 0xf9 });
+                    store(second);
+                    break;
+                case Eq:
+                case NEq:
+                case EqI:
+                case NEqI:
+                    // cmp eax, [top]; sete/setne al; movzx eax, al
+                    load(second);
+                    memory({ 0x3b }, eax, top);
+                    a.emit({ 0x0f, static_cast<std::uint8_t>(op == Eq || op == EqI ? 0x94 : 0x95), 0xc0, 0x0f, 0xb6, 0xc0 });
+                    store(second);
+                    break;
+                case Neg:
+                    // neg dword [top]
+                    memory({ 0xf7 }, 3, top);
+                    break;
+                case Not:
+                    // xor dword [top], 1
+                    memory({ 0x83 }, 6, top);
+                    a.emit({ 0x01 });
+                    break;
+                case Shl:
+                    // shl dword [top], imm8
+                    memory({ 0xc1 }, 4, top);
+                    a.emit({ static_cast<std::uint8_t>(chunk.readOperand<ByteCode::Index>(operand)) });
+                    break;
+                case Jz:
+                    // test eax, eax; jz rel32
+                    load(top);
+                    a.emit({ 0x85, 0xc0, 0x0f, 0x84 });
+                    fixups.emplace_back(a.position(), next + chunk.readOperand<ByteCode::Offset>(operand));
+                    a.emitValue<std::int32_t>(0);
+                    break;
+                case Jmp:
+                    a.emit({ 0xe9 });
+                    fixups.emplace_back(a.position(), next + chunk.readOperand<ByteCode::Offset>(operand));
+                    a.emitValue<std::int32_t>(0);
+                    break;
+                case PushInt:
+                    // mov dword [top + 1], imm32
+                    memory({ 0xc7 }, 0, top + 1);
+                    a.emitValue<std::int32_t>(chunk.integers[chunk.readOperand<ByteCode::Index>(operand)]);
+                    break;
+                case PushDouble:
+                case AddD:
+                case SubD:
+                case MulD:
+                case DivD:
+                case EqD:
+                case NEqD:
+                    assert(false && "rejected by analyze()");
+                    break;
+                case PushTrue:
+                case PushFalse:
+                    memory({ 0xc7 }, 0, top + 1);
+                    a.emitValue<std::int32_t>(op == PushTrue ? 1 : 0);
+                    break;
+                case StoreSlot:
+                    load(top);
+                    store(chunk.readOperand<ByteCode::Index>(operand));
+                    break;
+                case LoadSlot:
+                    load(chunk.readOperand<ByteCode::Index>(operand));
+                    store(top + 1);
+                    break;
+                case EqJz:
+                case NEqJz:
+                case EqIJz:
+                case NEqIJz:
+                    // cmp eax, [top]; jne/je rel32
+                    load(second);
+                    memory({ 0x3b }, eax, top);
+                    a.emit({ 0x0f, static_cast<std::uint8_t>(op == EqJz || op == EqIJz ? 0x85 : 0x84) });
+                    fixups.emplace_back(a.position(), next + chunk.readOperand<ByteCode::Offset>(operand));
+                    a.emitValue<std::int32_t>(0);
+                    break;
+                case AddSlotInt:
+                    // add dword [slot], imm32
+                    memory({ 0x81 }, 0, chunk.readOperand<ByteCode::Index>(operand));
+                    a.emitValue<std::int32_t>(chunk.integers[chunk.readOperand<ByteCode::Index>(operand + sizeof(ByteCode::Index))]);
+                    break;
+                case LoadLoad:
+                    load(chunk.readOperand<ByteCode::Index>(operand));
+                    store(top + 1);
+                    load(chunk.readOperand<ByteCode::Index>(operand + sizeof(ByteCode::Index)));
+                    store(top + 2);
+                    break;
+                case StoreKeep:
+                    load(top);
+                    store(chunk.readOperand<ByteCode::Index>(operand));
+                    break;
+                }
+            });
+
+            for (const auto& [at, target] : fixups) {
+                a.patch(at, static_cast<std::int32_t>(native[target] - (at + sizeof(std::int32_t))));
+            }
+            if (not divisionByZero.empty()) {
+                for (const auto at : divisionByZero) {
+                    a.patch(at, static_cast<std::int32_t>(a.position() - (at + sizeof(std::int32_t))));
+                }
+                // mov eax, 1; add rsp, 8; pop r12; pop rbx; ret
+                a.emit({ 0xb8, 0x01, 0x00, 0x00, 0x00, 0x48, 0x83, 0xc4, 0x08, 0x41, 0x5c, 0x5b, 0xc3 });
+            }
+
+            ExecutableMemory memoryBlock { a.code };
+            if (memoryBlock.get() == nullptr) {
+                TRACE(VM, "JIT: could not map executable memory");
+                return std::nullopt;
+            }
+
+            TRACE(VM, "JIT: compiled {} bytes of bytecode to {} bytes of machine code", chunk.code.size(), a.code.size());
+            return Program { std::move(memoryBlock), slots + chunk.maxStack, std::move(analysis->result) };
+        }
+
+        // Frame words needed by run().
+        [[nodiscard]] auto frameSize() const -> std::size_t {
+            return this->words;
+        }
+
+        // Slot types on exit, see State.
+        [[nodiscard]] auto resultTypes() const -> std::span<const Types> {
+            return this->result;
+        }
+
+        // Returns false if the program stopped on a division by zero.
+        [[nodiscard]] auto run(std::int32_t* frame, std::ostream& out) const -> bool {
+            return reinterpret_cast<Entry>(this->code.get())(frame, &out) == 0;
+        }
+
+    private:
+        Program(ExecutableMemory code, const std::size_t words, std::vector<Types> result)
+            : code { std::move(code) }, words { words }, result { std::move(result) } {}
+
+        ExecutableMemory code;
+        std::size_t words;
+        std::vector<Types> result;
+    };
+#endif
+}
+
+// ============================================================================
+// Runs a chunk as native code when the JIT supports it and on the
+// VirtualMachine otherwise, with the same interface as VirtualMachine.
+//
+// The JIT handles programs over ints and bools. Doubles, slots whose type
+// differs between paths, and contexts whose inputs are not ints all fall back
+// to the interpreter. After a native run every slot that was assigned on all
+// paths is written back to the context.
+// ============================================================================
+class JitMachine {
+public:
+    JitMachine(const ByteCode::Chunk& chunk) : interpreter { chunk } {
+#if ACOMPILER_JIT
+        if (not this->interpreter.hadError()) {
+            this->program = Jit::Program::compile(chunk);
+        }
+#endif
+    }
+
+    // Whether runs go to native code, given int inputs.
+    [[nodiscard]] auto isCompiled() const -> bool {
+#if ACOMPILER_JIT
+        return this->program.has_value();
+#else
+        return false;
+#endif
+    }
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return this->interpreter.hadError();
+    }
+
+    [[nodiscard]] auto getError() const -> const std::optional<std::string>& {
+        return this->interpreter.getError();
+    }
+
+    [[nodiscard]] auto getChunk() const -> const ByteCode::Chunk& {
+        return this->interpreter.getChunk();
+    }
+
+    [[nodiscard]] auto slot(const std::string_view name) const -> std::optional<ByteCode::Index> {
+        return this->interpreter.slot(name);
+    }
+
+    auto run(ExecutionContext& context) const -> bool {
+#if ACOMPILER_JIT
+        const auto& chunk = this->interpreter.getChunk();
+        const auto inputs = context.getSlots().first(chunk.inputs);
+        if (this->program.has_value() && std::ranges::all_of(inputs, [](const Value& v) { return v.isInt(); })) {
+            return runNative(context);
+        }
+#endif
+        return this->interpreter.run(context);
+    }
+
+    auto execute() -> bool {
+        if (not this->context.has_value()) {
+            this->context.emplace(this->interpreter.getChunk());
+        }
+        return run(*this->context);
+    }
+
+private:
+#if ACOMPILER_JIT
+    // Returns what run() does.
+    auto runNative(ExecutionContext& context) const -> bool {
+        context.error.reset();
+
+        // Small programs run without touching the heap.
+        std::array<std::int32_t, 256> small {};
+        std::vector<std::int32_t> large;
+        auto* frame = small.data();
+        if (this->program->frameSize() > small.size()) {
+            large.resize(this->program->frameSize());
+            frame = large.data();
+        }
+
+        const auto inputs = this->interpreter.getChunk().inputs;
+        for (std::size_t i = 0; i < inputs; ++i) {
+            frame[i] = context.getSlot(static_cast<ByteCode::Index>(i)).asInt();
+        }
+
+        if (not this->program->run(frame, context.getOutput())) {
+            context.fail("Division by zero.");
+            return context.succeeded();
+        }
+
+        const auto types = this->program->resultTypes();
+        for (std::size_t i = 0; i < types.size(); ++i) {
+            const auto index = static_cast<ByteCode::Index>(i);
+            if (types[i] == Jit::Int) {
+                context.setSlot(index, static_cast<INumber>(frame[i]));
+            } else if (types[i] == Jit::Boolean) {
+                context.setSlot(index, frame[i] != 0);
+            }
+        }
+        return true;
+    }
+
+    std::optional<Jit::Program> program;
+#endif
+    VirtualMachine interpreter;
+    // Only used by execute().
+    std::optional<ExecutionContext> context;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include "token.h"
+
+namespace Keywords {
+    using namespace std::string_view_literals;
+
+    // Add new keywords here; the hash below is re-derived at compile time.
+    constexpr std::array list = {
+        std::pair { "print"sv, TokenType::Print },
+        std::pair { "if"sv, TokenType::If },
+        std::pair { "then"sv, TokenType::Then },
+        std::pair { "else"sv, TokenType::Else },
+        std::pair { "end"sv, TokenType::End },
+    };
+
+    // Power of two with at least twice as many buckets as keywords.
+    constexpr std::size_t bits = [] {
+        std::size_t b { 1 };
+        while ((std::size_t { 1 } << b) < 2 * list.size()) {
+            ++b;
+        }
+        return b;
+    }();
+    constexpr std::size_t buckets = std::size_t { 1 } << bits;
+
+    // Multiplicative hash of the length and the first and last characters.
+    // Identifiers are never empty.
+    [[nodiscard]] constexpr auto hash(const std::string_view word, const std::uint32_t seed) -> std::size_t {
+        const auto key = static_cast<std::uint32_t>(word.size()) << 16
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(word.front())) << 8
+            | static_cast<std::uint32_t>(static_cast<unsigned char>(word.back()));
+        return (key * seed) >> (32 - bits);
+    }
+
+    // First odd multiplier that gives every keyword its own bucket, or 0.
+    constexpr std::uint32_t seed = [] {
+        for (std::uint32_t candidate = 1; candidate < 1'000'000; candidate += 2) {
+            std::array<bool, buckets> used {};
+            bool collision { false };
+            for (const auto& [word, type] : list) {
+                auto& bucket = used[hash(word, candidate)];
+                collision |= bucket;
+                bucket = true;
+            }
+            if (not collision) {
+                return candidate;
+            }
+        }
+        return std::uint32_t { 0 };
+    }();
+    static_assert(seed != 0, "no collision-free hash for the keyword list, widen the key in hash()");
+
+    constexpr auto table = [] {
+        std::array<std::pair<std::string_view, TokenType>, buckets> entries {};
+        for (auto& entry : entries) {
+            entry = { ""sv, TokenType::Identifier };
+        }
+        for (const auto& keyword : list) {
+            entries[hash(keyword.first, seed)] = keyword;
+        }
+        return entries;
+    }();
+
+    // The keyword's token type, or Identifier. One hash and one comparison.
+    [[nodiscard]] constexpr auto lookup(const std::string_view word) -> TokenType {
+        const auto& [keyword, type] = table[hash(word, seed)];
+        return keyword == word ? type : TokenType::Identifier;
+    }
+
+    static_assert(lookup("print") == TokenType::Print);
+    static_assert(lookup("end") == TokenType::End);
+    static_assert(lookup("ends") == TokenType::Identifier);
+}
@@ -5,44 +5,98 @@
 #include <string_view>
 #include <spdlog/spdlog.h>
 
+#include "char_class.h"
+#include "keywords.h"
 #include "token.h"
+#include "token_buffer.h"
+#include "trace.h"
 
 class Lexer {
 
 public:
     using TokenList = std::vector<Token>;
 
+    // Simple looks at one character at a time. Fast classifies bytes
+    // through CharClass::table and consumes whole runs of whitespace, digits
+    // and identifier characters at once, vectorized where available. Both
+    // produce the same tokens.
+    enum class Mode {
+        Simple,
+        Fast,
+    };
+
 public:
-    explicit Lexer(const std::string_view source) : source { source } {
-        using namespace std::string_view_literals;
-        keywords.insert({ "print"sv, TokenType::Print });
-        keywords.insert({ "if"sv, TokenType::If });
-        keywords.insert({ "then"sv, TokenType::Then });
-        keywords.insert({ "else"sv, TokenType::Else });
-        keywords.insert({ "end"sv, TokenType::End });
-    }
+    explicit Lexer(const std::string_view source, const Mode mode = Mode::Fast) : source { source }, mode { mode } {}
+
+    // Lexes a source that continues another one at line `firstLine`, right
+    // after a newline.
+    Lexer(const std::string_view source, const unsigned int firstLine, const Mode mode = Mode::Fast)
+        : source { source }, mode { mode }, line { firstLine } {}
 
     [[nodiscard]] auto lex(void) noexcept -> TokenList {
+        TokenList tokens;
+        do {
+            tokens.push_back(next());
+        } while (tokens.back().ttype != TokenType::Eof);
+
+        return tokens;
+    }
+
+    // Lexes the whole source into parallel arrays, without computing any
+    // positions; see TokenBuffer.
+    [[nodiscard]] auto lexBuffer(void) noexcept -> TokenBuffer {
+        TokenBuffer buffer { this->source };
+        this->sink = &buffer;
 
         while (this->current < this->source.size()) {
             this->start = this->current;
             nextToken();
         }
-
+        this->start = this->current;
         addToken(TokenType::Eof, std::nullopt);
 
-        return this->tokens;
+        this->sink = nullptr;
+        return buffer;
+    }
+
+    // Scans just far enough to return the next token. Returns Eof once the
+    // source is exhausted, and again on every later call.
+    [[nodiscard]] auto next(void) noexcept -> Token {
+        this->produced = false;
+        while (not this->produced) {
+            if (this->current >= this->source.size()) [[unlikely]] {
+                addToken(TokenType::Eof, std::nullopt);
+                break;
+            }
+            this->start = this->current;
+            nextToken();
+        }
+
+        return this->emitted;
     }
 
 private:
     [[nodiscard]] auto advance(void) -> char {
-        this->position.column++;
-        return this->source.at(this->current++);
+        return this->source[this->current++];
     }
 
     auto newLine(void) -> void {
-        this->position.line++;
-        this->position.column = 1;
+        this->line++;
+        this->lineStart = this->current;
+        this->joined = 0;
+        if (this->sink != nullptr) {
+            this->sink->newLine(this->current);
+        }
+    }
+
+    // Line, and column of the last consumed character. Columns count every
+    // character except the second of a joined operator, and lines after the
+    // first start at 1; TokenBuffer::position() reproduces this.
+    [[nodiscard]] auto position(void) const -> TokenPosition {
+        return {
+            .line = this->line,
+            .column = static_cast<unsigned int>(this->current - this->lineStart - this->joined + (this->line > 1 ? 1 : 0)),
+        };
     }
 
     [[nodiscard]] auto isAtEnd(std::size_t add = 0) -> bool {
@@ -51,20 +105,20 @@ private:
 
     [[nodiscard]] auto peek(void) -> char {
         if (this->isAtEnd()) [[unlikely]] {
-            spdlog::info("Scanner is at end");
+            TRACE(Lexer, "Scanner is at end");
             return '\0';
         }
 
-        return this->source.at(this->current);
+        return this->source[this->current];
     }
 
     [[nodiscard]] auto peekNext(void) -> char {
         if (this->isAtEnd(1)) [[unlikely]] {
-            spdlog::info("Scanner is at end");
+            TRACE(Lexer, "Scanner is at end");
             return '\0';
         }
 
-        return this->source.at(this->current + 1);
+        return this->source[this->current + 1];
     }
 
     [[nodiscard]] auto expect(char expected) -> bool {
@@ -72,33 +126,43 @@ private:
             return false;
         }
 
-        if (this->source.at(this->current) != expected) {
+        if (this->source[this->current] != expected) {
             return false;
         }
 
         this->current++;
+        this->joined++;
         return true;
     }
 
     auto addToken(const TokenType ttype, const std::optional<std::string_view> literal) -> void {
+        if (this->sink != nullptr) {
+            this->sink->push(ttype, this->start, this->current - this->start);
+            TRACE(Lexer, "{}", Token { .ttype = ttype, .lexeme = getCurrentLiteral(), .position = position() });
+            return;
+        }
+
         if (ttype == TokenType::Eof) {
-            this->tokens.emplace_back(Token { 
+            this->emitted = Token { 
                     .ttype = ttype, 
                     .lexeme = "", 
-                    .position = this->position 
-            });
+                    .position = position() 
+            };
         } else {
             const auto lexeme = literal.value_or(std::string_view { 
                     this->source.begin() + this->start, 
                     this->source.begin() + this->current 
             });
 
-            this->tokens.emplace_back(Token { 
+            this->emitted = Token { 
                     .ttype = ttype, 
                     .lexeme = lexeme, 
-                    .position = this->position 
-            });
+                    .position = position() 
+            };
         }
+
+        this->produced = true;
+        TRACE(Lexer, "{}", this->emitted);
     }
 
     [[nodiscard]] auto getCurrentLiteral() -> std::string_view {
@@ -108,18 +172,33 @@ private:
         };
     }
 
-    auto number(void) -> void {
-        bool isDouble { false };
+    // Consumes the longest run of characters in `mask` starting at current.
+    template<CharClass::Mask mask>
+    auto skipRun(void) -> void {
+        const auto* begin = this->source.data() + this->current;
+        const auto* end = CharClass::skip<mask>(begin, this->source.data() + this->source.size());
+        const auto length = static_cast<std::size_t>(end - begin);
+        this->current += length;
+    }
+
+    auto digits(void) -> void {
+        if (this->mode == Mode::Fast) {
+            skipRun<CharClass::Digit>();
+            return;
+        }
         while (std::isdigit(peek())) {
             std::ignore = advance();
         }
+    }
+
+    auto number(void) -> void {
+        bool isDouble { false };
+        digits();
 
         if (peek() == '.' && std::isdigit(peekNext())) {
             isDouble = true;
             std::ignore = advance();
-            while (std::isdigit(peek())) {
-                std::ignore = advance();
-            }
+            digits();
         }
 
         const auto literal = getCurrentLiteral();
@@ -134,17 +213,17 @@ private:
     }
 
     auto identifier(void) -> void {
-        while (isAlpha(peek()) || std::isdigit(peek())) {
-            std::ignore = advance();
+        if (this->mode == Mode::Fast) {
+            skipRun<CharClass::IdentifierTail>();
+        } else {
+            while (isAlpha(peek()) || std::isdigit(peek())) {
+                std::ignore = advance();
+            }
         }
 
         const auto literal = getCurrentLiteral();
 
-        if (keywords.contains(literal)) {
-            addToken(keywords.at(literal), literal);
-        } else {
-            addToken(TokenType::Identifier, literal);
-        }
+        addToken(Keywords::lookup(literal), literal);
     }
 
     auto nextToken(void) noexcept -> void {
@@ -187,13 +266,17 @@ private:
 
             case ' ':
             case '\t':
-            case '\r': break;
+            case '\r':
+                if (this->mode == Mode::Fast) {
+                    skipRun<CharClass::Space>();
+                }
+                break;
             case '\n': newLine(); break;
 
             default:
-             if (std::isdigit(c)) {
+             if (this->mode == Mode::Fast ? CharClass::is(c, CharClass::Digit) : std::isdigit(c)) {
                  this->number();
-             } else if (std::isalpha(c)) {
+             } else if (this->mode == Mode::Fast ? CharClass::is(c, CharClass::Alpha) : std::isalpha(c)) {
                  this->identifier();
              } else {
                  spdlog::error(fmt::format("Token not found: {}", c));
@@ -205,14 +288,18 @@ private:
     }
 
 private:
-    // TODO: just make a struct position
-    using ScannerPosition = TokenPosition;
-
-    TokenList tokens;
+    // Written by addToken(); `produced` tells next() whether the last call to
+    // nextToken() yielded a token or only skipped whitespace.
+    Token emitted {};
+    bool produced { false };
     std::size_t start { 0 };
     std::size_t current { 0 };
     std::string_view source;
-    ScannerPosition position { .line = 1, .column = 0 };
-    
-    std::unordered_map<std::string_view, TokenType> keywords {};
+    Mode mode;
+    unsigned int line { 1 };
+    std::size_t lineStart { 0 };
+    // Joined operators consumed on the current line.
+    std::size_t joined { 0 };
+    // Set while lexBuffer() runs.
+    TokenBuffer* sink { nullptr };
 };
@@ -1,6 +1,4 @@
 #include <cstdlib>
-#include <filesystem>
-#include <fstream>
 #include <optional>
 #include <spdlog/spdlog.h>
 #include <fmt/core.h>
@@ -9,115 +7,210 @@
 #include "parser.h"
 #include "gen.h"
 #include "vm.h"
+#include "jit.h"
+#include "ast_arena.h"
+#include "bytecode_file.h"
+#include "optimizer.h"
+#include "peephole.h"
+#include "register_gen.h"
+#include "register_vm.h"
+#include "type_checker.h"
+#include "source.h"
+#include "trace.h"
 
 
 static auto show_help(void) -> void {
     fmt::print(stderr, R"(
         Usage:
-            ./acompiler [file]
+            ./acompiler [--backend=stack|register] [--jit] [--no-fuse] [--profile] [--emit-bytecode=out.hbc] [--trace=lexer,parser,gen,vm|all] [file]
+
+        Without a file, or with '-', the script is read from stdin. A file
+        written by --emit-bytecode is run as it is, without compiling it.
+        --backend picks the stack machine (the default) or the register
+        machine; --jit, --no-fuse and --profile apply to the stack machine.
+        --no-fuse keeps superinstructions out of the bytecode, and --profile
+        interprets the script and prints its most frequent opcode sequences.
     )");
 }
 
-static auto readFileToString(const std::string_view path) -> std::optional<std::string> {
-    std::filesystem::path filepath { path };
+// Runs a compiled chunk, either just generated or loaded from a file.
+static auto execute(const ByteCode::Chunk& chunk, const bool useJit, const bool profile) -> int {
+    if (profile) {
+        fmt::print("=== Profile ===\n");
+        const VirtualMachine vm(chunk);
+        ExecutionContext context(chunk);
+        ByteCode::OpcodeProfile opcodes;
+        if (not vm.profile(context, opcodes)) {
+            return EXIT_FAILURE;
+        }
+        fmt::print(stderr, "{}", opcodes.report(10));
+        return EXIT_SUCCESS;
+    }
 
-    if (not std::filesystem::exists(filepath)) {
-        spdlog::error(fmt::format("File '{}' does not exist.", filepath.string()));
-        return std::nullopt;
+    if (useJit) {
+        fmt::print("=== JIT ===\n");
+        JitMachine jit(chunk);
+        if (not jit.isCompiled()) {
+            spdlog::info("The JIT does not support this program, interpreting it");
+        }
+        return jit.execute() ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    std::ifstream file { filepath };
-    std::string content((std::istreambuf_iterator<char>(file)),
-                             std::istreambuf_iterator<char>());
+    fmt::print("=== Virtual machine ===\n");
+    VirtualMachine vm(chunk);
 
-    return content;
+    return vm.execute() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-auto resolve(std::vector<std::unique_ptr<ByteCode::Instruction>>& instructions) -> void {
+auto main(int argc, char* argv[]) -> int {
+    spdlog::info("Compiler started");
 
-    const auto find_label = [&](const auto& name) -> int {
-        auto found = std::find_if(std::begin(instructions), std::end(instructions), [name] (auto& inst) {
-            if (auto inner = dynamic_cast<ByteCode::Label *>(inst.get())) {
-                return inner->label == name;
+    bool useJit { false };
+    bool registers { false };
+    bool fuse { true };
+    bool profile { false };
+    std::optional<std::string_view> emitPath;
+    std::string_view path { "-" };
+    bool pathGiven { false };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg { argv[i] };
+        if (arg == "--backend=stack" || arg == "--backend=register") {
+            registers = arg == "--backend=register";
+        } else if (arg == "--jit") {
+            useJit = true;
+        } else if (arg == "--no-fuse") {
+            fuse = false;
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg.starts_with("--emit-bytecode=") && arg.size() > std::string_view { "--emit-bytecode=" }.size()) {
+            emitPath = arg.substr(std::string_view { "--emit-bytecode=" }.size());
+        } else if (arg.starts_with("--trace=")) {
+            if (not Trace::enable(arg.substr(std::string_view { "--trace=" }.size()))) {
+                spdlog::error(fmt::format("Unknown trace category in '{}'", arg));
+                show_help();
+                return EXIT_FAILURE;
             }
-            return false;
-        });
-
-        return std::distance(std::begin(instructions), found);
-    };
-
-    for (int i = 0; i < instructions.size(); i++) {
-        auto& current = instructions[i];
-
-        if (auto inst = dynamic_cast<ByteCode::Jz *>(current.get())) {
-            const auto offset = find_label(inst->label);
-            spdlog::info("Jz Found offset: {}", offset);
-            inst->offset = offset - i;
-        }
-        if (auto inst = dynamic_cast<ByteCode::Jmp *>(current.get())) {
-            const auto offset = find_label(inst->label);
-            spdlog::info("Jmp Found offset: {}", offset);
-            inst->offset = offset - i;
+            if (not ACOMPILER_TRACE) {
+                spdlog::warn("Tracing is compiled out of this build (ACOMPILER_TRACE=0)");
+            }
+        } else if (not pathGiven && (arg == "-" || not arg.starts_with("-"))) {
+            path = arg;
+            pathGiven = true;
+        } else {
+            spdlog::error(fmt::format("Unexpected argument '{}'", arg));
+            show_help();
+            return EXIT_FAILURE;
         }
     }
-}
-
-auto main(int argc, char* argv[]) -> int {
-    spdlog::info("Compiler started");
 
-    /*
-    if (argc != 2) {
-        spdlog::error("No file provided");
+    if (registers && (useJit || profile || emitPath.has_value())) {
+        spdlog::error("--jit, --profile and --emit-bytecode need the stack backend");
         show_help();
         return EXIT_FAILURE;
     }
 
-    const auto content = readFileToString(argv[1]);
+    // Owns the text every token and AST node points into.
+    const auto source = SourceFile::open(path);
 
-    if (not content.has_value()) {
+    if (not source.has_value()) {
         return EXIT_FAILURE;
-    }*/
-
-    auto lexer = Lexer(R"(
-                a := 10;
-                if a != 10 then
-                    print a;
-                else
-                    print 100;
-                end
-                print a;
-        )"sv);
-    auto tokens = lexer.lex();
+    }
+
+    if (ByteCode::isBytecode(source->view())) {
+        if (registers || emitPath.has_value()) {
+            spdlog::error(fmt::format("'{}' is already compiled for the stack backend", path));
+            return EXIT_FAILURE;
+        }
+        ByteCode::Chunk chunk;
+        if (const auto error = ByteCode::decode(source->view(), chunk)) {
+            spdlog::error(fmt::format("Cannot load '{}': {}", path, *error));
+            return EXIT_FAILURE;
+        }
+        spdlog::info("Loaded {} bytes of bytecode from '{}'", chunk.code.size(), path);
+        return execute(chunk, useJit, profile);
+    }
+
+    auto lexer = Lexer(source->view());
+    const auto tokens = lexer.lexBuffer();
 
     fmt::print("=== Tokens ===\n");
-    for (const auto& token : tokens) {
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        const auto token = tokens.token(i);
         fmt::print(stderr, "{} = {}\n", tokenTypeName.at((int)token.ttype), token);
     }
 
-    auto p = Parser(tokens);
+    // Owns every AST node; declared before the statements that point into it.
+    AstArena arena;
+    auto p = Parser(tokens, arena);
 
     auto stmts = p.parse();
+    if (p.hadError()) {
+        for (const auto& error : p.getErrors()) {
+            fmt::print(stderr, "{}\n", error);
+        }
+        return EXIT_FAILURE;
+    }
+
+    AstOptimizer(&arena).run(stmts);
+
+    TypeChecker checker;
+    checker.run(stmts);
+    if (checker.hadError()) {
+        for (const auto& error : checker.getErrors()) {
+            fmt::print(stderr, "{}\n", error);
+        }
+        return EXIT_FAILURE;
+    }
 
     fmt::print("=== Statements ===\n");
     for (const auto& stmt : stmts) {
         fmt::print(stderr, "{}\n", stmt->to_string());
     }
 
+    if (registers) {
+        auto generator = RegisterGenerator(stmts);
+        const auto code = generator.generate();
+
+        if (generator.hadError()) {
+            for (const auto& error : generator.getErrors()) {
+                fmt::print(stderr, "{}\n", error);
+            }
+            return EXIT_FAILURE;
+        }
+
+        fmt::print("=== Generated ===\n");
+        fmt::print(stderr, "{}", RegisterCode::disassemble(code));
+
+        fmt::print("=== Register machine ===\n");
+        RegisterMachine vm(code);
+        return vm.execute() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     auto generator = BytecodeGenerator(stmts);
 
     auto outcome = generator.generate();
 
-    resolve(outcome);
+    if (generator.hadError()) {
+        for (const auto& error : generator.getErrors()) {
+            fmt::print(stderr, "{}\n", error);
+        }
+        return EXIT_FAILURE;
+    }
 
-    fmt::print("=== Generated ===\n");
-    //for (auto value : outcome) {
-        //fmt::print(stderr, "0x{:x}\n", value);
-    //}
+    const auto removed = ByteCode::Peephole().run(outcome);
+    spdlog::info("Peephole pass removed {} instructions", removed);
+    if (fuse) {
+        const auto fused = ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(outcome);
+        spdlog::info("Fusion saved {} instructions", fused);
+    }
 
-    fmt::print("=== Virtual machine ===\n");
-    VirtualMachine vm(outcome);
+    fmt::print("=== Generated ===\n");
+    fmt::print(stderr, "{}", ByteCode::disassemble(outcome));
 
-    vm.execute();
+    if (emitPath.has_value()) {
+        return ByteCode::writeFile(outcome, *emitPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    return EXIT_SUCCESS;
+    return execute(outcome, useJit, profile);
 }
@@ -0,0 +1,320 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "ast_arena.h"
+#include "expression.h"
+#include "statement.h"
+#include "trace.h"
+
+// ============================================================================
+// AST pass run between the Parser and the BytecodeGenerator, so that work
+// known at compile time never reaches the VM:
+//
+//  - arithmetic, comparisons and unary operators on literals are folded with
+//    the VM's semantics; int arithmetic wraps, INT_MIN / -1 included, and
+//    anything that fails at run time (division by zero, mixed types) is left
+//    for the VM to report;
+//  - reads of a variable assigned exactly once, by a top-level statement
+//    with a constant value, are replaced by the constant after that
+//    statement. The assignment itself stays, since callers can read slots;
+//  - if statements with a constant condition are replaced by the branch
+//    that runs.
+//
+// New nodes come from `arena` when the tree was parsed into one.
+// ============================================================================
+class AstOptimizer : Expressions::ExpressionVisitor, Statements::StatementVisitor {
+    using UniqStmt = std::unique_ptr<Statements::Statement>;
+    using UniqExpr = std::unique_ptr<Expressions::Expression>;
+    using Constant = std::variant<int, double, bool>;
+
+public:
+    explicit AstOptimizer(AstArena* arena = nullptr) : arena { arena } {}
+
+    auto run(std::vector<UniqStmt>& statements) -> void {
+        TRACE(Parser, "=== Optimizing ===");
+        this->assignments.clear();
+        this->constants.clear();
+        for (auto& statement : statements) {
+            countAssignments(*statement);
+        }
+
+        std::vector<UniqStmt> kept;
+        kept.reserve(statements.size());
+        for (auto& statement : statements) {
+            optimize(statement);
+            if (statement == nullptr) {
+                continue;
+            }
+            recordConstant(*statement);
+            kept.push_back(std::move(statement));
+        }
+        statements = std::move(kept);
+    }
+
+    [[nodiscard]] auto foldedCount() const -> std::size_t {
+        return this->folded;
+    }
+
+    [[nodiscard]] auto propagatedCount() const -> std::size_t {
+        return this->propagated;
+    }
+
+    [[nodiscard]] auto removedBranchCount() const -> std::size_t {
+        return this->removedBranches;
+    }
+
+private:
+    // Optimizes the node in `slot`, which a visit may replace.
+    auto optimize(UniqStmt& slot) -> void {
+        slot->accept(*this);
+        if (this->statementReplaced) {
+            this->statementReplaced = false;
+            slot = std::move(this->statementReplacement);
+        }
+    }
+
+    auto optimize(UniqExpr& slot) -> void {
+        slot->accept(*this);
+        if (this->expressionReplacement != nullptr) {
+            slot = std::move(this->expressionReplacement);
+        }
+    }
+
+    auto replace(UniqStmt statement) -> void {
+        this->statementReplaced = true;
+        this->statementReplacement = std::move(statement);
+    }
+
+    auto replace(const Constant constant) -> void {
+        this->folded++;
+        this->expressionReplacement = literal(constant);
+    }
+
+    [[nodiscard]] auto literal(const Constant constant) -> UniqExpr {
+        if (const auto* value = std::get_if<int>(&constant)) {
+            return makeNode<Expressions::INumber>(this->arena, *value);
+        }
+        if (const auto* value = std::get_if<double>(&constant)) {
+            return makeNode<Expressions::DNumber>(this->arena, *value);
+        }
+        return makeNode<Expressions::Boolean>(this->arena, std::get<bool>(constant));
+    }
+
+    [[nodiscard]] static auto constantOf(Expressions::Expression& expression) -> std::optional<Constant> {
+        if (const auto* number = dynamic_cast<Expressions::INumber*>(&expression)) {
+            return number->value;
+        }
+        if (const auto* number = dynamic_cast<Expressions::DNumber*>(&expression)) {
+            return number->value;
+        }
+        if (const auto* boolean = dynamic_cast<Expressions::Boolean*>(&expression)) {
+            return boolean->value;
+        }
+        return std::nullopt;
+    }
+
+    // ------------------------------------------------------------------------
+    // Constant propagation bookkeeping
+    // ------------------------------------------------------------------------
+    auto countAssignments(Statements::Statement& statement) -> void {
+        if (auto* expression = dynamic_cast<Statements::ExpressionStatement*>(&statement)) {
+            countAssignments(*expression->expression);
+        } else if (auto* print = dynamic_cast<Statements::Print*>(&statement)) {
+            countAssignments(*print->expression);
+        } else if (auto* branch = dynamic_cast<Statements::IfStatement*>(&statement)) {
+            countAssignments(*branch->condition);
+            for (auto* child : { branch->then.get(), branch->otherwise.get() }) {
+                if (child != nullptr) {
+                    countAssignments(*child);
+                }
+            }
+        }
+    }
+
+    auto countAssignments(Expressions::Expression& expression) -> void {
+        if (auto* assign = dynamic_cast<Expressions::Assign*>(&expression)) {
+            this->assignments[assign->name.getLexeme()]++;
+            countAssignments(*assign->value);
+        } else if (auto* binary = dynamic_cast<Expressions::BinaryOperator*>(&expression)) {
+            countAssignments(*binary->lhs);
+            countAssignments(*binary->rhs);
+        } else if (auto* logical = dynamic_cast<Expressions::Logical*>(&expression)) {
+            countAssignments(*logical->lhs);
+            countAssignments(*logical->rhs);
+        } else if (auto* unary = dynamic_cast<Expressions::Unary*>(&expression)) {
+            countAssignments(*unary->operand);
+        }
+    }
+
+    // Top-level statements run in order and there are no loops, so a
+    // top-level assignment is seen by everything after it.
+    auto recordConstant(Statements::Statement& statement) -> void {
+        auto* expression = dynamic_cast<Statements::ExpressionStatement*>(&statement);
+        if (expression == nullptr) {
+            return;
+        }
+        auto* assign = dynamic_cast<Expressions::Assign*>(expression->expression.get());
+        if (assign == nullptr || this->assignments[assign->name.getLexeme()] != 1) {
+            return;
+        }
+        if (const auto constant = constantOf(*assign->value)) {
+            this->constants.emplace(assign->name.getLexeme(), *constant);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Folding, with the VM's semantics
+    // ------------------------------------------------------------------------
+    [[nodiscard]] static auto fold(const TokenType op, const int a, const int b) -> std::optional<Constant> {
+        const auto wrap = [](const std::uint32_t value) { return static_cast<int>(value); };
+        const auto ua = static_cast<std::uint32_t>(a);
+        const auto ub = static_cast<std::uint32_t>(b);
+        switch (op) {
+            case TokenType::Plus:       return wrap(ua + ub);
+            case TokenType::Minus:      return wrap(ua - ub);
+            case TokenType::Star:       return wrap(ua * ub);
+            case TokenType::Slash:
+                if (b == 0) {
+                    return std::nullopt;
+                }
+                return b == -1 ? wrap(0u - ua) : a / b;
+            case TokenType::EqualEqual: return a == b;
+            case TokenType::BangEqual:  return a != b;
+            default:                    return std::nullopt;
+        }
+    }
+
+    [[nodiscard]] static auto fold(const TokenType op, const double a, const double b) -> std::optional<Constant> {
+        switch (op) {
+            case TokenType::Plus:       return a + b;
+            case TokenType::Minus:      return a - b;
+            case TokenType::Star:       return a * b;
+            case TokenType::Slash:      return a / b;
+            case TokenType::EqualEqual: return a == b;
+            case TokenType::BangEqual:  return a != b;
+            default:                    return std::nullopt;
+        }
+    }
+
+    [[nodiscard]] static auto fold(const TokenType op, const Constant& a, const Constant& b) -> std::optional<Constant> {
+        if (std::holds_alternative<int>(a) && std::holds_alternative<int>(b)) {
+            return fold(op, std::get<int>(a), std::get<int>(b));
+        }
+        if (std::holds_alternative<double>(a) && std::holds_alternative<double>(b)) {
+            return fold(op, std::get<double>(a), std::get<double>(b));
+        }
+        return std::nullopt;
+    }
+
+    auto foldBinary(UniqExpr& lhs, const Token& op, UniqExpr& rhs) -> void {
+        optimize(lhs);
+        optimize(rhs);
+
+        const auto a = constantOf(*lhs);
+        const auto b = constantOf(*rhs);
+        if (not a.has_value() || not b.has_value()) {
+            return;
+        }
+        if (const auto result = fold(op.ttype, *a, *b)) {
+            replace(*result);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Statements
+    // ------------------------------------------------------------------------
+    auto visit(Statements::ExpressionStatement& statement) -> void override {
+        optimize(statement.expression);
+    }
+
+    auto visit(Statements::Print& statement) -> void override {
+        optimize(statement.expression);
+    }
+
+    auto visit(Statements::IfStatement& statement) -> void override {
+        optimize(statement.condition);
+        if (statement.then != nullptr) {
+            optimize(statement.then);
+        }
+        if (statement.otherwise != nullptr) {
+            optimize(statement.otherwise);
+        }
+
+        const auto condition = constantOf(*statement.condition);
+        if (not condition.has_value() || not std::holds_alternative<bool>(*condition)) {
+            return;
+        }
+        this->removedBranches++;
+        replace(std::move(std::get<bool>(*condition) ? statement.then : statement.otherwise));
+    }
+
+    // ------------------------------------------------------------------------
+    // Expressions
+    // ------------------------------------------------------------------------
+    auto visit(Expressions::BinaryOperator& expression) -> void override {
+        foldBinary(expression.lhs, expression.operator_type, expression.rhs);
+    }
+
+    auto visit(Expressions::Logical& expression) -> void override {
+        foldBinary(expression.lhs, expression.operator_type, expression.rhs);
+    }
+
+    auto visit(Expressions::Unary& expression) -> void override {
+        optimize(expression.operand);
+
+        const auto operand = constantOf(*expression.operand);
+        if (not operand.has_value()) {
+            return;
+        }
+        if (expression.operator_type.ttype == TokenType::Bang) {
+            if (const auto* value = std::get_if<bool>(&*operand)) {
+                replace(not *value);
+            }
+            return;
+        }
+        if (const auto* value = std::get_if<int>(&*operand)) {
+            replace(static_cast<int>(0u - static_cast<std::uint32_t>(*value)));
+        } else if (const auto* value = std::get_if<double>(&*operand)) {
+            replace(-*value);
+        }
+    }
+
+    auto visit(Expressions::Variable& expression) -> void override {
+        const auto found = this->constants.find(expression.name.getLexeme());
+        if (found == this->constants.end()) {
+            return;
+        }
+        this->propagated++;
+        this->expressionReplacement = literal(found->second);
+    }
+
+    auto visit(Expressions::Assign& expression) -> void override {
+        optimize(expression.value);
+    }
+
+    auto visit(Expressions::INumber&) -> void override {}
+    auto visit(Expressions::DNumber&) -> void override {}
+    auto visit(Expressions::Boolean&) -> void override {}
+
+private:
+    AstArena* arena;
+    // Per variable: how many assignments the program has.
+    std::unordered_map<std::string_view, std::size_t> assignments;
+    // Variables whose value is known from here on.
+    std::unordered_map<std::string_view, Constant> constants;
+
+    // Set by a visit that replaces the node it visited.
+    UniqExpr expressionReplacement;
+    UniqStmt statementReplacement;
+    bool statementReplaced { false };
+
+    std::size_t folded { 0 };
+    std::size_t propagated { 0 };
+    std::size_t removedBranches { 0 };
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <future>
+#include <string_view>
+#include <vector>
+
+#include "lexer.h"
+#include "thread_pool.h"
+
+// ============================================================================
+// Lexes a large source on a ThreadPool. No token spans a newline, so the
+// source is cut just after newlines into pieces that are lexed independently
+// and then concatenated, dropping every Eof but the last. The result is
+// identical to Lexer(source).lex().
+//
+// Each piece but the first is lexed as if it started on line 2, which gives
+// the columns of any line after the first; its lines are then shifted once
+// the newlines in the pieces before it are known, from their Eof tokens.
+//
+// The calling thread runs pieces too while it waits, so this may itself run
+// as a task on `pool`.
+// ============================================================================
+[[nodiscard]] static auto lexParallel(const std::string_view source, ThreadPool& pool, std::size_t pieces = 0, const std::size_t minPieceBytes = 256 * 1024) -> Lexer::TokenList {
+    if (pieces == 0) {
+        // Extra pieces let idle workers steal from slow ones.
+        pieces = 4 * pool.size();
+    }
+    pieces = std::min(pieces, std::max<std::size_t>(source.size() / std::max<std::size_t>(minPieceBytes, 1), 1));
+
+    std::vector<std::string_view> parts;
+    std::size_t begin { 0 };
+    for (std::size_t k = 1; k < pieces && begin < source.size(); ++k) {
+        const auto newline = source.find('\n', std::max(begin, k * source.size() / pieces));
+        if (newline == std::string_view::npos) {
+            break;
+        }
+        parts.push_back(source.substr(begin, newline + 1 - begin));
+        begin = newline + 1;
+    }
+    parts.push_back(source.substr(begin));
+
+    if (parts.size() == 1) {
+        return Lexer(source).lex();
+    }
+
+    std::vector<std::future<Lexer::TokenList>> lexed;
+    for (std::size_t k = 0; k < parts.size(); ++k) {
+        lexed.push_back(pool.submit([part = parts[k], firstLine = k == 0 ? 1u : 2u] {
+            return Lexer(part, firstLine).lex();
+        }));
+    }
+
+    std::vector<Lexer::TokenList> lists;
+    for (auto& future : lexed) {
+        lists.push_back(pool.get(future));
+    }
+
+    // Where each piece's tokens go, and how far its lines shift.
+    std::vector<std::size_t> outputOffsets(lists.size());
+    std::vector<unsigned int> lineShifts(lists.size());
+    std::size_t total { 0 };
+    unsigned int nextLine { 1 };
+    for (std::size_t k = 0; k < lists.size(); ++k) {
+        const auto firstLine = k == 0 ? 1u : 2u;
+        outputOffsets[k] = total;
+        lineShifts[k] = nextLine - firstLine;
+
+        const auto& eof = lists[k].back();
+        nextLine += eof.position.line - firstLine;
+        total += lists[k].size() - 1;
+    }
+
+    Lexer::TokenList tokens(total + 1);
+    std::vector<std::future<void>> copies;
+    for (std::size_t k = 0; k < lists.size(); ++k) {
+        copies.push_back(pool.submit([&, k] {
+            const auto& list = lists[k];
+            const auto last = k + 1 == lists.size() ? list.size() : list.size() - 1;
+            for (std::size_t i = 0; i < last; ++i) {
+                auto token = list[i];
+                token.position.line += lineShifts[k];
+                tokens[outputOffsets[k] + i] = token;
+            }
+        }));
+    }
+    for (auto& copy : copies) {
+        pool.get(copy);
+    }
+
+    return tokens;
+}
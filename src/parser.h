@@ -1,34 +1,175 @@
 #pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include "ast_arena.h"
 #include "expression.h"
+#include "flat_ast.h"
 #include "lexer.h"
 #include "statement.h"
+#include "token_source.h"
+
+// ============================================================================
+// Parser builder for the pointer tree of Expressions and Statements. Nodes
+// are allocated one by one on the heap unless the builder is given an
+// AstArena, which then has to outlive the returned statements.
+// ============================================================================
+class TreeBuilder {
+public:
+    using Expression = std::unique_ptr<Expressions::Expression>;
+    using Statement = std::unique_ptr<Statements::Statement>;
+    using Result = std::vector<Statement>;
+
+    TreeBuilder() = default;
+    TreeBuilder(AstArena& arena) : arena { &arena } {}
+
+    [[nodiscard]] auto integer(const Token& token) -> Expression {
+        return make<Expressions::INumber>(token.lexeme);
+    }
+
+    [[nodiscard]] auto real(const Token& token) -> Expression {
+        return make<Expressions::DNumber>(token.lexeme);
+    }
 
+    [[nodiscard]] auto variable(const Token& token) -> Expression {
+        return make<Expressions::Variable>(token);
+    }
+
+    [[nodiscard]] auto binary(Expression lhs, const Token& op, Expression rhs) -> Expression {
+        return make<Expressions::BinaryOperator>(std::move(lhs), op, std::move(rhs));
+    }
+
+    [[nodiscard]] auto logical(Expression lhs, const Token& op, Expression rhs) -> Expression {
+        return make<Expressions::Logical>(std::move(lhs), op, std::move(rhs));
+    }
+
+    [[nodiscard]] auto unary(const Token& op, Expression operand) -> Expression {
+        return make<Expressions::Unary>(op, std::move(operand));
+    }
+
+    // Whether `expression` can be the target of assign(): only a variable.
+    [[nodiscard]] static auto assignable(const Expression& expression) -> bool {
+        return dynamic_cast<const Expressions::Variable*>(expression.get()) != nullptr;
+    }
+
+    [[nodiscard]] auto assign(Expression target, Expression value) -> Expression {
+        assert(assignable(target) && "assignment target must be a variable");
+        auto name = static_cast<Expressions::Variable&>(*target).name;
+        return make<Expressions::Assign>(name, std::move(value));
+    }
+
+    [[nodiscard]] auto expressionStatement(Expression expression) -> Statement {
+        return make<Statements::ExpressionStatement>(std::move(expression));
+    }
+
+    [[nodiscard]] auto print(Expression expression) -> Statement {
+        return make<Statements::Print>(std::move(expression));
+    }
+
+    [[nodiscard]] auto ifStatement(Expression condition, Statement then, Statement otherwise) -> Statement {
+        return make<Statements::IfStatement>(std::move(condition), std::move(then), std::move(otherwise));
+    }
+
+    [[nodiscard]] static auto noStatement() -> Statement {
+        return nullptr;
+    }
+
+    auto root(Statement statement) -> void {
+        this->statements.push_back(std::move(statement));
+    }
+
+    [[nodiscard]] auto describe(const Statement& statement) const -> std::string {
+        return statement->to_string();
+    }
+
+    [[nodiscard]] auto finish() -> Result {
+        return std::move(this->statements);
+    }
+
+private:
+    template<typename T, typename... Args>
+    [[nodiscard]] auto make(Args&&... args) -> std::unique_ptr<T> {
+        return makeNode<T>(this->arena, std::forward<Args>(args)...);
+    }
+
+    AstArena* arena { nullptr };
+    Result statements;
+};
+
+// ============================================================================
+// Binding power of every token in infix position; tokens that do not continue
+// an expression have None. Higher binds tighter.
+// ============================================================================
+namespace Precedence {
+    enum Level : std::uint8_t {
+        None,
+        Assignment, // :=, right associative
+        Equality,   // == !=
+        Term,       // + -
+        Factor,     // * /
+        Unary,      // prefix - !
+    };
+
+    constexpr auto infix = [] {
+        std::array<Level, static_cast<std::size_t>(TokenType::Eof) + 1> levels {};
+        levels[static_cast<std::size_t>(TokenType::Assign)] = Assignment;
+        levels[static_cast<std::size_t>(TokenType::EqualEqual)] = Equality;
+        levels[static_cast<std::size_t>(TokenType::BangEqual)] = Equality;
+        levels[static_cast<std::size_t>(TokenType::Plus)] = Term;
+        levels[static_cast<std::size_t>(TokenType::Minus)] = Term;
+        levels[static_cast<std::size_t>(TokenType::Star)] = Factor;
+        levels[static_cast<std::size_t>(TokenType::Slash)] = Factor;
+        return levels;
+    }();
+
+    [[nodiscard]] constexpr auto of(const TokenType ttype) -> Level {
+        return infix[static_cast<std::size_t>(ttype)];
+    }
+}
+
+// TokenSource is TokenSpan to parse an already lexed list, TokenBufferView to
+// parse a TokenBuffer, or TokenStream to pull tokens from a Lexer while
+// parsing. Builder makes the nodes: TreeBuilder for the pointer tree, or
+// FlatAst::Builder for the flat one.
+template<typename TokenSource, typename Builder = TreeBuilder>
 class Parser {
-    using TokenList = Lexer::TokenList;
 
-    using UniqStmt = std::unique_ptr<Statements::Statement>;
-    using UniqExpr = std::unique_ptr<Expressions::Expression>;
+    using Stmt = typename Builder::Statement;
+    using Expr = typename Builder::Expression;
 
-    using StatementList = std::vector<UniqStmt>;
 public:
-    Parser(const std::span<Token> tokens) : tokens{ tokens } {}
+    template<typename Source>
+    explicit Parser(Source&& source, Builder builder = {}) : tokens { std::forward<Source>(source) }, builder { std::move(builder) } {}
 
-    [[nodiscard]] auto parse() -> StatementList {
-        StatementList statements;
+    [[nodiscard]] auto parse() -> typename Builder::Result {
         while (! isAtEnd()) {
             auto decl = declaration();
-            statements.push_back(std::move(decl));
+            if (this->panicking) {
+                synchronize();
+                continue;
+            }
+            TRACE(Parser, "{}", this->builder.describe(decl));
+            this->builder.root(std::move(decl));
         }
 
-        return statements;
+        return this->builder.finish();
+    }
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return not this->errors.empty();
     }
 
-    [[nodiscard]] auto declaration() -> UniqStmt {
+    [[nodiscard]] auto getErrors() const -> const std::vector<std::string>& {
+        return this->errors;
+    }
+
+    [[nodiscard]] auto declaration() -> Stmt {
         return statement();
     }
 
 
-    [[nodiscard]] auto statement() -> UniqStmt {
+    [[nodiscard]] auto statement() -> Stmt {
         if (checkAndAdvance(TokenType::If)) {
             return ifStatement();
         }
@@ -39,118 +180,115 @@ public:
         return expressionStatement();
     }
 
-    [[nodiscard]] auto ifStatement() -> UniqStmt {
+    [[nodiscard]] auto ifStatement() -> Stmt {
         auto condition = expression();
         std::ignore = consume(TokenType::Then, "Expect 'then' after if statement.");
         auto then = statement();
 
-        std::unique_ptr<Statements::Statement> else_branch;
+        auto else_branch = this->builder.noStatement();
 
         if (checkAndAdvance(TokenType::Else)) {
             else_branch = statement();
         }
 
         std::ignore = consume(TokenType::End, "Expect 'end' after if statement.");
-        auto ifStatement = std::make_unique<Statements::IfStatement>(std::move(condition), std::move(then), std::move(else_branch));
-        return UniqStmt(std::move(ifStatement));
+        return this->builder.ifStatement(std::move(condition), std::move(then), std::move(else_branch));
     }
 
-    [[nodiscard]] auto expressionStatement() -> UniqStmt {
+    [[nodiscard]] auto expressionStatement() -> Stmt {
         auto expr = expression();
         std::ignore = consume(TokenType::Semicolon, "Expect ';' after expression.");
-        auto exprStatement = std::make_unique<Statements::ExpressionStatement>(std::move(expr));
-        return UniqStmt(std::move(exprStatement));
+        return this->builder.expressionStatement(std::move(expr));
     }
 
     
-    [[nodiscard]] auto printStatement() -> UniqStmt {
+    [[nodiscard]] auto printStatement() -> Stmt {
         auto expr = expression();
         std::ignore = consume(TokenType::Semicolon, "Expect ';' after value.");
 
-        auto printExpr = std::make_unique<Statements::Print>(std::move(expr));
-        return UniqStmt(std::move(printExpr));
+        return this->builder.print(std::move(expr));
     }
 
 
     // Expressions
 
-    [[nodiscard]] auto expression() -> UniqExpr {
-        return assignment();
-    }
-
-
-    [[nodiscard]] auto assignment() -> UniqExpr {
-        auto expr = equality();
-        //auto expr = term();
-
-        if (checkAndAdvance(TokenType::Assign)) {
-            auto value = assignment();
-            auto name = dynamic_cast<Expressions::Variable *>(expr.get())->name;
-            return UniqExpr(std::make_unique<Expressions::Assign>(name, std::move(value)));
+    // Pratt parser: one prefix operand, then a loop over infix operators that
+    // bind at least as tightly as `minimum`. Only the right operand of an
+    // operator recurses, so nesting depth follows the source rather than the
+    // number of precedence levels.
+    [[nodiscard]] auto expression(const Precedence::Level minimum = Precedence::Assignment) -> Expr {
+        auto expr = prefix();
+
+        while (not this->panicking) {
+            const auto ttype = peek().ttype;
+            const auto level = Precedence::of(ttype);
+            // None is below every minimum.
+            if (level < minimum) {
+                break;
+            }
+            this->tokens.advance();
+
+            if (ttype == TokenType::Assign) {
+                const Token op = previous();
+                auto value = expression(Precedence::Assignment);
+                if (not this->builder.assignable(expr)) {
+                    // Keep the target so the rest of the statement still parses.
+                    error(op, "Invalid assignment target.");
+                    continue;
+                }
+                expr = this->builder.assign(std::move(expr), std::move(value));
+                continue;
+            }
+
+            const Token op = previous();
+            // Left associative: the right operand only takes tighter operators.
+            auto right = expression(static_cast<Precedence::Level>(level + 1));
+            if (level == Precedence::Equality) {
+                expr = this->builder.logical(std::move(expr), op, std::move(right));
+            } else {
+                expr = this->builder.binary(std::move(expr), op, std::move(right));
+            }
         }
 
         return expr;
     }
 
-    [[nodiscard]] auto equality() -> UniqExpr {
-        auto expr = term();
-
-        while (checkAndAdvance(TokenType::EqualEqual, TokenType::BangEqual)) {
-            auto op = previous();
-            auto right = term();
-            expr = std::make_unique<Expressions::Logical>(std::move(expr), op, std::move(right));
+    // After an error the result is only a placeholder, to be dropped with the
+    // statement it is in.
+    [[nodiscard]] auto prefix() -> Expr {
+        const auto ttype = peek().ttype;
+        if (ttype == TokenType::Eof) {
+            unexpected(peek(), "Expect expression.");
+            return {};
         }
-
-        return expr;
-    }
-
-
-    [[nodiscard]] auto term() -> UniqExpr {
-        auto expr = factor();
-
-        while (checkAndAdvance(TokenType::Plus, TokenType::Minus)) {
-            auto op = previous();
-            auto right = factor();
-            expr = std::make_unique<Expressions::BinaryOperator>(std::move(expr), op, std::move(right));
-        }
-
-        return expr;
-    }
-
-
-    [[nodiscard]] auto factor() -> UniqExpr {
-        auto expr = primary();
-
-        while (checkAndAdvance(TokenType::Star, TokenType::Slash)) {
-            auto op = previous();
-            auto right = primary();
-            expr = std::make_unique<Expressions::BinaryOperator>(std::move(expr), op, std::move(right));
+        this->tokens.advance();
+
+        switch (ttype) {
+            case TokenType::INumber:
+                return this->builder.integer(previous());
+            case TokenType::DNumber:
+                return this->builder.real(previous());
+            case TokenType::Identifier:
+                return this->builder.variable(previous());
+            case TokenType::Minus:
+            case TokenType::Bang: {
+                const Token op = previous();
+                auto operand = expression(Precedence::Unary);
+                return this->builder.unary(op, std::move(operand));
+            }
+            case TokenType::LeftParen: {
+                auto expr = expression();
+                std::ignore = consume(TokenType::RightParen, "Expect ')' after expression.");
+                return expr;
+            }
+            default:
+                break;
         }
 
-        return expr;
+        unexpected(previous(), "Expect expression.");
+        return {};
     }
 
-
-    [[nodiscard]] auto primary() -> UniqExpr {
-        if (checkAndAdvance(TokenType::INumber)) {
-            auto number = std::make_unique<Expressions::INumber>(previous().lexeme);
-            return UniqExpr(std::move(number));
-        }
-        if (checkAndAdvance(TokenType::DNumber)) {
-            auto number = std::make_unique<Expressions::DNumber>(previous().lexeme);
-            return UniqExpr(std::move(number));
-        }
-
-        if (checkAndAdvance(TokenType::Identifier)) {
-            auto variable = std::make_unique<Expressions::Variable>(previous());
-            return UniqExpr(std::move(variable));
-        }
-
-        assert(false && "primary failed");
-    }
-
-
-
     template <typename ...Tokens>
     [[nodiscard]] auto checkAndAdvance(Tokens&& ...tokens) -> bool {
         const bool found = (check(tokens) || ...);
@@ -165,16 +303,19 @@ public:
         return peek().ttype == TokenType::Eof;
     }
 
-    [[nodiscard]] constexpr auto peek() const -> Token {
-        return this->tokens[this->current];
+    // A reference into the source where it has one, so looking at the
+    // current token does not copy it.
+    [[nodiscard]] constexpr auto peek() const -> decltype(auto) {
+        return this->tokens.peek();
     }
 
     [[nodiscard]] auto consume(const TokenType& ttype, const std::string& msg) -> Token {
         if (check(ttype)) {
             return advance();
-        } else {
-            return /* some error (peek(), msg)*/ {};
         }
+        // The statement is still complete, so it is kept.
+        error(peek(), msg);
+        return {};
     }
 
     [[nodiscard]] auto check(const TokenType& ttype) const -> bool {
@@ -186,16 +327,68 @@ public:
 
     [[nodiscard]] auto advance() -> Token {
         if (not isAtEnd()) {
-            this->current++;
+            this->tokens.advance();
         }
         return previous();
     }
 
-    [[nodiscard]] auto previous() const -> Token {
-        return this->tokens[this->current - 1];
+    [[nodiscard]] auto previous() const -> decltype(auto) {
+        return this->tokens.previous();
+    }
+
+    // Errors while panicking would only follow from the first one, and are
+    // not reported.
+    auto error(const Token& token, const std::string& message) -> void {
+        if (this->panicking) {
+            return;
+        }
+        if (token.ttype == TokenType::Eof) {
+            this->errors.push_back(fmt::format("[line {}] Error at end: {}", token.position.line, message));
+            return;
+        }
+        this->errors.push_back(fmt::format("[line {}] Error at '{}': {}", token.position.line, token.getLexeme(), message));
+    }
+
+    // Reports a token where an expression has to start. The statement it is
+    // in cannot be built, so parse() drops it and resumes at the next one.
+    auto unexpected(const Token& token, const std::string& message) -> void {
+        error(token, message);
+        this->panicking = true;
+    }
+
+    // Skips to where the next statement likely starts: just past a `;` or
+    // `end`, or at `if` or `print`. The failed statement consumed at least
+    // one token, so this always makes progress.
+    auto synchronize() -> void {
+        this->panicking = false;
+        while (not isAtEnd()) {
+            if (previous().ttype == TokenType::Semicolon || previous().ttype == TokenType::End) {
+                return;
+            }
+            if (check(TokenType::If) || check(TokenType::Print)) {
+                return;
+            }
+            this->tokens.advance();
+        }
     }
 
 private:
-    std::size_t current { 0 };
-    std::span<Token> tokens;
+    TokenSource tokens;
+    Builder builder;
+    std::vector<std::string> errors;
+    // Set from an unexpected token until synchronize().
+    bool panicking { false };
 };
+
+// The token source a Parser uses for a constructor argument.
+template<typename Source>
+using TokenSourceFor = std::conditional_t<std::is_same_v<std::remove_cvref_t<Source>, Lexer>, TokenStream<>,
+                       std::conditional_t<std::is_same_v<std::remove_cvref_t<Source>, TokenBuffer>, TokenBufferView,
+                       TokenSpan>>;
+
+template<typename Source>
+Parser(Source&&) -> Parser<TokenSourceFor<Source>>;
+template<typename Source>
+Parser(Source&&, AstArena&) -> Parser<TokenSourceFor<Source>>;
+template<typename Source>
+Parser(Source&&, FlatAst::Builder) -> Parser<TokenSourceFor<Source>, FlatAst::Builder>;
@@ -0,0 +1,467 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "chunk.h"
+#include "trace.h"
+
+namespace ByteCode {
+
+    // ============================================================================
+    // Peephole optimizer over a generated chunk. The code is decoded into a
+    // list of instructions with jump targets held as instruction indices, each
+    // rule of the table is tried at every instruction until none fires, and
+    // the survivors are encoded back with fresh jump offsets.
+    //
+    // Rules never delete instructions outright: remove() marks them, and a
+    // jump to a removed instruction lands on the next live one.
+    // ============================================================================
+    class Peephole {
+    public:
+        struct Instruction {
+            OpCode op;
+            // Index operand, or for jumps the index of the target instruction.
+            std::uint32_t operand { 0 };
+            // Second Index operand of the opcodes that have two.
+            std::uint32_t operand2 { 0 };
+            bool removed { false };
+        };
+
+        // Returns true if it changed the code at instruction `at`.
+        using Apply = auto (*)(Peephole& code, std::size_t at) -> bool;
+
+        struct Rule {
+            std::string_view name;
+            Apply apply;
+        };
+
+        [[nodiscard]] static auto defaultRules() -> std::vector<Rule> {
+            return {
+                { "jump to next", &jumpToNext },
+                { "thread jumps", &threadJumps },
+                { "store then load", &storeThenLoad },
+                { "identity", &identity },
+                { "multiply by power of two", &multiplyByPowerOfTwo },
+            };
+        }
+
+        // Rules only shrink or simplify the code, so a fixpoint comes within a
+        // few passes; the cap guards against a custom rule that undoes another.
+        static constexpr std::size_t maxPasses = 8;
+
+        // Rules that replace common sequences with superinstructions. They
+        // run as a separate pass after defaultRules(), which do not know the
+        // superinstructions, and are left out to debug with plain opcodes.
+        [[nodiscard]] static auto fusionRules() -> std::vector<Rule> {
+            return {
+                { "compare and branch", &compareAndBranch },
+                { "add int to slot", &addIntToSlot },
+                { "store and keep", &storeAndKeep },
+                { "load twice", &loadTwice },
+            };
+        }
+
+        explicit Peephole(std::vector<Rule> rules = defaultRules()) : rules { std::move(rules) }, hits(this->rules.size(), 0) {}
+
+        // Rewrites `chunk` in place and returns how many instructions it removed.
+        auto run(Chunk& chunk) -> std::size_t {
+            decode(chunk);
+
+            const auto before = this->code.size();
+            bool changed { true };
+            for (std::size_t pass = 0; changed && pass < maxPasses; ++pass) {
+                changed = false;
+                for (std::size_t at = 0; at < this->code.size(); ++at) {
+                    if (this->code[at].removed) {
+                        continue;
+                    }
+                    for (std::size_t rule = 0; rule < this->rules.size(); ++rule) {
+                        if (this->rules[rule].apply(*this, at)) {
+                            TRACE(Generator, "Peephole: {} at instruction {}", this->rules[rule].name, at);
+                            this->hits[rule]++;
+                            changed = true;
+                            if (this->code[at].removed) {
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            const auto removedCount = before - liveCount();
+            encode(chunk);
+            this->removedTotal += removedCount;
+            return removedCount;
+        }
+
+        // Instructions removed by every run() so far.
+        [[nodiscard]] auto removed() const -> std::size_t {
+            return this->removedTotal;
+        }
+
+        // How often each rule of the table fired, in table order.
+        [[nodiscard]] auto ruleHits() const -> const std::vector<std::size_t>& {
+            return this->hits;
+        }
+
+        // --------------------------------------------------------------------
+        // For rules
+        // --------------------------------------------------------------------
+        [[nodiscard]] auto at(const std::size_t index) -> Instruction& {
+            return this->code[index];
+        }
+
+        // The next live instruction after `index`; Halt ends every chunk, so
+        // there is one for all but the last.
+        [[nodiscard]] auto next(const std::size_t index) const -> std::size_t {
+            return live(index + 1);
+        }
+
+        // Where the jump at `index` lands.
+        [[nodiscard]] auto target(const std::size_t index) const -> std::size_t {
+            return live(this->code[index].operand);
+        }
+
+        auto retarget(const std::size_t index, const std::size_t target) -> void {
+            this->incoming[live(this->code[index].operand)]--;
+            this->code[index].operand = static_cast<std::uint32_t>(target);
+            this->incoming[target]++;
+        }
+
+        // Whether some jump lands on the instruction at `index`.
+        [[nodiscard]] auto isTarget(const std::size_t index) const -> bool {
+            return this->incoming[index] > 0;
+        }
+
+        auto remove(const std::size_t index) -> void {
+            auto& instruction = this->code[index];
+            assert(not instruction.removed && instruction.op != OpCode::Halt);
+            if (isJump(instruction.op)) {
+                this->incoming[target(index)]--;
+            }
+            instruction.removed = true;
+            // Jumps to it now land on the next live instruction.
+            this->incoming[next(index)] += this->incoming[index];
+            this->incoming[index] = 0;
+        }
+
+        [[nodiscard]] auto integer(const Instruction& instruction) const -> int {
+            assert(instruction.op == OpCode::PushInt);
+            return this->integers[instruction.operand];
+        }
+
+        [[nodiscard]] static auto isJump(const OpCode op) -> bool {
+            return ByteCode::isJump(op);
+        }
+
+    private:
+        // --------------------------------------------------------------------
+        // Default rules
+        // --------------------------------------------------------------------
+
+        // Jmp to the next instruction does nothing; Jz to it only drops the
+        // condition.
+        static auto jumpToNext(Peephole& code, const std::size_t at) -> bool {
+            const auto op = code.at(at).op;
+            if ((op != OpCode::Jmp && op != OpCode::Jz) || code.target(at) != code.next(at)) {
+                return false;
+            }
+            if (op == OpCode::Jmp) {
+                code.remove(at);
+            } else {
+                code.incoming[code.target(at)]--;
+                code.at(at) = { .op = OpCode::Pop };
+            }
+            return true;
+        }
+
+        // A jump landing on a Jmp goes straight to where that one goes.
+        static auto threadJumps(Peephole& code, const std::size_t at) -> bool {
+            if (not isJump(code.at(at).op)) {
+                return false;
+            }
+            const auto target = code.target(at);
+            if (code.at(target).op != OpCode::Jmp || target == at) {
+                return false;
+            }
+            const auto final = code.target(target);
+            if (final == target) {
+                return false;
+            }
+            code.retarget(at, final);
+            return true;
+        }
+
+        // StoreSlot x; LoadSlot x keeps the value on the stack instead of
+        // reading it back: Dup; StoreSlot x.
+        static auto storeThenLoad(Peephole& code, const std::size_t at) -> bool {
+            const auto store = code.at(at);
+            if (store.op != OpCode::StoreSlot) {
+                return false;
+            }
+            const auto load = code.next(at);
+            if (code.at(load).op != OpCode::LoadSlot || code.at(load).operand != store.operand || code.isTarget(load)) {
+                return false;
+            }
+            code.at(at) = { .op = OpCode::Dup };
+            code.at(load) = store;
+            return true;
+        }
+
+        // x + 0, x - 0, x * 1 and x / 1 are x. Only the I forms qualify: the
+        // generic forms stop the run when x is not a number, and dropping
+        // them would hide that.
+        static auto identity(Peephole& code, const std::size_t at) -> bool {
+            if (code.at(at).op != OpCode::PushInt) {
+                return false;
+            }
+            const auto op = code.next(at);
+            if (code.isTarget(op)) {
+                return false;
+            }
+            const auto value = code.integer(code.at(at));
+            const auto arithmetic = code.at(op).op;
+            const bool neutral = (value == 0 && (arithmetic == OpCode::AddI || arithmetic == OpCode::SubI))
+                              || (value == 1 && (arithmetic == OpCode::MulI || arithmetic == OpCode::DivI));
+            if (not neutral) {
+                return false;
+            }
+            code.remove(at);
+            code.remove(op);
+            return true;
+        }
+
+        // x * 2^k becomes x << k for MulI, which wraps exactly like the
+        // multiplication. The generic Mul is left alone since x may be a double.
+        static auto multiplyByPowerOfTwo(Peephole& code, const std::size_t at) -> bool {
+            if (code.at(at).op != OpCode::PushInt) {
+                return false;
+            }
+            const auto mul = code.next(at);
+            const auto value = code.integer(code.at(at));
+            if (code.at(mul).op != OpCode::MulI || code.isTarget(mul) || value < 2 || not std::has_single_bit(static_cast<std::uint32_t>(value))) {
+                return false;
+            }
+            code.at(mul) = { .op = OpCode::Shl, .operand = static_cast<std::uint32_t>(std::countr_zero(static_cast<std::uint32_t>(value))) };
+            code.remove(at);
+            return true;
+        }
+
+        // --------------------------------------------------------------------
+        // Fusion rules
+        // --------------------------------------------------------------------
+
+        // Eq; Jz becomes EqJz and NEq; Jz becomes NEqJz, and the I forms
+        // become EqIJz and NEqIJz, which keep skipping the tag checks. The D
+        // forms have no fused counterpart and stay as they are.
+        static auto compareAndBranch(Peephole& code, const std::size_t at) -> bool {
+            using enum OpCode;
+            const auto op = code.at(at).op;
+            const bool ints = op == EqI || op == NEqI;
+            const bool equal = op == Eq || op == EqI;
+            if (not ints && op != Eq && op != NEq) {
+                return false;
+            }
+            const auto jump = code.next(at);
+            if (code.at(jump).op != Jz || code.isTarget(jump)) {
+                return false;
+            }
+            const auto target = code.target(jump);
+            const auto fused = ints ? (equal ? EqIJz : NEqIJz) : (equal ? EqJz : NEqJz);
+            code.at(at) = { .op = fused, .operand = static_cast<std::uint32_t>(target) };
+            code.incoming[target]++;
+            code.remove(jump);
+            return true;
+        }
+
+        // x := x + k, with the sum discarded or, after storeThenLoad, kept on
+        // the stack. k is an int, so x must be one too.
+        static auto addIntToSlot(Peephole& code, const std::size_t at) -> bool {
+            using enum OpCode;
+            const auto load = code.at(at);
+            if (load.op != LoadSlot) {
+                return false;
+            }
+            // Checked one at a time, since only Halt has no next instruction.
+            const auto push = code.next(at);
+            if (code.at(push).op != PushInt) {
+                return false;
+            }
+            const auto add = code.next(push);
+            if (code.at(add).op != Add && code.at(add).op != AddI) {
+                return false;
+            }
+            auto store = code.next(add);
+            const bool keep = code.at(store).op == Dup;
+            const auto dup = store;
+            if (keep) {
+                store = code.next(dup);
+            }
+            if (code.at(store).op != StoreSlot || code.at(store).operand != load.operand
+                || code.isTarget(push) || code.isTarget(add) || code.isTarget(store) || (keep && code.isTarget(dup))) {
+                return false;
+            }
+
+            code.at(at) = { .op = AddSlotInt, .operand = load.operand, .operand2 = code.at(push).operand };
+            code.remove(push);
+            code.remove(add);
+            if (keep) {
+                code.remove(dup);
+                code.at(store) = load;
+            } else {
+                code.remove(store);
+            }
+            return true;
+        }
+
+        static auto storeAndKeep(Peephole& code, const std::size_t at) -> bool {
+            if (code.at(at).op != OpCode::Dup) {
+                return false;
+            }
+            const auto store = code.next(at);
+            if (code.at(store).op != OpCode::StoreSlot || code.isTarget(store)) {
+                return false;
+            }
+            code.at(at) = { .op = OpCode::StoreKeep, .operand = code.at(store).operand };
+            code.remove(store);
+            return true;
+        }
+
+        static auto loadTwice(Peephole& code, const std::size_t at) -> bool {
+            if (code.at(at).op != OpCode::LoadSlot) {
+                return false;
+            }
+            const auto second = code.next(at);
+            if (code.at(second).op != OpCode::LoadSlot || code.isTarget(second)) {
+                return false;
+            }
+            code.at(at) = { .op = OpCode::LoadLoad, .operand = code.at(at).operand, .operand2 = code.at(second).operand };
+            code.remove(second);
+            return true;
+        }
+
+        // --------------------------------------------------------------------
+        // Decoding and encoding
+        // --------------------------------------------------------------------
+        auto decode(const Chunk& chunk) -> void {
+            this->code.clear();
+            this->integers = chunk.integers;
+
+            std::vector<std::uint32_t> indexOf(chunk.code.size() + 1, 0);
+            chunk.forEachInstruction([&](const std::size_t offset, const OpCode op) {
+                indexOf[offset] = static_cast<std::uint32_t>(this->code.size());
+                this->code.push_back({ .op = op });
+            });
+
+            this->incoming.assign(this->code.size(), 0);
+            std::size_t index { 0 };
+            chunk.forEachInstruction([&](const std::size_t offset, const OpCode op) {
+                auto& instruction = this->code[index++];
+                if (isJump(op)) {
+                    const auto target = offset + instructionLength(op) + chunk.readOperand<Offset>(offset + 1);
+                    instruction.operand = indexOf[target];
+                    this->incoming[instruction.operand]++;
+                } else if (operandBytes[static_cast<Type>(op)] >= sizeof(Index)) {
+                    instruction.operand = chunk.readOperand<Index>(offset + 1);
+                    if (operandBytes[static_cast<Type>(op)] == 2 * sizeof(Index)) {
+                        instruction.operand2 = chunk.readOperand<Index>(offset + 1 + sizeof(Index));
+                    }
+                }
+            });
+        }
+
+        auto encode(Chunk& chunk) const -> void {
+            std::vector<std::size_t> offsetOf(this->code.size(), 0);
+            std::size_t offset { 0 };
+            for (std::size_t i = 0; i < this->code.size(); ++i) {
+                offsetOf[i] = offset;
+                if (not this->code[i].removed) {
+                    offset += instructionLength(this->code[i].op);
+                }
+            }
+
+            chunk.code.clear();
+            for (std::size_t i = 0; i < this->code.size(); ++i) {
+                const auto& instruction = this->code[i];
+                if (instruction.removed) {
+                    continue;
+                }
+                chunk.write(instruction.op);
+                if (isJump(instruction.op)) {
+                    const auto end = offsetOf[i] + instructionLength(instruction.op);
+                    chunk.writeOperand(static_cast<Offset>(static_cast<std::ptrdiff_t>(offsetOf[target(i)]) - static_cast<std::ptrdiff_t>(end)));
+                } else if (operandBytes[static_cast<Type>(instruction.op)] >= sizeof(Index)) {
+                    chunk.writeOperand(static_cast<Index>(instruction.operand));
+                    if (operandBytes[static_cast<Type>(instruction.op)] == 2 * sizeof(Index)) {
+                        chunk.writeOperand(static_cast<Index>(instruction.operand2));
+                    }
+                }
+            }
+            chunk.maxStack = maxStack();
+        }
+
+        // Deepest stack along the live code; a Dup can make it deeper than
+        // the generator's count.
+        [[nodiscard]] auto maxStack() const -> std::size_t {
+            constexpr auto unknown = std::numeric_limits<std::size_t>::max();
+            std::vector<std::size_t> depth(this->code.size(), unknown);
+            std::vector<std::size_t> worklist { live(0) };
+            depth[live(0)] = 0;
+            std::size_t deepest { 0 };
+
+            const auto flowTo = [&](const std::size_t target, const std::size_t d) {
+                if (depth[target] == unknown) {
+                    depth[target] = d;
+                    worklist.push_back(target);
+                }
+            };
+
+            while (not worklist.empty()) {
+                const auto i = worklist.back();
+                worklist.pop_back();
+
+                const auto op = this->code[i].op;
+                const auto type = static_cast<Type>(op);
+                const auto after = depth[i] - stackPops[type] + stackPushes[type];
+                deepest = std::max(deepest, after);
+
+                if (isJump(op)) {
+                    flowTo(target(i), after);
+                }
+                if (op != OpCode::Halt && op != OpCode::Jmp) {
+                    flowTo(next(i), after);
+                }
+            }
+            return deepest;
+        }
+
+        [[nodiscard]] auto live(std::size_t index) const -> std::size_t {
+            while (index < this->code.size() && this->code[index].removed) {
+                ++index;
+            }
+            return index;
+        }
+
+        [[nodiscard]] auto liveCount() const -> std::size_t {
+            std::size_t count { 0 };
+            for (const auto& instruction : this->code) {
+                count += not instruction.removed;
+            }
+            return count;
+        }
+
+        std::vector<Rule> rules;
+        std::vector<std::size_t> hits;
+        std::size_t removedTotal { 0 };
+
+        std::vector<Instruction> code;
+        // Per instruction: how many jumps land on it.
+        std::vector<std::size_t> incoming;
+        std::vector<int> integers;
+    };
+}
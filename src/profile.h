@@ -0,0 +1,104 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fmt/core.h>
+
+#include "chunk.h"
+
+namespace ByteCode {
+
+    // ============================================================================
+    // Counts how often each sequence of 2 to maxLength opcodes is executed,
+    // in the order the VM dispatches them; see VirtualMachine::profile(). The
+    // most frequent sequences are the candidates for superinstructions.
+    //
+    // Counts accumulate over any number of runs, of any number of chunks.
+    // Sequences never span two runs, but do span jumps, so a sequence that
+    // runs across a jump target cannot always be fused.
+    // ============================================================================
+    class OpcodeProfile {
+    public:
+        static constexpr std::size_t maxLength = 4;
+
+        struct Sequence {
+            std::vector<OpCode> ops;
+            std::size_t count;
+        };
+
+        // Starts a new run.
+        auto begin() -> void {
+            this->filled = 0;
+        }
+
+        auto record(const OpCode op) -> void {
+            std::shift_left(this->window.begin(), this->window.end(), 1);
+            this->window.back() = op;
+            this->filled = std::min(this->filled + 1, maxLength);
+            this->executed++;
+
+            std::uint64_t key { 0 };
+            for (std::size_t length = 1; length <= this->filled; ++length) {
+                key |= static_cast<std::uint64_t>(this->window[maxLength - length]) << (8 * (length - 1));
+                if (length >= 2) {
+                    this->counts[key | (static_cast<std::uint64_t>(length) << 56)]++;
+                }
+            }
+        }
+
+        // Instructions recorded so far.
+        [[nodiscard]] auto instructions() const -> std::size_t {
+            return this->executed;
+        }
+
+        // The `limit` most frequent sequences of `length` opcodes, most
+        // frequent first.
+        [[nodiscard]] auto top(const std::size_t length, const std::size_t limit) const -> std::vector<Sequence> {
+            std::vector<Sequence> found;
+            for (const auto& [key, count] : this->counts) {
+                if ((key >> 56) != length) {
+                    continue;
+                }
+                Sequence sequence { {}, count };
+                for (std::size_t i = length; i-- > 0;) {
+                    sequence.ops.push_back(static_cast<OpCode>((key >> (8 * i)) & 0xff));
+                }
+                found.push_back(std::move(sequence));
+            }
+            std::ranges::sort(found, [](const auto& a, const auto& b) {
+                return a.count != b.count ? a.count > b.count : a.ops < b.ops;
+            });
+            found.resize(std::min(found.size(), limit));
+            return found;
+        }
+
+        // The `limit` most frequent sequences of each length, with their
+        // share of all executed instructions.
+        [[nodiscard]] auto report(const std::size_t limit) const -> std::string {
+            std::string out = fmt::format("{} instructions executed\n", this->executed);
+            for (std::size_t length = 2; length <= maxLength; ++length) {
+                out += fmt::format("{}-grams:\n", length);
+                for (const auto& sequence : top(length, limit)) {
+                    std::string names;
+                    for (const auto op : sequence.ops) {
+                        names += fmt::format("{} ", getOpCodeName(op));
+                    }
+                    names.pop_back();
+                    out += fmt::format("  {:>10} {:5.1f}%  {}\n", sequence.count, 100.0 * static_cast<double>(sequence.count) / static_cast<double>(this->executed), names);
+                }
+            }
+            return out;
+        }
+
+    private:
+        // The last `filled` opcodes, oldest first, right-aligned.
+        std::array<OpCode, maxLength> window {};
+        std::size_t filled { 0 };
+        std::size_t executed { 0 };
+        // Key: length << 56 | opcodes, the last one in the low byte.
+        std::unordered_map<std::uint64_t, std::size_t> counts;
+    };
+}
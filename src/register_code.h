@@ -0,0 +1,239 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+
+#include "value.h"
+
+// ============================================================================
+// Bytecode of the register backend, the alternative to ByteCode's stack
+// machine. Instructions are three-address and fixed size: an opcode and up to
+// three register operands, `a` being the destination.
+//
+// Every value lives in a register of the frame, laid out as
+//
+//   [ variable slots | constants | temporaries ]
+//
+// so `a := b + c` is one Add, and `a := b + 1` is one Add reading a constant
+// register. Constant registers are filled once, when a context is bound to
+// the chunk, and never written by the code.
+// ============================================================================
+namespace RegisterCode {
+    using Register = std::uint16_t;
+    // Index of an instruction, the operand of jumps.
+    using Target = std::uint32_t;
+
+    // Every opcode except Halt, with the operands it uses:
+    //
+    //   Move                   a = b
+    //   Add ... NEq            a = b op c, checking the types
+    //   AddI ... NEqD          a = b op c on two ints / two doubles, unchecked
+    //   Neg / Not              a = op b
+    //   Print                  prints a
+    //   Jz                     jumps to target() if a is false
+    //   Jmp                    jumps to target()
+#define REGISTER_INSTRUCTIONS(X) \
+    X(Move)                      \
+    X(Add)                       \
+    X(Sub)                       \
+    X(Mul)                       \
+    X(Div)                       \
+    X(Eq)                        \
+    X(NEq)                       \
+    X(AddI)                      \
+    X(SubI)                      \
+    X(MulI)                      \
+    X(DivI)                      \
+    X(EqI)                       \
+    X(NEqI)                      \
+    X(AddD)                      \
+    X(SubD)                      \
+    X(MulD)                      \
+    X(DivD)                      \
+    X(EqD)                       \
+    X(NEqD)                      \
+    X(Neg)                       \
+    X(Not)                       \
+    X(Print)                     \
+    X(Jz)                        \
+    X(Jmp)
+
+#define REGISTER_OPCODES(X) \
+    X(Halt)                 \
+    REGISTER_INSTRUCTIONS(X)
+
+    enum class OpCode : std::uint8_t {
+#define X(name) name,
+        REGISTER_OPCODES(X)
+#undef X
+    };
+
+    constexpr std::array opCodeNames = {
+#define X(name) #name,
+        REGISTER_OPCODES(X)
+#undef X
+    };
+
+    constexpr auto opCodeCount = opCodeNames.size();
+
+    [[nodiscard]] static constexpr auto getOpCodeName(const OpCode op) -> std::string_view {
+        return opCodeNames.at(static_cast<std::size_t>(op));
+    }
+
+    // How many of b and c an opcode reads.
+    [[nodiscard]] static constexpr auto sources(const OpCode op) -> std::size_t {
+        switch (op) {
+            case OpCode::Halt:
+            case OpCode::Print:
+            case OpCode::Jz:
+            case OpCode::Jmp:   return 0;
+            case OpCode::Move:
+            case OpCode::Neg:
+            case OpCode::Not:   return 1;
+            default:            return 2;
+        }
+    }
+
+    [[nodiscard]] static constexpr auto writes(const OpCode op) -> bool {
+        return op != OpCode::Halt && op != OpCode::Print && op != OpCode::Jz && op != OpCode::Jmp;
+    }
+
+    // Whether `a` is an operand: the destination, or the register Print and
+    // Jz read.
+    [[nodiscard]] static constexpr auto usesA(const OpCode op) -> bool {
+        return writes(op) || op == OpCode::Print || op == OpCode::Jz;
+    }
+
+    [[nodiscard]] static constexpr auto isJump(const OpCode op) -> bool {
+        return op == OpCode::Jz || op == OpCode::Jmp;
+    }
+
+    struct Instruction {
+        OpCode op;
+        Register a { 0 };
+        Register b { 0 };
+        Register c { 0 };
+
+        // Jumps keep their target in b and c.
+        [[nodiscard]] auto target() const -> Target {
+            return static_cast<Target>(this->b) | (static_cast<Target>(this->c) << 16);
+        }
+
+        auto setTarget(const Target target) -> void {
+            this->b = static_cast<Register>(target);
+            this->c = static_cast<Register>(target >> 16);
+        }
+    };
+    static_assert(sizeof(Instruction) == 8);
+
+    // ============================================================================
+    // A compiled program for the register machine.
+    // ============================================================================
+    struct Chunk {
+        std::vector<Instruction> code;
+        // Values of the constant registers, which start at slots.size().
+        std::vector<Value> constants;
+        // One entry per variable slot, holding the variable's name.
+        std::vector<std::string> slots;
+        // The first `inputs` slots are set by the caller before each run.
+        std::size_t inputs { 0 };
+        // Registers in a frame: slots, constants and temporaries.
+        std::size_t registers { 0 };
+
+        [[nodiscard]] auto firstConstant() const -> std::size_t {
+            return this->slots.size();
+        }
+
+        [[nodiscard]] auto firstTemporary() const -> std::size_t {
+            return this->slots.size() + this->constants.size();
+        }
+    };
+
+    [[nodiscard]] inline auto disassemble(const Chunk& chunk) -> std::string {
+        const auto name = [&](const Register r) -> std::string {
+            if (r < chunk.firstConstant()) {
+                return fmt::format("r{}({})", r, chunk.slots[r]);
+            }
+            if (r < chunk.firstTemporary()) {
+                return fmt::format("k{}({})", r, chunk.constants[r - chunk.firstConstant()].visit(PrintVisitor {}));
+            }
+            return fmt::format("t{}", r);
+        };
+
+        std::string out;
+        for (std::size_t i = 0; i < chunk.code.size(); ++i) {
+            const auto& instruction = chunk.code[i];
+            std::string operands;
+            if (usesA(instruction.op)) {
+                operands += " " + name(instruction.a);
+            }
+            if (isJump(instruction.op)) {
+                operands += fmt::format(" -> {:04}", instruction.target());
+            }
+            if (sources(instruction.op) >= 1) {
+                operands += " " + name(instruction.b);
+            }
+            if (sources(instruction.op) == 2) {
+                operands += " " + name(instruction.c);
+            }
+            auto line = fmt::format("{:04} {:<5}{}", i, getOpCodeName(instruction.op), operands);
+            line.erase(line.find_last_not_of(' ') + 1);
+            out += line + '\n';
+        }
+        return out;
+    }
+
+    // ============================================================================
+    // Load-time check that a chunk is safe to run without further checks:
+    // every opcode and register is in range, nothing writes a constant
+    // register, jumps land inside the code and the code ends in Halt or Jmp.
+    //
+    // Returns a description of the first problem found.
+    // ============================================================================
+    [[nodiscard]] inline auto verify(const Chunk& chunk) -> std::optional<std::string> {
+        if (chunk.code.empty()) {
+            return "empty chunk";
+        }
+        if (chunk.inputs > chunk.slots.size()) {
+            return "more inputs than slots";
+        }
+        if (chunk.registers < chunk.firstTemporary() || chunk.registers > std::numeric_limits<Register>::max()) {
+            return "register count does not cover slots and constants";
+        }
+
+        for (std::size_t i = 0; i < chunk.code.size(); ++i) {
+            const auto& instruction = chunk.code[i];
+            if (static_cast<std::size_t>(instruction.op) >= opCodeCount) {
+                return fmt::format("{:04}: invalid opcode {}", i, static_cast<int>(instruction.op));
+            }
+            const auto op = instruction.op;
+
+            if (isJump(op) && instruction.target() >= chunk.code.size()) {
+                return fmt::format("{:04}: jump out of the code", i);
+            }
+            const std::array operands { instruction.b, instruction.c };
+            for (std::size_t source = 0; source < sources(op); ++source) {
+                if (operands[source] >= chunk.registers) {
+                    return fmt::format("{:04}: register out of range", i);
+                }
+            }
+            if (usesA(op) && instruction.a >= chunk.registers) {
+                return fmt::format("{:04}: register out of range", i);
+            }
+            if (writes(op) && instruction.a >= chunk.firstConstant() && instruction.a < chunk.firstTemporary()) {
+                return fmt::format("{:04}: {} writes a constant register", i, getOpCodeName(op));
+            }
+        }
+
+        const auto last = chunk.code.back().op;
+        if (last != OpCode::Halt && last != OpCode::Jmp) {
+            return "execution can run off the end of the code";
+        }
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,336 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fmt/core.h>
+
+#include "expression.h"
+#include "register_code.h"
+#include "statement.h"
+#include "trace.h"
+
+// ============================================================================
+// Generates RegisterCode from the AST, for the register backend.
+//
+// Each expression is generated into a register and returns it. Variables and
+// literals already have one, so they emit nothing; an operator writes a new
+// temporary, or straight into the variable when it is the value of an
+// assignment, so `a := b + c` is a single Add. Temporaries are allocated
+// like a stack and released once the operator that reads them is emitted.
+//
+// Errors and the rules for defined variables are those of the
+// BytecodeGenerator, and so are inputs and the specialized opcodes picked
+// from the TypeChecker's annotations.
+// ============================================================================
+class RegisterGenerator : Expressions::ExpressionVisitor, Statements::StatementVisitor {
+    using Register = RegisterCode::Register;
+    using OpCode = RegisterCode::OpCode;
+
+public:
+    RegisterGenerator(std::span<std::unique_ptr<Statements::Statement>> statements, std::span<const std::string_view> inputs = {})
+        : statements { statements } {
+        for (const auto input : inputs) {
+            this->defined[slot(input)] = true;
+        }
+        this->chunk.inputs = this->chunk.slots.size();
+    }
+
+    [[nodiscard]] auto generate() -> RegisterCode::Chunk {
+        TRACE(Generator, "=== Start Generating registers ===");
+        // Slots and constants are numbered from 0 each while generating, as
+        // neither count is known yet; relocate() moves them into place.
+        for (auto& statement : this->statements) {
+            this->temporaries = 0;
+            statement->accept(*this);
+        }
+        emit(OpCode::Halt);
+
+        relocate();
+        return std::move(this->chunk);
+    }
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return not this->errors.empty();
+    }
+
+    [[nodiscard]] auto getErrors() const -> const std::vector<std::string>& {
+        return this->errors;
+    }
+
+private:
+    // While generating, a register is tagged with the space it belongs to in
+    // its top bits; relocate() replaces the tags with real numbers.
+    enum Space : std::uint32_t {
+        Slot = 0,
+        Constant = 1u << 30,
+        Temporary = 2u << 30,
+    };
+    static constexpr std::uint32_t spaceMask = 3u << 30;
+
+    using Operand = std::uint32_t;
+
+    struct Pending {
+        OpCode op;
+        Operand a { 0 };
+        Operand b { 0 };
+        Operand c { 0 };
+    };
+
+    auto emit(const OpCode op, const Operand a = 0, const Operand b = 0, const Operand c = 0) -> std::size_t {
+        TRACE(Generator, "Add register instruction {}", RegisterCode::getOpCodeName(op));
+        this->code.push_back({ op, a, b, c });
+        return this->code.size() - 1;
+    }
+
+    [[nodiscard]] auto slot(const std::string_view name) -> Operand {
+        if (const auto found = this->variables.find(name); found != this->variables.end()) {
+            return found->second;
+        }
+        const auto index = static_cast<Operand>(this->chunk.slots.size());
+        this->chunk.slots.emplace_back(name);
+        this->variables.emplace(name, index);
+        this->defined.push_back(false);
+        return Slot | index;
+    }
+
+    template<typename Key>
+    [[nodiscard]] auto constant(std::unordered_map<Key, Operand>& index, const Key key, const Value value) -> Operand {
+        if (const auto found = index.find(key); found != index.end()) {
+            return found->second;
+        }
+        const auto added = Constant | static_cast<Operand>(this->chunk.constants.size());
+        this->chunk.constants.push_back(value);
+        index.emplace(key, added);
+        return added;
+    }
+
+    [[nodiscard]] auto temporary() -> Operand {
+        const auto index = this->temporaries++;
+        this->maxTemporaries = std::max(this->maxTemporaries, this->temporaries);
+        return Temporary | index;
+    }
+
+    // Where an operator writes its result: the requested destination, or a
+    // new temporary once the operands' temporaries are released.
+    [[nodiscard]] auto destination(const std::uint32_t mark) -> Operand {
+        this->temporaries = mark;
+        if (this->target.has_value()) {
+            return *std::exchange(this->target, std::nullopt);
+        }
+        return temporary();
+    }
+
+    // Generates `expression` and returns the register holding its value.
+    // With `into`, the value ends up in that register.
+    auto generate(Expressions::Expression& expression, const std::optional<Operand> into = std::nullopt) -> Operand {
+        const auto saved = std::exchange(this->target, into);
+        expression.accept(*this);
+        auto result = this->result;
+        if (into.has_value() && result != *into) {
+            // Only operators consume the target; move anything else into it.
+            emit(OpCode::Move, *into, result);
+            result = *into;
+        }
+        this->target = saved;
+        return result;
+    }
+
+    auto error(const Token& token, const std::string& message) -> void {
+        this->errors.push_back(fmt::format("[line {}] Error at '{}': {}", token.position.line, token.getLexeme(), message));
+    }
+
+    // Replaces tagged operands with register numbers and fills in the
+    // chunk's code.
+    auto relocate() -> void {
+        const auto constants = this->chunk.slots.size();
+        const auto temporaries = constants + this->chunk.constants.size();
+        this->chunk.registers = temporaries + this->maxTemporaries;
+        if (this->chunk.registers > std::numeric_limits<Register>::max()) {
+            this->errors.push_back(fmt::format("Error: Program needs {} registers, at most {} are supported.", this->chunk.registers, std::numeric_limits<Register>::max()));
+            return;
+        }
+
+        const auto place = [&](const Operand operand) -> Register {
+            const auto index = operand & ~spaceMask;
+            switch (operand & spaceMask) {
+                case Constant:  return static_cast<Register>(constants + index);
+                case Temporary: return static_cast<Register>(temporaries + index);
+                default:        return static_cast<Register>(index);
+            }
+        };
+
+        this->chunk.code.reserve(this->code.size());
+        for (const auto& pending : this->code) {
+            RegisterCode::Instruction instruction { pending.op };
+            if (RegisterCode::usesA(pending.op)) {
+                instruction.a = place(pending.a);
+            }
+            if (RegisterCode::isJump(pending.op)) {
+                instruction.setTarget(pending.b);
+            } else {
+                instruction.b = place(pending.b);
+                instruction.c = place(pending.c);
+            }
+            this->chunk.code.push_back(instruction);
+        }
+    }
+
+    [[nodiscard]] static auto specialized(const Expressions::StaticType operands, const OpCode generic, const OpCode ints, const OpCode doubles) -> OpCode {
+        switch (operands) {
+            case Expressions::StaticType::Int:    return ints;
+            case Expressions::StaticType::Double: return doubles;
+            default:                              return generic;
+        }
+    }
+
+    [[nodiscard]] static auto operatorCode(const TokenType op, const Expressions::StaticType operands) -> OpCode {
+        switch (op) {
+            case TokenType::Plus:       return specialized(operands, OpCode::Add, OpCode::AddI, OpCode::AddD);
+            case TokenType::Minus:      return specialized(operands, OpCode::Sub, OpCode::SubI, OpCode::SubD);
+            case TokenType::Star:       return specialized(operands, OpCode::Mul, OpCode::MulI, OpCode::MulD);
+            case TokenType::Slash:      return specialized(operands, OpCode::Div, OpCode::DivI, OpCode::DivD);
+            case TokenType::EqualEqual: return specialized(operands, OpCode::Eq, OpCode::EqI, OpCode::EqD);
+            case TokenType::BangEqual:  return specialized(operands, OpCode::NEq, OpCode::NEqI, OpCode::NEqD);
+            default:
+                assert(false && "not a binary operator");
+                return OpCode::Halt;
+        }
+    }
+
+    auto binary(Expressions::Expression& lhs, const TokenType op, Expressions::Expression& rhs) -> void {
+        const auto into = std::exchange(this->target, std::nullopt);
+        const auto mark = this->temporaries;
+        const auto b = generate(lhs);
+        const auto c = generate(rhs);
+        this->target = into;
+
+        const auto operands = lhs.type == rhs.type ? lhs.type : Expressions::StaticType::Unknown;
+        const auto a = destination(mark);
+        emit(operatorCode(op, operands), a, b, c);
+        this->result = a;
+    }
+
+    // ------------------------------------------------------------------------
+    // Statements
+    // ------------------------------------------------------------------------
+    auto visit(Statements::ExpressionStatement& statement) -> void override {
+        std::ignore = generate(*statement.expression);
+    }
+
+    auto visit(Statements::Print& statement) -> void override {
+        emit(OpCode::Print, generate(*statement.expression));
+    }
+
+    auto visit(Statements::IfStatement& statement) -> void override {
+        const auto condition = generate(*statement.condition);
+        const auto jz = emit(OpCode::Jz, condition);
+        this->temporaries = 0;
+
+        // A variable is only defined after the if when both branches define it.
+        const auto before = this->defined;
+        if (statement.then != nullptr) {
+            statement.then->accept(*this);
+        }
+        auto afterThen = std::move(this->defined);
+        this->defined = before;
+        this->defined.resize(afterThen.size(), false);
+
+        if (statement.otherwise != nullptr) {
+            const auto jmp = emit(OpCode::Jmp);
+            this->code[jz].b = static_cast<Operand>(this->code.size());
+            statement.otherwise->accept(*this);
+            this->code[jmp].b = static_cast<Operand>(this->code.size());
+        } else {
+            this->code[jz].b = static_cast<Operand>(this->code.size());
+        }
+
+        afterThen.resize(this->defined.size(), false);
+        for (std::size_t i = 0; i < this->defined.size(); ++i) {
+            this->defined[i] = this->defined[i] && afterThen[i];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Expressions
+    // ------------------------------------------------------------------------
+    auto visit(Expressions::BinaryOperator& expression) -> void override {
+        binary(*expression.lhs, expression.operator_type.ttype, *expression.rhs);
+    }
+
+    auto visit(Expressions::Logical& expression) -> void override {
+        binary(*expression.lhs, expression.operator_type.ttype, *expression.rhs);
+    }
+
+    auto visit(Expressions::Unary& expression) -> void override {
+        const auto into = std::exchange(this->target, std::nullopt);
+        const auto mark = this->temporaries;
+        const auto b = generate(*expression.operand);
+        this->target = into;
+
+        const auto a = destination(mark);
+        emit(expression.operator_type.ttype == TokenType::Bang ? OpCode::Not : OpCode::Neg, a, b);
+        this->result = a;
+    }
+
+    auto visit(Expressions::Variable& expression) -> void override {
+        const auto found = this->variables.find(expression.name.getLexeme());
+        if (found == this->variables.end()) {
+            error(expression.name, "Undefined variable.");
+        } else if (not this->defined[found->second & ~spaceMask]) {
+            error(expression.name, "Variable might not be defined on every path.");
+        }
+        this->result = found != this->variables.end() ? found->second : Slot;
+    }
+
+    auto visit(Expressions::Assign& expression) -> void override {
+        const auto variable = slot(expression.name.getLexeme());
+        std::ignore = generate(*expression.value, variable);
+        this->defined[variable & ~spaceMask] = true;
+        this->result = variable;
+    }
+
+    auto visit(Expressions::INumber& expression) -> void override {
+        this->result = constant(this->integers, expression.value, Value { expression.value });
+    }
+
+    auto visit(Expressions::DNumber& expression) -> void override {
+        // Keyed on the bit pattern so 0.0 and -0.0 stay distinct.
+        this->result = constant(this->doubles, std::bit_cast<std::uint64_t>(expression.value), Value { expression.value });
+    }
+
+    auto visit(Expressions::Boolean& expression) -> void override {
+        this->result = constant(this->booleans, expression.value, Value { expression.value });
+    }
+
+private:
+    std::span<std::unique_ptr<Statements::Statement>> statements;
+    RegisterCode::Chunk chunk;
+    std::vector<Pending> code;
+    std::vector<std::string> errors;
+
+    std::unordered_map<std::string_view, Operand> variables;
+    // Per slot: is the variable assigned on every path reaching this point?
+    std::vector<bool> defined;
+    std::unordered_map<int, Operand> integers;
+    std::unordered_map<std::uint64_t, Operand> doubles;
+    std::unordered_map<bool, Operand> booleans;
+
+    // Temporaries in use, and the most ever in use at once.
+    std::uint32_t temporaries { 0 };
+    std::uint32_t maxTemporaries { 0 };
+    // Register the expression being generated should write, if any.
+    std::optional<Operand> target;
+    // Register holding the value of the expression just generated.
+    Operand result { 0 };
+};
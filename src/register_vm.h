@@ -0,0 +1,349 @@
+#pragma once
+
+#include "register_code.h"
+#include "trace.h"
+#include "value.h"
+#include "vm.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+// ============================================================================
+// Everything a single run of a RegisterCode program mutates: its frame of
+// registers. Like an ExecutionContext, a context is sized for one chunk and
+// can be reused for any number of runs of it, but not by two at once.
+// ============================================================================
+class RegisterContext {
+    friend class RegisterMachine;
+
+public:
+    explicit RegisterContext(const RegisterCode::Chunk& chunk, std::ostream& out = std::cout) : out { &out } {
+        bind(chunk);
+    }
+
+    // Resizes the context for another chunk, reusing its storage, and loads
+    // the chunk's constant registers.
+    auto bind(const RegisterCode::Chunk& chunk) -> void {
+        this->registers.resize(chunk.registers);
+        std::ranges::copy(chunk.constants, this->registers.begin() + static_cast<std::ptrdiff_t>(chunk.firstConstant()));
+        this->slots = chunk.slots.size();
+    }
+
+    auto setSlot(const RegisterCode::Register slot, const Value value) -> void {
+        assert(slot < this->slots);
+        this->registers[slot] = value;
+    }
+
+    [[nodiscard]] auto getSlot(const RegisterCode::Register slot) const -> const Value& {
+        assert(slot < this->slots);
+        return this->registers[slot];
+    }
+
+    [[nodiscard]] auto getSlots() const -> std::span<const Value> {
+        return std::span(this->registers).first(this->slots);
+    }
+
+    [[nodiscard]] auto getOutput() const -> std::ostream& {
+        return *this->out;
+    }
+
+    auto setOutput(std::ostream& out) -> void {
+        this->out = &out;
+    }
+
+    // The run-time error that stopped the last run, if any.
+    [[nodiscard]] auto getError() const -> const std::optional<std::string>& {
+        return this->error;
+    }
+
+private:
+    // Slots are not cleared between runs, see ExecutionContext::reset().
+    auto reset(const RegisterCode::Chunk& chunk) -> void {
+        this->ip = chunk.code.data();
+        this->base = this->registers.data();
+        this->error.reset();
+    }
+
+    // Stops the run at the next dispatch, see ExecutionContext::fail().
+    auto fail(std::string message) -> void {
+        static constexpr RegisterCode::Instruction halt { RegisterCode::OpCode::Halt };
+        this->error = std::move(message);
+        this->ip = &halt;
+    }
+
+    // See ExecutionContext::succeeded().
+    [[nodiscard]] auto succeeded() const -> bool {
+        if (this->error.has_value()) {
+            fmt::print(stderr, "Runtime error: {}\n", *this->error);
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] auto operator[](const RegisterCode::Register r) -> Value& {
+        return this->base[r];
+    }
+
+    const RegisterCode::Instruction* ip { nullptr };
+    Value* base { nullptr };
+    std::vector<Value> registers;
+    std::size_t slots { 0 };
+    std::ostream* out;
+    std::optional<std::string> error;
+};
+
+// ============================================================================
+// Interpreter for RegisterCode, the register backend's counterpart of the
+// VirtualMachine. Operands are read from and written to the frame directly,
+// so there is no operand stack and one instruction does the work of the
+// stack machine's loads, operator and store.
+// ============================================================================
+class RegisterMachine {
+    using Instruction = RegisterCode::Instruction;
+
+public:
+    using Dispatch = VirtualMachine::Dispatch;
+    static constexpr auto defaultDispatch = VirtualMachine::defaultDispatch;
+
+    // The chunk is verified once here and never modified; runs then trust its
+    // register numbers and jump targets.
+    RegisterMachine(const RegisterCode::Chunk& chunk) : chunk { chunk }, error { RegisterCode::verify(chunk) } {}
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return this->error.has_value();
+    }
+
+    [[nodiscard]] auto getError() const -> const std::optional<std::string>& {
+        return this->error;
+    }
+
+    [[nodiscard]] auto getChunk() const -> const RegisterCode::Chunk& {
+        return this->chunk;
+    }
+
+    [[nodiscard]] auto slot(const std::string_view name) const -> std::optional<RegisterCode::Register> {
+        const auto found = std::find(this->chunk.slots.begin(), this->chunk.slots.end(), name);
+        if (found == this->chunk.slots.end()) {
+            return std::nullopt;
+        }
+        return static_cast<RegisterCode::Register>(std::distance(this->chunk.slots.begin(), found));
+    }
+
+    // Runs the program from the start in the given context, which must be
+    // bound to this chunk. Returns false if the chunk failed verification or
+    // the run stopped on a run-time error, see RegisterContext::getError().
+    auto run(RegisterContext& context, Dispatch dispatch = defaultDispatch) const -> bool {
+        if (hadError()) {
+            fmt::print(stderr, "Refusing to run malformed register code: {}\n", *this->error);
+            return false;
+        }
+
+        TRACE(VM, "=== Start register VM ===");
+        assert(context.registers.size() == this->chunk.registers && "context bound to another chunk");
+        context.reset(this->chunk);
+
+#if ACOMPILER_COMPUTED_GOTO
+        if (dispatch == Dispatch::Threaded) {
+            executeThreaded(context);
+            return context.succeeded();
+        }
+#endif
+        executeSwitch(context);
+        return context.succeeded();
+    }
+
+    // Runs the program in a context owned by this RegisterMachine. Returns
+    // what run() does.
+    auto execute(Dispatch dispatch = defaultDispatch) -> bool {
+        if (not this->context.has_value()) {
+            this->context.emplace(this->chunk);
+        }
+        return run(*this->context, dispatch);
+    }
+
+private:
+    auto executeSwitch(RegisterContext& ctx) const -> void {
+        while (true) {
+            const auto& instruction = *ctx.ip++;
+            switch (instruction.op) {
+            case RegisterCode::OpCode::Halt:
+                return;
+#define X(name) case RegisterCode::OpCode::name: this->op##name(ctx, instruction); break;
+            REGISTER_INSTRUCTIONS(X)
+#undef X
+            }
+        }
+    }
+
+#if ACOMPILER_COMPUTED_GOTO
+    auto executeThreaded(RegisterContext& ctx) const -> void {
+        static const void* const dispatchTable[] = {
+#define X(name) &&op_##name,
+            REGISTER_OPCODES(X)
+#undef X
+        };
+        static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == RegisterCode::opCodeCount);
+
+        const Instruction* instruction { nullptr };
+#define DISPATCH()            \
+    instruction = ctx.ip++;   \
+    goto *dispatchTable[static_cast<std::size_t>(instruction->op)]
+
+        DISPATCH();
+
+    op_Halt:
+        return;
+#define X(name) op_##name: this->op##name(ctx, *instruction); DISPATCH();
+        REGISTER_INSTRUCTIONS(X)
+#undef X
+#undef DISPATCH
+    }
+#endif
+
+    // ------------------------------------------------------------------------
+    // Instruction handlers, entered with ip just past the instruction
+    // ------------------------------------------------------------------------
+    enum class BinaryOperators {
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        EQ,
+        NEQ,
+    };
+    static constexpr std::array BinaryOperatorNames = {
+        "ADD",
+        "SUB",
+        "MUL",
+        "DIV",
+        "EQ",
+        "NEQ",
+    };
+
+    template<BinaryOperators op>
+    auto doBinaryOperation(RegisterContext& ctx, const Instruction& i) const -> void {
+        const auto& b = ctx[i.b];
+        const auto& c = ctx[i.c];
+        TRACE(VM, "Perform binary operation on r{} r{}", i.b, i.c);
+
+        if (Value::bothInts(b, c)) [[likely]] {
+            if (op == BinaryOperators::DIV && c.asInt() == 0) [[unlikely]] {
+                return ctx.fail("Division by zero.");
+            }
+            ctx[i.a] = apply<op>(b.asInt(), c.asInt());
+        } else if (Value::bothDoubles(b, c)) {
+            ctx[i.a] = apply<op>(b.asDouble(), c.asDouble());
+        } else {
+            ctx.fail(fmt::format("Operands of {} must be two numbers of the same type, got {} and {}.", BinaryOperatorNames[static_cast<std::size_t>(op)], b.visit(PrintVisitor{}), c.visit(PrintVisitor{})));
+        }
+    }
+
+    // The operand types were proved at compile time, so the tags are not
+    // looked at.
+    template<BinaryOperators op, typename T>
+    auto doTypedOperation(RegisterContext& ctx, const Instruction& i) const -> void {
+        TRACE(VM, "Perform typed operation on r{} r{}", i.b, i.c);
+        if constexpr (std::is_same_v<T, int>) {
+            if (op == BinaryOperators::DIV && ctx[i.c].asInt() == 0) [[unlikely]] {
+                return ctx.fail("Division by zero.");
+            }
+            ctx[i.a] = apply<op>(ctx[i.b].asInt(), ctx[i.c].asInt());
+        } else {
+            ctx[i.a] = apply<op>(ctx[i.b].asDouble(), ctx[i.c].asDouble());
+        }
+    }
+
+    auto opMove(RegisterContext& ctx, const Instruction& i) const -> void {
+        TRACE(VM, "Move r{} to r{}", i.b, i.a);
+        ctx[i.a] = ctx[i.b];
+    }
+
+    auto opAdd(RegisterContext& ctx, const Instruction& i) const -> void { doBinaryOperation<BinaryOperators::ADD>(ctx, i); }
+    auto opSub(RegisterContext& ctx, const Instruction& i) const -> void { doBinaryOperation<BinaryOperators::SUB>(ctx, i); }
+    auto opMul(RegisterContext& ctx, const Instruction& i) const -> void { doBinaryOperation<BinaryOperators::MUL>(ctx, i); }
+    auto opDiv(RegisterContext& ctx, const Instruction& i) const -> void { doBinaryOperation<BinaryOperators::DIV>(ctx, i); }
+    auto opEq(RegisterContext& ctx, const Instruction& i)  const -> void { doBinaryOperation<BinaryOperators::EQ>(ctx, i); }
+    auto opNEq(RegisterContext& ctx, const Instruction& i) const -> void { doBinaryOperation<BinaryOperators::NEQ>(ctx, i); }
+
+    auto opAddI(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::ADD, int>(ctx, i); }
+    auto opSubI(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::SUB, int>(ctx, i); }
+    auto opMulI(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::MUL, int>(ctx, i); }
+    auto opDivI(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::DIV, int>(ctx, i); }
+    auto opEqI(RegisterContext& ctx, const Instruction& i)  const -> void { doTypedOperation<BinaryOperators::EQ, int>(ctx, i); }
+    auto opNEqI(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::NEQ, int>(ctx, i); }
+
+    auto opAddD(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::ADD, double>(ctx, i); }
+    auto opSubD(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::SUB, double>(ctx, i); }
+    auto opMulD(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::MUL, double>(ctx, i); }
+    auto opDivD(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::DIV, double>(ctx, i); }
+    auto opEqD(RegisterContext& ctx, const Instruction& i)  const -> void { doTypedOperation<BinaryOperators::EQ, double>(ctx, i); }
+    auto opNEqD(RegisterContext& ctx, const Instruction& i) const -> void { doTypedOperation<BinaryOperators::NEQ, double>(ctx, i); }
+
+    auto opNeg(RegisterContext& ctx, const Instruction& i) const -> void {
+        const auto& value = ctx[i.b];
+        TRACE(VM, "Neg on {}", value.visit(PrintVisitor{}));
+        if (value.isInt()) [[likely]] {
+            ctx[i.a] = static_cast<int>(0u - static_cast<std::uint32_t>(value.asInt()));
+        } else if (value.isDouble()) {
+            ctx[i.a] = -value.asDouble();
+        } else {
+            ctx.fail(fmt::format("Operand of Neg must be a number, got {}.", value.visit(PrintVisitor{})));
+        }
+    }
+
+    auto opNot(RegisterContext& ctx, const Instruction& i) const -> void {
+        const auto& value = ctx[i.b];
+        TRACE(VM, "Not on {}", value.visit(PrintVisitor{}));
+        if (not value.isBool()) [[unlikely]] {
+            return ctx.fail(fmt::format("Operand of Not must be a bool, got {}.", value.visit(PrintVisitor{})));
+        }
+        ctx[i.a] = not value.asBool();
+    }
+
+    auto opPrint(RegisterContext& ctx, const Instruction& i) const -> void {
+        *ctx.out << ctx[i.a].visit(PrintVisitor{}) << '\n';
+    }
+
+    auto opJz(RegisterContext& ctx, const Instruction& i) const -> void {
+        const auto& condition = ctx[i.a];
+        TRACE(VM, "Jz on {}", condition.visit(PrintVisitor{}));
+        if (not condition.isBool()) [[unlikely]] {
+            return ctx.fail(fmt::format("Condition must be a bool, got {}.", condition.visit(PrintVisitor{})));
+        }
+        if (not condition.asBool()) {
+            ctx.ip = this->chunk.code.data() + i.target();
+        }
+    }
+
+    auto opJmp(RegisterContext& ctx, const Instruction& i) const -> void {
+        ctx.ip = this->chunk.code.data() + i.target();
+    }
+
+    // Int arithmetic wraps, see VirtualMachine::apply().
+    template<BinaryOperators op, typename T>
+    [[nodiscard]] static auto apply(const T a, const T b) -> Value {
+        if constexpr (std::is_same_v<T, int>) {
+            const auto ua = static_cast<std::uint32_t>(a);
+            const auto ub = static_cast<std::uint32_t>(b);
+            if constexpr (op == BinaryOperators::ADD) return static_cast<int>(ua + ub);
+            if constexpr (op == BinaryOperators::SUB) return static_cast<int>(ua - ub);
+            if constexpr (op == BinaryOperators::MUL) return static_cast<int>(ua * ub);
+            if constexpr (op == BinaryOperators::DIV) return b == -1 ? static_cast<int>(0u - ua) : a / b;
+        }
+        if constexpr (op == BinaryOperators::ADD) return a + b;
+        if constexpr (op == BinaryOperators::SUB) return a - b;
+        if constexpr (op == BinaryOperators::MUL) return a * b;
+        if constexpr (op == BinaryOperators::DIV) return a / b;
+        if constexpr (op == BinaryOperators::EQ)  return a == b;
+        if constexpr (op == BinaryOperators::NEQ) return a != b;
+    }
+
+private:
+    const RegisterCode::Chunk& chunk;
+    std::optional<std::string> error;
+    // Only used by execute().
+    std::optional<RegisterContext> context;
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============================================================================
+// The text of one script. Regular files are mapped read-only, so lexing reads
+// the page cache directly and token lexemes point into the mapping; anything
+// that cannot be mapped (stdin, pipes) is read into an owned buffer instead.
+//
+// Tokens and AST nodes hold string_views into view(), so a SourceFile must
+// outlive the whole compilation.
+// ============================================================================
+class SourceFile {
+public:
+    // Opens and maps `path`; "-" reads stdin.
+    [[nodiscard]] static auto open(const std::string_view path) -> std::optional<SourceFile> {
+        if (path == "-") {
+            return fromDescriptor(STDIN_FILENO, "<stdin>");
+        }
+
+        const std::string name { path };
+        const int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            spdlog::error(fmt::format("Cannot open '{}': {}", name, std::strerror(errno)));
+            return std::nullopt;
+        }
+
+        auto source = fromDescriptor(fd, name);
+        ::close(fd);
+        return source;
+    }
+
+    // Maps `fd` if it is a non-empty regular file and reads it otherwise. The
+    // descriptor stays open and owned by the caller.
+    [[nodiscard]] static auto fromDescriptor(const int fd, const std::string_view name) -> std::optional<SourceFile> {
+        struct stat info {};
+        if (fstat(fd, &info) != 0) {
+            spdlog::error(fmt::format("Cannot stat '{}': {}", name, std::strerror(errno)));
+            return std::nullopt;
+        }
+
+        if (S_ISREG(info.st_mode) && info.st_size > 0) {
+            const auto size = static_cast<std::size_t>(info.st_size);
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                // The lexer makes one forward pass.
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                return SourceFile { static_cast<const char*>(mapping), size };
+            }
+        }
+
+        std::string buffer;
+        char block[64 * 1024];
+        while (true) {
+            const auto count = ::read(fd, block, sizeof(block));
+            if (count == 0) {
+                break;
+            }
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                spdlog::error(fmt::format("Cannot read '{}': {}", name, std::strerror(errno)));
+                return std::nullopt;
+            }
+            buffer.append(block, static_cast<std::size_t>(count));
+        }
+        return SourceFile { std::move(buffer) };
+    }
+
+    SourceFile(SourceFile&& other) noexcept
+        : mapping { std::exchange(other.mapping, nullptr) }, length { std::exchange(other.length, 0) }, buffer { std::move(other.buffer) } {}
+
+    auto operator=(SourceFile&& other) noexcept -> SourceFile& {
+        std::swap(this->mapping, other.mapping);
+        std::swap(this->length, other.length);
+        std::swap(this->buffer, other.buffer);
+        return *this;
+    }
+
+    ~SourceFile() {
+        if (this->mapping != nullptr) {
+            munmap(const_cast<char*>(this->mapping), this->length);
+        }
+    }
+
+    [[nodiscard]] auto view() const -> std::string_view {
+        if (this->mapping != nullptr) {
+            return { this->mapping, this->length };
+        }
+        return this->buffer;
+    }
+
+    [[nodiscard]] auto isMapped() const -> bool {
+        return this->mapping != nullptr;
+    }
+
+private:
+    SourceFile(const char* mapping, const std::size_t length) : mapping { mapping }, length { length } {}
+    explicit SourceFile(std::string buffer) : buffer { std::move(buffer) } {}
+
+    const char* mapping { nullptr };
+    std::size_t length { 0 };
+    std::string buffer;
+};
@@ -23,6 +23,17 @@ namespace Statements {
         virtual ~Statement() = default;
         virtual void accept(StatementVisitor& visitor) = 0;
         [[nodiscard]] virtual auto to_string(std::size_t offset = 0) -> std::string const = 0;
+
+        // Nodes made by an AstArena are released with the arena, see ast_arena.h.
+        static void operator delete(Statement* statement, std::destroying_delete_t) {
+            if (statement->arenaOwned) {
+                return;
+            }
+            statement->~Statement();
+            ::operator delete(statement);
+        }
+
+        bool arenaOwned { false };
     };
 
     template<typename T>
@@ -58,11 +69,12 @@ namespace Statements {
         [[nodiscard]] auto to_string(std::size_t offset = 0) -> std::string const final { 
             return fmt::format("IfStatement {} then {} otherwise", 
                     condition->to_string(), 
-                    then->to_string(), 
+                    then != nullptr ? then->to_string() : "<empty>", 
                     otherwise != nullptr ? otherwise->to_string() : "<no else branch>"); 
         }
 
         std::unique_ptr<Expressions::Expression> condition;
+        // Null when the optimizer removed every statement of the branch.
         std::unique_ptr<Statements::Statement> then;
         std::unique_ptr<Statements::Statement> otherwise;
     };
@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// ============================================================================
+// Fixed set of worker threads, each with its own task deque. A worker pops
+// its newest task from the back of its own deque and, when that is empty,
+// steals the oldest task from the front of another worker's deque. Tasks
+// submitted from outside the pool are spread round-robin; tasks submitted from
+// a worker go to that worker's deque.
+//
+// The deques are guarded by one mutex each, held only for the push/pop
+// itself, so workers contend only when stealing. This is a simplification of
+// a lock-free (Chase-Lev) deque: the lock is uncontended unless a thief is at
+// the same deque, and the jobs it guards run for far longer than it is held.
+// Submitting takes no other lock unless a worker is asleep and must be woken.
+// ============================================================================
+class ThreadPool {
+    using Task = std::function<void()>;
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+public:
+    explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency()) {
+        threads = std::max<std::size_t>(threads, 1);
+        for (std::size_t i = 0; i < threads; ++i) {
+            this->queues.push_back(std::make_unique<Queue>());
+        }
+        for (std::size_t i = 0; i < threads; ++i) {
+            this->workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+    // Runs every task that was already submitted, then joins the workers.
+    ~ThreadPool() {
+        {
+            std::lock_guard lock { this->sleepMutex };
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+        for (auto& worker : this->workers) {
+            worker.join();
+        }
+    }
+
+    template<typename F>
+    [[nodiscard]] auto submit(F&& f) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+
+        // std::function needs a copyable target, packaged_task is move-only.
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        push([task = std::move(task)] { (*task)(); });
+        return future;
+    }
+
+    // The result of `future`, running queued tasks until it is ready. A task
+    // running on a worker can wait this way on tasks it submitted without
+    // tying up the worker those tasks may be queued on.
+    template<typename T>
+    auto get(std::future<T>& future) -> T {
+        const auto self = currentWorker().value_or(0);
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            Task task;
+            if (not tryPop(self, task)) {
+                // Everything left is already running on some thread.
+                break;
+            }
+            this->pending.fetch_sub(1, std::memory_order_relaxed);
+            task();
+        }
+        return future.get();
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t {
+        return this->workers.size();
+    }
+
+    // Index of the calling thread within the pool running it, if any.
+    [[nodiscard]] auto currentWorker() const -> std::optional<std::size_t> {
+        if (currentPool == this) {
+            return currentIndex;
+        }
+        return std::nullopt;
+    }
+
+private:
+    auto push(Task task) -> void {
+        const auto self = currentWorker();
+        const auto index = self.value_or(this->nextQueue.fetch_add(1, std::memory_order_relaxed) % this->queues.size());
+
+        // Counted before it is visible, so a thief's decrement never
+        // overtakes this increment.
+        this->pending.fetch_add(1);
+        {
+            auto& queue = *this->queues[index];
+            std::lock_guard lock { queue.mutex };
+            queue.tasks.push_back(std::move(task));
+        }
+
+        // A worker registers as a sleeper before it checks `pending`, and
+        // this reads `sleepers` after incrementing `pending`, so either the
+        // worker sees the task or this sees the worker. The lock orders the
+        // notification after the worker has started waiting.
+        if (this->sleepers.load() > 0) {
+            {
+                std::lock_guard lock { this->sleepMutex };
+            }
+            this->wake.notify_one();
+        }
+    }
+
+    [[nodiscard]] auto tryPop(const std::size_t self, Task& task) -> bool {
+        {
+            auto& own = *this->queues[self];
+            std::lock_guard lock { own.mutex };
+            if (not own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < this->queues.size(); ++i) {
+            auto& victim = *this->queues[(self + i) % this->queues.size()];
+            std::lock_guard lock { victim.mutex };
+            if (not victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    auto workerLoop(const std::size_t self) -> void {
+        currentPool = this;
+        currentIndex = self;
+
+        while (true) {
+            Task task;
+            if (tryPop(self, task)) {
+                this->pending.fetch_sub(1, std::memory_order_relaxed);
+                task();
+                continue;
+            }
+
+            std::unique_lock lock { this->sleepMutex };
+            this->sleepers.fetch_add(1);
+            this->wake.wait(lock, [this] { return this->stopping || this->pending.load() > 0; });
+            this->sleepers.fetch_sub(1);
+            if (this->stopping && this->pending.load() == 0) {
+                return;
+            }
+        }
+    }
+
+private:
+    static inline thread_local const ThreadPool* currentPool { nullptr };
+    static inline thread_local std::size_t currentIndex { 0 };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> nextQueue { 0 };
+
+    // Tasks pushed but not yet popped. It and `sleepers` use sequentially
+    // consistent operations, which the wake-up protocol in push() relies on.
+    std::atomic<std::size_t> pending { 0 };
+    // Workers waiting, or about to wait, on `wake`.
+    std::atomic<std::size_t> sleepers { 0 };
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping { false };
+};
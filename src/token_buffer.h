@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "token.h"
+
+// Two-character operators whose second character the lexer consumes without
+// advancing its column, see TokenBuffer::position().
+[[nodiscard]] constexpr auto isJoinedToken(const TokenType ttype) -> bool {
+    return ttype == TokenType::EqualEqual || ttype == TokenType::BangEqual || ttype == TokenType::Assign;
+}
+
+// ============================================================================
+// Tokens of one source as parallel arrays: 9 bytes per token instead of a
+// 32-byte Token. Lexemes are stored as offsets into the source and positions
+// are not stored at all; they are recomputed on demand from the table of
+// line starts the lexer records in the same pass.
+// ============================================================================
+class TokenBuffer {
+public:
+    using Offset = std::uint32_t;
+
+    explicit TokenBuffer(const std::string_view source) : source { source } {
+        assert(source.size() <= std::numeric_limits<Offset>::max() && "source too large for 32-bit token offsets");
+    }
+
+    auto push(const TokenType ttype, const std::size_t offset, const std::size_t length) -> void {
+        this->types.push_back(static_cast<std::uint8_t>(ttype));
+        this->offsets.push_back(static_cast<Offset>(offset));
+        this->lengths.push_back(static_cast<Offset>(length));
+    }
+
+    // Records that a line starts at `offset`, just past a '\n'.
+    auto newLine(const std::size_t offset) -> void {
+        this->lineStarts.push_back(static_cast<Offset>(offset));
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t {
+        return this->types.size();
+    }
+
+    [[nodiscard]] auto type(const std::size_t i) const -> TokenType {
+        return static_cast<TokenType>(this->types[i]);
+    }
+
+    [[nodiscard]] auto offset(const std::size_t i) const -> Offset {
+        return this->offsets[i];
+    }
+
+    [[nodiscard]] auto lexeme(const std::size_t i) const -> std::string_view {
+        return this->source.substr(this->offsets[i], this->lengths[i]);
+    }
+
+    // Index of the line (0 based) holding `offset`.
+    [[nodiscard]] auto lineOf(const Offset offset) const -> std::size_t {
+        return static_cast<std::size_t>(std::upper_bound(this->lineStarts.begin(), this->lineStarts.end(), offset) - this->lineStarts.begin()) - 1;
+    }
+
+    [[nodiscard]] auto lineStart(const std::size_t line) const -> Offset {
+        return this->lineStarts[line];
+    }
+
+    // The position Lexer::next() reports for token i: the line, and the
+    // column of the token's last character counted the way the lexer counts
+    // it, which skips the second character of joined operators and starts
+    // lines after the first at 1.
+    [[nodiscard]] auto position(const std::size_t i) const -> TokenPosition {
+        const auto line = lineOf(this->offsets[i]);
+        const auto start = this->lineStarts[line];
+        const auto first = static_cast<std::size_t>(std::lower_bound(this->offsets.begin(), this->offsets.begin() + i, start) - this->offsets.begin());
+
+        std::size_t joined { 0 };
+        for (auto j = first; j <= i; ++j) {
+            joined += isJoinedToken(type(j));
+        }
+        return column(line, i, joined);
+    }
+
+    // Position of token i given the number of joined operators up to and
+    // including it on its line, for callers that walk the tokens in order.
+    [[nodiscard]] auto column(const std::size_t line, const std::size_t i, const std::size_t joined) const -> TokenPosition {
+        const auto end = this->offsets[i] + this->lengths[i];
+        return {
+            .line = static_cast<unsigned int>(line + 1),
+            .column = static_cast<unsigned int>(end - this->lineStarts[line] - joined + (line > 0 ? 1 : 0)),
+        };
+    }
+
+    [[nodiscard]] auto token(const std::size_t i) const -> Token {
+        return {
+            .ttype = type(i),
+            .lexeme = lexeme(i),
+            .position = position(i),
+        };
+    }
+
+    [[nodiscard]] auto lineCount() const -> std::size_t {
+        return this->lineStarts.size();
+    }
+
+    // Bytes of token storage in use, line table excluded.
+    [[nodiscard]] auto bytes() const -> std::size_t {
+        return size() * (sizeof(std::uint8_t) + 2 * sizeof(Offset));
+    }
+
+private:
+    std::string_view source;
+    std::vector<std::uint8_t> types;
+    std::vector<Offset> offsets;
+    std::vector<Offset> lengths;
+    // Offset of the first character of every line; line 1 starts at 0.
+    std::vector<Offset> lineStarts { 0 };
+};
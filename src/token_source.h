@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <span>
+
+#include "lexer.h"
+#include "token.h"
+#include "token_buffer.h"
+
+// ============================================================================
+// Token sources the Parser reads from. All expose the current token (and a
+// few behind it) through peek(), the last consumed one through previous(),
+// and move on with advance(). Neither advances past Eof.
+// ============================================================================
+
+// Tokens lexed up front into one list.
+class TokenSpan {
+public:
+    TokenSpan(const std::span<Token> tokens) : tokens { tokens } {
+        assert(not tokens.empty() && tokens.back().ttype == TokenType::Eof);
+    }
+
+    [[nodiscard]] auto peek(const std::size_t ahead = 0) const -> const Token& {
+        return this->tokens[std::min(this->current + ahead, this->tokens.size() - 1)];
+    }
+
+    [[nodiscard]] auto previous() const -> const Token& {
+        return this->tokens[this->current - 1];
+    }
+
+    auto advance() -> void {
+        this->current++;
+    }
+
+private:
+    std::span<Token> tokens;
+    std::size_t current { 0 };
+};
+
+// Tokens pulled from the lexer as the parser needs them. Only the previous
+// token and `Lookahead` upcoming ones are held, in a ring buffer, so memory
+// does not grow with the input.
+template<std::size_t Lookahead = 1>
+class TokenStream {
+    static_assert(Lookahead >= 1);
+    static constexpr std::size_t capacity = std::bit_ceil(Lookahead + 1);
+    static constexpr std::size_t mask = capacity - 1;
+
+public:
+    explicit TokenStream(Lexer& lexer) : lexer { &lexer } {
+        for (std::size_t i = 0; i < Lookahead; ++i) {
+            this->ring[i] = lexer.next();
+        }
+    }
+
+    [[nodiscard]] auto peek(const std::size_t ahead = 0) const -> const Token& {
+        assert(ahead < Lookahead);
+        return this->ring[(this->head + ahead) & mask];
+    }
+
+    [[nodiscard]] auto previous() const -> const Token& {
+        return this->ring[(this->head + capacity - 1) & mask];
+    }
+
+    // Refills the slot of the token that stops being previous().
+    auto advance() -> void {
+        this->ring[(this->head + Lookahead) & mask] = this->lexer->next();
+        this->head = (this->head + 1) & mask;
+    }
+
+private:
+    Lexer* lexer;
+    std::array<Token, capacity> ring {};
+    std::size_t head { 0 };
+};
+
+// Tokens read from a TokenBuffer. Advancing only moves an index; a token's
+// position is computed when the token is read. Reads mostly go forward, so a
+// cursor remembers the line and the joined operators seen on it, and catches
+// up in constant amortized time instead of searching the line table.
+class TokenBufferView {
+public:
+    TokenBufferView(const TokenBuffer& buffer) : buffer { &buffer } {
+        assert(buffer.size() > 0 && buffer.type(buffer.size() - 1) == TokenType::Eof);
+    }
+
+    [[nodiscard]] auto peek(const std::size_t ahead = 0) const -> Token {
+        return materialize(std::min(this->index + ahead, this->buffer->size() - 1));
+    }
+
+    [[nodiscard]] auto previous() const -> Token {
+        if (this->index == 0) {
+            return {};
+        }
+        return materialize(this->index - 1);
+    }
+
+    auto advance() -> void {
+        if (this->index + 1 < this->buffer->size()) {
+            this->index++;
+        }
+    }
+
+private:
+    auto materialize(const std::size_t i) const -> Token {
+        return {
+            .ttype = this->buffer->type(i),
+            .lexeme = this->buffer->lexeme(i),
+            .position = position(i),
+        };
+    }
+
+    auto position(const std::size_t i) const -> TokenPosition {
+        if (i < this->cursor.next) {
+            if (i + 1 == this->cursor.next) {
+                return this->buffer->column(this->cursor.line, i, this->cursor.joined);
+            }
+            return this->buffer->position(i);
+        }
+        for (; this->cursor.next <= i; this->cursor.next++) {
+            const auto offset = this->buffer->offset(this->cursor.next);
+            while (this->cursor.line + 1 < this->buffer->lineCount() && this->buffer->lineStart(this->cursor.line + 1) <= offset) {
+                this->cursor.line++;
+                this->cursor.joined = 0;
+            }
+            this->cursor.joined += isJoinedToken(this->buffer->type(this->cursor.next));
+        }
+        return this->buffer->column(this->cursor.line, i, this->cursor.joined);
+    }
+
+    const TokenBuffer* buffer;
+    std::size_t index { 0 };
+    // Line of the last token the cursor passed and the joined operators on
+    // it up to and including that token.
+    mutable struct {
+        std::size_t next { 0 };
+        std::size_t line { 0 };
+        std::size_t joined { 0 };
+    } cursor;
+};
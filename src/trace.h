@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+// Tracing is compiled in unless NDEBUG is set; -DACOMPILER_TRACE=0/1
+// overrides that either way.
+#ifndef ACOMPILER_TRACE
+#ifdef NDEBUG
+#define ACOMPILER_TRACE 0
+#else
+#define ACOMPILER_TRACE 1
+#endif
+#endif
+
+namespace Trace {
+    using namespace std::string_view_literals;
+
+    enum class Category : unsigned int {
+        Lexer,
+        Parser,
+        Generator,
+        VM,
+    };
+
+    constexpr std::array categoryNames = {
+        "lexer"sv,
+        "parser"sv,
+        "gen"sv,
+        "vm"sv,
+    };
+
+    // One bit per Category; everything starts disabled.
+    inline std::atomic<unsigned int> enabledCategories { 0 };
+
+    [[nodiscard]] inline auto enabled(const Category category) -> bool {
+        return (enabledCategories.load(std::memory_order_relaxed) >> static_cast<unsigned int>(category)) & 1;
+    }
+
+    inline auto enable(const Category category) -> void {
+        enabledCategories.fetch_or(1u << static_cast<unsigned int>(category), std::memory_order_relaxed);
+    }
+
+    // Enables every category in a comma separated list such as "lexer,vm"
+    // ("all" enables everything). Returns false on an unknown name.
+    [[nodiscard]] inline auto enable(std::string_view list) -> bool {
+        while (not list.empty()) {
+            const auto comma = list.find(',');
+            const auto name = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view {} : list.substr(comma + 1);
+
+            if (name == "all") {
+                enabledCategories.store((1u << categoryNames.size()) - 1, std::memory_order_relaxed);
+                continue;
+            }
+
+            bool found { false };
+            for (unsigned int i = 0; i < categoryNames.size(); ++i) {
+                if (categoryNames[i] == name) {
+                    enable(static_cast<Category>(i));
+                    found = true;
+                }
+            }
+            if (not found) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Trace output goes to stderr so it never mixes with program output.
+    [[nodiscard]] inline auto logger() -> spdlog::logger& {
+        static auto instance = [] {
+            auto sink = std::make_shared<spdlog::sinks::stderr_sink_mt>();
+            auto created = std::make_shared<spdlog::logger>("trace", std::move(sink));
+            created->set_pattern("[%n:%v]");
+            return created;
+        }();
+        return *instance;
+    }
+}
+
+// Hot-path logging. The arguments are only evaluated when the category is
+// enabled, and the whole statement disappears when ACOMPILER_TRACE is 0.
+#if ACOMPILER_TRACE
+#define TRACE(category, ...)                                             \
+    do {                                                                 \
+        if (Trace::enabled(Trace::Category::category)) [[unlikely]] {    \
+            Trace::logger().info(__VA_ARGS__);                           \
+        }                                                                \
+    } while (false)
+#else
+#define TRACE(category, ...) \
+    do {                     \
+    } while (false)
+#endif
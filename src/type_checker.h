@@ -0,0 +1,196 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <fmt/core.h>
+
+#include "expression.h"
+#include "statement.h"
+#include "trace.h"
+
+// ============================================================================
+// AST pass run between the AstOptimizer and the BytecodeGenerator. It
+// annotates every expression with the type of its value, so the generator
+// can emit the opcodes specialized for ints or doubles, and reports what the
+// VM would otherwise only trip over at run time: mixing ints and doubles,
+// arithmetic on bools, comparing bools, and conditions that are not bools.
+//
+// Variables are typed by the assignments that reach each read, the same
+// way the generator tracks whether they are defined. A variable assigned
+// values of different types on the two paths of an if, or one the caller
+// sets (an input), is Unknown: operations on it keep the generic opcodes,
+// which check the types when they run.
+// ============================================================================
+class TypeChecker : Expressions::ExpressionVisitor, Statements::StatementVisitor {
+    using StaticType = Expressions::StaticType;
+    using Environment = std::unordered_map<std::string_view, StaticType>;
+
+public:
+    auto run(std::vector<std::unique_ptr<Statements::Statement>>& statements) -> void {
+        TRACE(Parser, "=== Type checking ===");
+        this->variables.clear();
+        for (auto& statement : statements) {
+            statement->accept(*this);
+        }
+    }
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return not this->errors.empty();
+    }
+
+    [[nodiscard]] auto getErrors() const -> const std::vector<std::string>& {
+        return this->errors;
+    }
+
+private:
+    auto check(Expressions::Expression& expression) -> StaticType {
+        expression.accept(*this);
+        return expression.type;
+    }
+
+    auto error(const Token& token, const std::string& message) -> void {
+        this->errors.push_back(fmt::format("[line {}] Error at '{}': {}", token.position.line, token.getLexeme(), message));
+    }
+
+    // Type both operands of a binary operator share, Unknown if only run
+    // time can tell. When one side is Unknown, the other one's type is the
+    // only one that can run.
+    auto operands(const Token& op, const StaticType lhs, const StaticType rhs) -> StaticType {
+        if (lhs == StaticType::Bool || rhs == StaticType::Bool) {
+            error(op, "Operands must be numbers.");
+            return StaticType::Unknown;
+        }
+        if (lhs != StaticType::Unknown && rhs != StaticType::Unknown && lhs != rhs) {
+            error(op, "Operands must be two ints or two doubles.");
+            return StaticType::Unknown;
+        }
+        return lhs != StaticType::Unknown ? lhs : rhs;
+    }
+
+    // ------------------------------------------------------------------------
+    // Statements
+    // ------------------------------------------------------------------------
+    auto visit(Statements::ExpressionStatement& statement) -> void override {
+        std::ignore = check(*statement.expression);
+    }
+
+    auto visit(Statements::Print& statement) -> void override {
+        std::ignore = check(*statement.expression);
+    }
+
+    auto visit(Statements::IfStatement& statement) -> void override {
+        const auto condition = check(*statement.condition);
+        if (condition != StaticType::Unknown && condition != StaticType::Bool) {
+            if (const auto* token = tokenOf(*statement.condition)) {
+                error(*token, "Condition must be a bool.");
+            } else {
+                this->errors.push_back("Error: Condition must be a bool.");
+            }
+        }
+
+        const auto before = this->variables;
+        if (statement.then != nullptr) {
+            statement.then->accept(*this);
+        }
+        auto afterThen = std::move(this->variables);
+
+        this->variables = before;
+        if (statement.otherwise != nullptr) {
+            statement.otherwise->accept(*this);
+        }
+
+        // A variable assigned on one path only is either undefined after the
+        // if, and the generator reports reading it, or an input the other
+        // path left alone, whose type only run time knows.
+        for (const auto& [name, type] : afterThen) {
+            const auto [found, inserted] = this->variables.emplace(name, StaticType::Unknown);
+            if (not inserted && found->second != type) {
+                found->second = StaticType::Unknown;
+            }
+        }
+        for (auto& [name, type] : this->variables) {
+            if (not afterThen.contains(name)) {
+                type = StaticType::Unknown;
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Expressions
+    // ------------------------------------------------------------------------
+    auto visit(Expressions::BinaryOperator& expression) -> void override {
+        const auto lhs = check(*expression.lhs);
+        const auto rhs = check(*expression.rhs);
+        expression.type = operands(expression.operator_type, lhs, rhs);
+    }
+
+    auto visit(Expressions::Logical& expression) -> void override {
+        const auto lhs = check(*expression.lhs);
+        const auto rhs = check(*expression.rhs);
+        std::ignore = operands(expression.operator_type, lhs, rhs);
+        expression.type = StaticType::Bool;
+    }
+
+    auto visit(Expressions::Unary& expression) -> void override {
+        const auto operand = check(*expression.operand);
+        if (expression.operator_type.ttype == TokenType::Bang) {
+            if (operand != StaticType::Unknown && operand != StaticType::Bool) {
+                error(expression.operator_type, "Operand must be a bool.");
+            }
+            expression.type = StaticType::Bool;
+            return;
+        }
+        if (operand == StaticType::Bool) {
+            error(expression.operator_type, "Operand must be a number.");
+            return;
+        }
+        expression.type = operand;
+    }
+
+    auto visit(Expressions::Variable& expression) -> void override {
+        const auto found = this->variables.find(expression.name.getLexeme());
+        expression.type = found != this->variables.end() ? found->second : StaticType::Unknown;
+    }
+
+    auto visit(Expressions::Assign& expression) -> void override {
+        expression.type = check(*expression.value);
+        this->variables[expression.name.getLexeme()] = expression.type;
+    }
+
+    auto visit(Expressions::INumber& expression) -> void override {
+        expression.type = StaticType::Int;
+    }
+
+    auto visit(Expressions::DNumber& expression) -> void override {
+        expression.type = StaticType::Double;
+    }
+
+    auto visit(Expressions::Boolean& expression) -> void override {
+        expression.type = StaticType::Bool;
+    }
+
+    // A token to point an error about `expression` at, if it has one.
+    [[nodiscard]] static auto tokenOf(const Expressions::Expression& expression) -> const Token* {
+        if (const auto* binary = dynamic_cast<const Expressions::BinaryOperator*>(&expression)) {
+            return &binary->operator_type;
+        }
+        if (const auto* unary = dynamic_cast<const Expressions::Unary*>(&expression)) {
+            return &unary->operator_type;
+        }
+        if (const auto* variable = dynamic_cast<const Expressions::Variable*>(&expression)) {
+            return &variable->name;
+        }
+        if (const auto* assign = dynamic_cast<const Expressions::Assign*>(&expression)) {
+            return &assign->name;
+        }
+        return nullptr;
+    }
+
+private:
+    // Per variable: the type of the value it holds at this point.
+    Environment variables;
+    std::vector<std::string> errors;
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <fmt/core.h>
+
+#ifndef ACOMPILER_NAN_BOXING
+#define ACOMPILER_NAN_BOXING 0
+#endif
+
+using INumber = int;
+using DNumber = double;
+using Bool = bool;
+
+namespace Values {
+
+    // ============================================================================
+    // Tagged union on top of std::variant. Portable, 16 bytes per value.
+    // ============================================================================
+    class Variant {
+    public:
+        constexpr Variant() = default;
+        constexpr Variant(const Bool value) : data { value } {}
+        constexpr Variant(const INumber value) : data { value } {}
+        constexpr Variant(const DNumber value) : data { value } {}
+
+        [[nodiscard]] constexpr auto isBool() const -> bool { return std::holds_alternative<Bool>(data); }
+        [[nodiscard]] constexpr auto isInt() const -> bool { return std::holds_alternative<INumber>(data); }
+        [[nodiscard]] constexpr auto isDouble() const -> bool { return std::holds_alternative<DNumber>(data); }
+
+        [[nodiscard]] constexpr auto asBool() const -> Bool { return *std::get_if<Bool>(&data); }
+        [[nodiscard]] constexpr auto asInt() const -> INumber { return *std::get_if<INumber>(&data); }
+        [[nodiscard]] constexpr auto asDouble() const -> DNumber { return *std::get_if<DNumber>(&data); }
+
+        [[nodiscard]] static constexpr auto bothInts(const Variant& a, const Variant& b) -> bool {
+            return a.isInt() && b.isInt();
+        }
+
+        [[nodiscard]] static constexpr auto bothDoubles(const Variant& a, const Variant& b) -> bool {
+            return a.isDouble() && b.isDouble();
+        }
+
+        template<typename F>
+        constexpr auto visit(F&& f) const {
+            return std::visit(std::forward<F>(f), data);
+        }
+
+    private:
+        std::variant<Bool, INumber, DNumber> data;
+    };
+
+    // ============================================================================
+    // NaN-boxed value, 8 bytes. Doubles are stored as themselves; every NaN is
+    // canonicalized to a positive quiet NaN, which frees the negative quiet NaN
+    // space for the other types:
+    //
+    //   1111 1111 1111 1001  0...0  <32-bit int>     int
+    //   1111 1111 1111 1010  0...0  <0 or 1>         bool
+    //
+    // so a type test is one mask and compare on the top 16 bits.
+    // ============================================================================
+    class Boxed {
+        static constexpr std::uint64_t canonicalNaN = 0x7ff8'0000'0000'0000;
+        static constexpr std::uint64_t tagMask      = 0xffff'0000'0000'0000;
+        static constexpr std::uint64_t boxedSpace   = 0xfff8'0000'0000'0000;
+        static constexpr std::uint64_t intTag       = 0xfff9'0000'0000'0000;
+        static constexpr std::uint64_t boolTag      = 0xfffa'0000'0000'0000;
+
+    public:
+        constexpr Boxed() : bits { boolTag } {}
+        constexpr Boxed(const Bool value) : bits { boolTag | static_cast<std::uint64_t>(value) } {}
+        constexpr Boxed(const INumber value) : bits { intTag | static_cast<std::uint32_t>(value) } {}
+        constexpr Boxed(const DNumber value) : bits { value != value ? canonicalNaN : std::bit_cast<std::uint64_t>(value) } {}
+
+        [[nodiscard]] constexpr auto isBool() const -> bool { return (bits & tagMask) == boolTag; }
+        [[nodiscard]] constexpr auto isInt() const -> bool { return (bits & tagMask) == intTag; }
+        [[nodiscard]] constexpr auto isDouble() const -> bool { return (bits & boxedSpace) != boxedSpace; }
+
+        [[nodiscard]] constexpr auto asBool() const -> Bool { return (bits & 1) != 0; }
+        [[nodiscard]] constexpr auto asInt() const -> INumber { return static_cast<INumber>(static_cast<std::uint32_t>(bits)); }
+        [[nodiscard]] constexpr auto asDouble() const -> DNumber { return std::bit_cast<DNumber>(bits); }
+
+        // Both checks fold the two tags together so the hot path tests once.
+        [[nodiscard]] static constexpr auto bothInts(const Boxed& a, const Boxed& b) -> bool {
+            return (((a.bits ^ intTag) | (b.bits ^ intTag)) & tagMask) == 0;
+        }
+
+        [[nodiscard]] static constexpr auto bothDoubles(const Boxed& a, const Boxed& b) -> bool {
+            return ((a.bits & boxedSpace) != boxedSpace) & ((b.bits & boxedSpace) != boxedSpace);
+        }
+
+        template<typename F>
+        constexpr auto visit(F&& f) const {
+            if (isInt()) {
+                return std::forward<F>(f)(asInt());
+            }
+            if (isBool()) {
+                return std::forward<F>(f)(asBool());
+            }
+            return std::forward<F>(f)(asDouble());
+        }
+
+        [[nodiscard]] constexpr auto raw() const -> std::uint64_t { return bits; }
+
+    private:
+        std::uint64_t bits;
+    };
+
+    static_assert(sizeof(Boxed) == 8);
+}
+
+#if ACOMPILER_NAN_BOXING
+using Value = Values::Boxed;
+#else
+using Value = Values::Variant;
+#endif
+
+struct PrintVisitor {
+    std::string operator()(Bool b) { return b ? "true" : "false"; }
+    // This matches every other type than std::monostate.
+    std::string operator()(const auto& x) { return fmt::format("{}", x); }
+};
@@ -0,0 +1,380 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <fmt/core.h>
+
+#include "chunk.h"
+#include "expression.h"
+
+namespace ByteCode {
+
+    // What the verifier knows about a slot: its type, or Unset if some path
+    // reaches this point without storing to it. Unknown is a value the caller
+    // sets, such as an input, or one of different types on different paths.
+    using SlotType = std::optional<Expressions::StaticType>;
+    inline constexpr SlotType Unset {};
+
+    // Propagates the type of every stack entry and slot through a chunk whose
+    // structure verify() has already checked. Opcodes that look at the tags
+    // accept Unknown values, as they do for inputs, but no value proven to
+    // have the wrong type; the I and D forms, which never look at the tags,
+    // need their operands proven. As in the TypeChecker, a generic operator
+    // with one Unknown operand yields the other operand's type, the only one
+    // it can run with. Slots other than the inputs start Unset and may not be
+    // read until every path has stored to them. States are only kept where
+    // jumps land.
+    [[nodiscard]] inline auto verifyTypes(const Chunk& chunk) -> std::optional<std::string> {
+        using enum Expressions::StaticType;
+        using Expressions::StaticType;
+        struct State {
+            std::vector<StaticType> stack;
+            std::vector<SlotType> slots;
+        };
+
+        const auto& code = chunk.code;
+        const auto targetOf = [&](const std::size_t offset) {
+            const auto next = offset + instructionLength(chunk.opAt(offset));
+            return static_cast<std::size_t>(static_cast<std::ptrdiff_t>(next) + chunk.readOperand<Offset>(offset + 1));
+        };
+
+        std::vector<bool> target(code.size(), false);
+        for (std::size_t offset = 0; offset < code.size(); offset += instructionLength(chunk.opAt(offset))) {
+            if (isJump(chunk.opAt(offset))) {
+                target[targetOf(offset)] = true;
+            }
+        }
+
+        std::vector<std::optional<State>> entry(code.size());
+        std::vector<std::size_t> worklist;
+        const auto merge = [&](const std::size_t at, const State& state) {
+            auto& into = entry[at];
+            if (not into.has_value()) {
+                into = state;
+                worklist.push_back(at);
+                return;
+            }
+            bool changed { false };
+            for (std::size_t i = 0; i < into->stack.size(); ++i) {
+                if (into->stack[i] != state.stack[i] && into->stack[i] != Unknown) {
+                    into->stack[i] = Unknown;
+                    changed = true;
+                }
+            }
+            for (std::size_t i = 0; i < into->slots.size(); ++i) {
+                auto& slot = into->slots[i];
+                if (slot != state.slots[i] && slot != Unset) {
+                    slot = state.slots[i] == Unset ? Unset : SlotType { Unknown };
+                    changed = true;
+                }
+            }
+            if (changed) {
+                worklist.push_back(at);
+            }
+        };
+        State start { {}, std::vector(chunk.slots.size(), Unset) };
+        std::fill_n(start.slots.begin(), chunk.inputs, SlotType { Unknown });
+        merge(0, start);
+
+        // Type of a generic operator's result, or nothing if no values of
+        // these types can be combined.
+        const auto numbers = [](const StaticType a, const StaticType b) -> std::optional<StaticType> {
+            if (a == Bool || b == Bool || (a != Unknown && b != Unknown && a != b)) {
+                return std::nullopt;
+            }
+            return a != Unknown ? a : b;
+        };
+
+        while (not worklist.empty()) {
+            auto state = *entry[worklist.back()];
+            auto offset = worklist.back();
+            worklist.pop_back();
+
+            auto& stack = state.stack;
+            const auto pop = [&] {
+                const auto type = stack.back();
+                stack.pop_back();
+                return type;
+            };
+            // The slot the Index operand at `at` names.
+            const auto read = [&](const std::size_t at) -> SlotType& {
+                return state.slots[chunk.readOperand<Index>(at)];
+            };
+
+            while (true) {
+                const auto op = chunk.opAt(offset);
+                const auto name = getOpCodeName(op);
+                const auto operand = offset + 1;
+
+                switch (op) {
+                case OpCode::Halt:
+                case OpCode::Jmp:
+                    break;
+                case OpCode::Print:
+                case OpCode::Pop:
+                    std::ignore = pop();
+                    break;
+                case OpCode::Dup:
+                    stack.push_back(stack.back());
+                    break;
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mul:
+                case OpCode::Div:
+                case OpCode::Eq:
+                case OpCode::NEq:
+                case OpCode::EqJz:
+                case OpCode::NEqJz: {
+                    const auto b = pop();
+                    const auto a = pop();
+                    const auto result = numbers(a, b);
+                    if (not result.has_value()) {
+                        return fmt::format("{:04}: {} on operands that are not two numbers of the same type", offset, name);
+                    }
+                    if (op == OpCode::Eq || op == OpCode::NEq) {
+                        stack.push_back(Bool);
+                    } else if (op != OpCode::EqJz && op != OpCode::NEqJz) {
+                        stack.push_back(*result);
+                    }
+                    break;
+                }
+                case OpCode::AddI:
+                case OpCode::SubI:
+                case OpCode::MulI:
+                case OpCode::DivI:
+                case OpCode::EqI:
+                case OpCode::NEqI:
+                case OpCode::AddD:
+                case OpCode::SubD:
+                case OpCode::MulD:
+                case OpCode::DivD:
+                case OpCode::EqD:
+                case OpCode::NEqD:
+                case OpCode::EqIJz:
+                case OpCode::NEqIJz: {
+                    const bool ints = op == OpCode::AddI || op == OpCode::SubI || op == OpCode::MulI || op == OpCode::DivI || op == OpCode::EqI || op == OpCode::NEqI
+                                   || op == OpCode::EqIJz || op == OpCode::NEqIJz;
+                    const auto type = ints ? Int : Double;
+                    const auto b = pop();
+                    const auto a = pop();
+                    if (a != type || b != type) {
+                        return fmt::format("{:04}: {} on operands not proven to be {}", offset, name, ints ? "ints" : "doubles");
+                    }
+                    const bool compares = op == OpCode::EqI || op == OpCode::NEqI || op == OpCode::EqD || op == OpCode::NEqD;
+                    if (op != OpCode::EqIJz && op != OpCode::NEqIJz) {
+                        stack.push_back(compares ? Bool : type);
+                    }
+                    break;
+                }
+                case OpCode::Neg:
+                case OpCode::Shl:
+                    if (stack.back() == Bool) {
+                        return fmt::format("{:04}: {} on a value that is not a number", offset, name);
+                    }
+                    break;
+                case OpCode::Not:
+                case OpCode::Jz: {
+                    const auto type = pop();
+                    if (type != Unknown && type != Bool) {
+                        return fmt::format("{:04}: {} on a value that is not a bool", offset, name);
+                    }
+                    if (op == OpCode::Not) {
+                        stack.push_back(Bool);
+                    }
+                    break;
+                }
+                case OpCode::PushInt:
+                    stack.push_back(Int);
+                    break;
+                case OpCode::PushDouble:
+                    stack.push_back(Double);
+                    break;
+                case OpCode::PushTrue:
+                case OpCode::PushFalse:
+                    stack.push_back(Bool);
+                    break;
+                case OpCode::StoreSlot:
+                    read(operand) = pop();
+                    break;
+                case OpCode::StoreKeep:
+                    read(operand) = stack.back();
+                    break;
+                case OpCode::LoadSlot:
+                case OpCode::LoadLoad: {
+                    const std::size_t count = op == OpCode::LoadLoad ? 2 : 1;
+                    for (std::size_t i = 0; i < count; ++i) {
+                        const auto slot = read(operand + i * sizeof(Index));
+                        if (slot == Unset) {
+                            return fmt::format("{:04}: {} of a slot that may not be set", offset, name);
+                        }
+                        stack.push_back(*slot);
+                    }
+                    break;
+                }
+                case OpCode::AddSlotInt: {
+                    auto& slot = read(operand);
+                    if (slot == Unset) {
+                        return fmt::format("{:04}: {} of a slot that may not be set", offset, name);
+                    }
+                    if (slot != Unknown && slot != Int) {
+                        return fmt::format("{:04}: {} on a slot that is not an int", offset, name);
+                    }
+                    slot = Int;
+                    break;
+                }
+                }
+
+                if (isJump(op)) {
+                    merge(targetOf(offset), state);
+                }
+                if (op == OpCode::Halt || op == OpCode::Jmp) {
+                    break;
+                }
+                offset += instructionLength(op);
+                if (target[offset]) {
+                    merge(offset, state);
+                    break;
+                }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // ============================================================================
+    // Load-time check that a chunk is safe to run with a stack of
+    // chunk.maxStack values and no further checks: every opcode and operand is
+    // in range, jumps land on instruction boundaries, execution cannot run off
+    // the end of the code, the stack depth at each instruction is the same
+    // on every path and stays within [0, maxStack], and no opcode can see a
+    // value of a type it does not handle (see verifyTypes()).
+    //
+    // Returns a description of the first problem found.
+    // ============================================================================
+    [[nodiscard]] inline auto verify(const Chunk& chunk) -> std::optional<std::string> {
+        const auto& code = chunk.code;
+
+        if (code.empty()) {
+            return "empty chunk";
+        }
+        if (chunk.inputs > chunk.slots.size()) {
+            return "more inputs than slots";
+        }
+
+        // Pass 1: decode linearly, checking opcodes and pool indices, and mark
+        // where instructions start.
+        std::vector<bool> boundary(code.size(), false);
+        for (std::size_t offset = 0; offset < code.size();) {
+            if (code[offset] >= opCodeCount) {
+                return fmt::format("{:04}: invalid opcode {}", offset, code[offset]);
+            }
+
+            const auto op = chunk.opAt(offset);
+            const auto length = instructionLength(op);
+            if (offset + length > code.size()) {
+                return fmt::format("{:04}: truncated {}", offset, getOpCodeName(op));
+            }
+
+            const auto operand = offset + 1;
+            switch (op) {
+            case OpCode::PushInt:
+                if (chunk.readOperand<Index>(operand) >= chunk.integers.size()) {
+                    return fmt::format("{:04}: integer constant out of range", offset);
+                }
+                break;
+            case OpCode::PushDouble:
+                if (chunk.readOperand<Index>(operand) >= chunk.doubles.size()) {
+                    return fmt::format("{:04}: double constant out of range", offset);
+                }
+                break;
+            case OpCode::StoreSlot:
+            case OpCode::LoadSlot:
+            case OpCode::StoreKeep:
+                if (chunk.readOperand<Index>(operand) >= chunk.slots.size()) {
+                    return fmt::format("{:04}: slot out of range", offset);
+                }
+                break;
+            case OpCode::AddSlotInt:
+                if (chunk.readOperand<Index>(operand) >= chunk.slots.size()) {
+                    return fmt::format("{:04}: slot out of range", offset);
+                }
+                if (chunk.readOperand<Index>(operand + sizeof(Index)) >= chunk.integers.size()) {
+                    return fmt::format("{:04}: integer constant out of range", offset);
+                }
+                break;
+            case OpCode::LoadLoad:
+                if (chunk.readOperand<Index>(operand) >= chunk.slots.size() || chunk.readOperand<Index>(operand + sizeof(Index)) >= chunk.slots.size()) {
+                    return fmt::format("{:04}: slot out of range", offset);
+                }
+                break;
+            case OpCode::Shl:
+                if (chunk.readOperand<Index>(operand) >= 32) {
+                    return fmt::format("{:04}: shift count out of range", offset);
+                }
+                break;
+            default:
+                break;
+            }
+
+            boundary[offset] = true;
+            offset += length;
+        }
+
+        // Pass 2: propagate stack depths along every edge.
+        constexpr auto unknown = std::numeric_limits<std::size_t>::max();
+        std::vector<std::size_t> depth(code.size(), unknown);
+        std::vector<std::size_t> worklist { 0 };
+        depth[0] = 0;
+
+        const auto flowTo = [&](const std::size_t from, const std::ptrdiff_t target, const std::size_t d) -> std::optional<std::string> {
+            if (target < 0 || static_cast<std::size_t>(target) >= code.size() || not boundary[target]) {
+                return fmt::format("{:04}: control flow leaves the code or enters an instruction", from);
+            }
+            if (depth[target] == unknown) {
+                depth[target] = d;
+                worklist.push_back(target);
+            } else if (depth[target] != d) {
+                return fmt::format("{:04}: stack depth {} disagrees with {} on another path", target, d, depth[target]);
+            }
+            return std::nullopt;
+        };
+
+        while (not worklist.empty()) {
+            const auto offset = worklist.back();
+            worklist.pop_back();
+
+            const auto op = chunk.opAt(offset);
+            const auto pops = stackPops[static_cast<Type>(op)];
+            const auto pushes = stackPushes[static_cast<Type>(op)];
+
+            if (depth[offset] < pops) {
+                return fmt::format("{:04}: {} underflows the stack", offset, getOpCodeName(op));
+            }
+            const auto after = depth[offset] - pops + pushes;
+            if (after > chunk.maxStack) {
+                return fmt::format("{:04}: {} exceeds the maximum stack depth {}", offset, getOpCodeName(op), chunk.maxStack);
+            }
+
+            const auto next = static_cast<std::ptrdiff_t>(offset + instructionLength(op));
+
+            if (isJump(op)) {
+                const auto target = next + chunk.readOperand<Offset>(offset + 1);
+                if (auto error = flowTo(offset, target, after)) {
+                    return error;
+                }
+            }
+
+            if (op != OpCode::Halt && op != OpCode::Jmp) {
+                if (auto error = flowTo(offset, next, after)) {
+                    return error;
+                }
+            }
+        }
+
+        // Pass 3: types, on code now known to be well formed.
+        return verifyTypes(chunk);
+    }
+}
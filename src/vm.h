@@ -1,20 +1,134 @@
 #pragma once
 
 #include "gen.h"
+#include "profile.h"
+#include "trace.h"
+#include "value.h"
+#include "verifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <optional>
+#include <span>
 #include <type_traits>
-#include <variant>
 
-using INumber = int;
-using DNumber = double;
-using Bool = bool;
-using Value = std::variant<Bool, INumber, DNumber>;
+#ifndef ACOMPILER_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define ACOMPILER_COMPUTED_GOTO 1
+#else
+#define ACOMPILER_COMPUTED_GOTO 0
+#endif
+#endif
 
-struct PrintVisitor {
-    std::string operator()(Bool b) { return b ? "true" : "false"; }
-    // This matches every other type than std::monostate. 
-    std::string operator()(const auto& x) { return fmt::format("{}", x); }
+// ============================================================================
+// Everything a single run of a program mutates. A context is sized for one
+// chunk and can be reused for any number of runs of it, but must not be used
+// by two runs at the same time.
+// ============================================================================
+class ExecutionContext {
+    friend class VirtualMachine;
+    friend class JitMachine;
+
+public:
+    explicit ExecutionContext(const ByteCode::Chunk& chunk, std::ostream& out = std::cout)
+        : stack(chunk.maxStack), variables(chunk.slots.size()), out { &out } {}
+
+    // Resizes the context for another chunk, reusing its storage.
+    auto bind(const ByteCode::Chunk& chunk) -> void {
+        this->stack.resize(chunk.maxStack);
+        this->variables.resize(chunk.slots.size());
+    }
+
+    // Whether the stack and slots are large enough to run `chunk`.
+    [[nodiscard]] auto fits(const ByteCode::Chunk& chunk) const -> bool {
+        return this->stack.size() >= chunk.maxStack && this->variables.size() >= chunk.slots.size();
+    }
+
+    auto setSlot(const ByteCode::Index slot, const Value value) -> void {
+        assert(slot < this->variables.size());
+        this->variables[slot] = value;
+    }
+
+    [[nodiscard]] auto getSlot(const ByteCode::Index slot) const -> const Value& {
+        assert(slot < this->variables.size());
+        return this->variables[slot];
+    }
+
+    [[nodiscard]] auto getSlots() const -> std::span<const Value> {
+        return this->variables;
+    }
+
+    [[nodiscard]] auto getOutput() const -> std::ostream& {
+        return *this->out;
+    }
+
+    auto setOutput(std::ostream& out) -> void {
+        this->out = &out;
+    }
+
+    // The run-time error that stopped the last run, if any.
+    [[nodiscard]] auto getError() const -> const std::optional<std::string>& {
+        return this->error;
+    }
+
+private:
+    // Slots are not cleared between runs: inputs keep what the caller set,
+    // and the generator guarantees every other slot is written before it is
+    // read.
+    auto reset(const ByteCode::Chunk& chunk) -> void {
+        this->ip = chunk.code.data();
+        this->sp = this->stack.data();
+        this->error.reset();
+    }
+
+    // Stops the run at the next dispatch, which reads a Halt instead of the
+    // next instruction, so the loops need no check of their own. Inputs
+    // such as a bool `x` in `x + 1` reach handlers the verifier could not
+    // prove them safe for.
+    auto fail(std::string message) -> void {
+        static constexpr auto halt = static_cast<ByteCode::Type>(ByteCode::OpCode::Halt);
+        this->error = std::move(message);
+        this->ip = &halt;
+    }
+
+    // Prints the error that stopped the last run, if any. Returns whether
+    // the run completed.
+    [[nodiscard]] auto succeeded() const -> bool {
+        if (this->error.has_value()) {
+            fmt::print(stderr, "Runtime error: {}\n", *this->error);
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    auto readConstant(void) -> T {
+        T value;
+        std::memcpy(&value, this->ip, sizeof(T));
+        std::advance(this->ip, sizeof(T));
+        return value;
+    }
+
+    auto push(const Value value) -> void {
+        *this->sp++ = value;
+    }
+
+    [[nodiscard]] auto pop() -> Value {
+        return *--this->sp;
+    }
+
+    [[nodiscard]] auto top() const -> const Value& {
+        return this->sp[-1];
+    }
+
+    const ByteCode::Type* ip { nullptr };
+    std::vector<Value> stack;
+    Value* sp { nullptr };
+    std::vector<Value> variables;
+    std::ostream* out;
+    std::optional<std::string> error;
 };
 
 class VirtualMachine {
@@ -37,189 +151,400 @@ class VirtualMachine {
 
 
 public:
-    VirtualMachine(std::span<std::unique_ptr<ByteCode::Instruction>> bytecode) : bytecode { std::move(bytecode) } { ip = std::begin(bytecode); }
+    // Switch is the portable loop, Threaded jumps straight from one handler
+    // to the next through a table of label addresses (GCC/Clang only).
+    enum class Dispatch {
+        Switch,
+        Threaded,
+    };
 
-    template<typename T>
-    auto readConstant(void) -> T {
-        T value;
-        assert(std::distance(ip, std::end(this->bytecode)) >= sizeof(T));
-        std::memcpy(&value, &(*ip), sizeof(T));
-        std::advance(ip, sizeof(T));
-        return value;
+    static constexpr auto defaultDispatch = ACOMPILER_COMPUTED_GOTO ? Dispatch::Threaded : Dispatch::Switch;
+
+    // The chunk is verified once here and never modified; runs then trust it,
+    // so their operand stack is allocated at its final size and never
+    // bounds-checked. One VirtualMachine can serve any number of contexts,
+    // from any number of threads.
+    VirtualMachine(const ByteCode::Chunk& chunk) : chunk { chunk }, error { ByteCode::verify(chunk) } {}
+
+    [[nodiscard]] auto hadError() const -> bool {
+        return this->error.has_value();
     }
 
-    auto doBinaryOperation(BinaryOperators op) -> void {
-        auto b = stack.back();
-        stack.pop_back();
+    [[nodiscard]] auto getError() const -> const std::optional<std::string>& {
+        return this->error;
+    }
 
-        auto a = stack.back();
-        stack.pop_back();
+    [[nodiscard]] auto getChunk() const -> const ByteCode::Chunk& {
+        return this->chunk;
+    }
 
-        spdlog::info(fmt::format("Perform binary operation {} on {} {}", BinaryOperatorNames[(int) op], std::visit(PrintVisitor{}, a), std::visit(PrintVisitor{}, b)));
+    [[nodiscard]] auto slot(const std::string_view name) const -> std::optional<ByteCode::Index> {
+        const auto found = std::find(this->chunk.slots.begin(), this->chunk.slots.end(), name);
+        if (found == this->chunk.slots.end()) {
+            return std::nullopt;
+        }
+        return static_cast<ByteCode::Index>(std::distance(this->chunk.slots.begin(), found));
+    }
 
-        switch (op) {
-        case BinaryOperators::ADD:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) + std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) + std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
-            }
-            break;
-        case BinaryOperators::SUB:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) - std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) - std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
-            }
-            break;
-        case BinaryOperators::MUL:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) * std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) * std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
+    // Runs the program from the start in the given context. Returns false if
+    // the chunk failed verification or the run stopped on a run-time error,
+    // see ExecutionContext::getError().
+    auto run(ExecutionContext& context, Dispatch dispatch = defaultDispatch) const -> bool {
+        if (hadError()) {
+            fmt::print(stderr, "Refusing to run malformed bytecode: {}\n", *this->error);
+            return false;
+        }
+
+        TRACE(VM, "=== Start VM ===");
+        assert(context.fits(this->chunk) && "context bound to a smaller chunk");
+        context.reset(this->chunk);
+
+#if ACOMPILER_COMPUTED_GOTO
+        if (dispatch == Dispatch::Threaded) {
+            executeThreaded(context);
+            return context.succeeded();
+        }
+#endif
+        executeSwitch(context, [](ByteCode::OpCode) {});
+        return context.succeeded();
+    }
+
+    // Runs the program like run() with the switch loop, recording every
+    // opcode it dispatches into `profile`.
+    auto profile(ExecutionContext& context, ByteCode::OpcodeProfile& profile) const -> bool {
+        if (hadError()) {
+            fmt::print(stderr, "Refusing to run malformed bytecode: {}\n", *this->error);
+            return false;
+        }
+
+        assert(context.fits(this->chunk) && "context bound to a smaller chunk");
+        context.reset(this->chunk);
+        profile.begin();
+        executeSwitch(context, [&](const ByteCode::OpCode op) { profile.record(op); });
+        return context.succeeded();
+    }
+
+    // Runs the program in a context owned by this VirtualMachine. Returns
+    // what run() does.
+    auto execute(Dispatch dispatch = defaultDispatch) -> bool {
+        if (not this->context.has_value()) {
+            this->context.emplace(this->chunk);
+        }
+        return run(*this->context, dispatch);
+    }
+
+private:
+    auto doBinaryOperation(ExecutionContext& ctx, BinaryOperators op) const -> void {
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+
+        TRACE(VM, "Perform binary operation {} on {} {}", BinaryOperatorNames[(int) op], a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+
+        if (Value::bothInts(a, b)) [[likely]] {
+            if (op == BinaryOperators::DIV && b.asInt() == 0) [[unlikely]] {
+                return ctx.fail("Division by zero.");
             }
-            break;
-        case BinaryOperators::DIV:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) / std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) / std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
+            ctx.push(apply(op, a.asInt(), b.asInt()));
+        } else if (Value::bothDoubles(a, b)) {
+            ctx.push(apply(op, a.asDouble(), b.asDouble()));
+        } else {
+            ctx.fail(fmt::format("Operands of {} must be two numbers of the same type, got {} and {}.", BinaryOperatorNames[(int) op], a.visit(PrintVisitor{}), b.visit(PrintVisitor{})));
+        }
+    }
+
+    // The operand types were proved at compile time, so the tags are not
+    // looked at.
+    template<BinaryOperators op, typename T>
+    auto doTypedOperation(ExecutionContext& ctx) const -> void {
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+
+        TRACE(VM, "Perform typed operation {} on {} {}", BinaryOperatorNames[(int) op], a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+
+        if constexpr (std::is_same_v<T, int>) {
+            if (op == BinaryOperators::DIV && b.asInt() == 0) [[unlikely]] {
+                return ctx.fail("Division by zero.");
             }
-            break;
-        case BinaryOperators::EQ:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) == std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) == std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
+            ctx.push(apply(op, a.asInt(), b.asInt()));
+        } else {
+            ctx.push(apply(op, a.asDouble(), b.asDouble()));
+        }
+    }
+
+    // `observe` sees every opcode before it runs, Halt excepted.
+    template<typename Observe>
+    auto executeSwitch(ExecutionContext& ctx, Observe&& observe) const -> void {
+        while (true) {
+            const auto op = static_cast<ByteCode::OpCode>(*ctx.ip++);
+            if (op != ByteCode::OpCode::Halt) {
+                observe(op);
             }
-            break;
-        case BinaryOperators::NEQ:
-            if (std::holds_alternative<INumber>(a) && std::holds_alternative<INumber>(b)) {
-                stack.emplace_back(std::get<INumber>(a) != std::get<INumber>(b));
-            } else if (std::holds_alternative<DNumber>(a) && std::holds_alternative<DNumber>(b)) {
-                stack.emplace_back(std::get<DNumber>(a) != std::get<DNumber>(b));
-            } else {
-                assert(false && "type mismatch");
+            switch (op) {
+            case ByteCode::OpCode::Halt:
+                return;
+#define X(name, operands, pops, pushes) case ByteCode::OpCode::name: this->op##name(ctx); break;
+            BYTECODE_INSTRUCTIONS(X)
+#undef X
             }
-            break;
         }
     }
 
-    auto execute() -> void {
-        const auto readInstruction = [this]() -> std::unique_ptr<ByteCode::Instruction> { 
-            return std::move(*ip++);
+#if ACOMPILER_COMPUTED_GOTO
+    auto executeThreaded(ExecutionContext& ctx) const -> void {
+        static const void* const dispatchTable[] = {
+#define X(name, operands, pops, pushes) &&op_##name,
+            BYTECODE_OPCODES(X)
+#undef X
         };
+        static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == ByteCode::opCodeCount);
 
-        ByteCode::Instruction instruction;
-
-        spdlog::warn("=== Start VM ===");
-
-        while (true && ip != std::end(bytecode)) {
-            const auto inst = readInstruction();
-
-            if (dynamic_cast<ByteCode::Print *>(inst.get())) {
-                std::cout << "[output]" << std::visit(PrintVisitor{}, pop()) << '\n';
-            } if (dynamic_cast<ByteCode::Add *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::ADD);
-            } else if (dynamic_cast<ByteCode::Sub *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::SUB);
-            } else if (dynamic_cast<ByteCode::Mul *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::MUL);
-            } else if (dynamic_cast<ByteCode::Div *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::DIV);
-            } else if (dynamic_cast<ByteCode::Eq *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::EQ);
-            } else if (dynamic_cast<ByteCode::NEq *>(inst.get())) {
-                doBinaryOperation(BinaryOperators::NEQ);
-            } else if (const auto inner = dynamic_cast<ByteCode::PushInt *>(inst.get())) {
-                const auto value = inner->value;
-                spdlog::info(fmt::format("PushInt [{}]", value));
-                this->stack.push_back(value);
-            } else if (dynamic_cast<ByteCode::PushDouble *>(inst.get())) {
-                assert(false && "Not implemented");
-            } else if (const auto inner = dynamic_cast<ByteCode::Assign *>(inst.get())) {
-                const auto value = pop();
-                const auto name = inner->name;
-                spdlog::info(fmt::format("Assign [{}] to {}", std::visit(PrintVisitor{}, value), name));
-                this->variables.insert({ name, value });
-            } else if (const auto inner = dynamic_cast<ByteCode::Variable *>(inst.get())) {
-                const auto name = inner->name;
-                spdlog::info(fmt::format("Lookup variable {}", name));
-                if (not this->variables.contains(name)) {
-                    fmt::print(stderr, "No variable with name '{}'", name);
-                    assert(false);
-                }
-
-                this->stack.push_back(this->variables.at(name));
-            } else if (const auto inner = dynamic_cast<ByteCode::Jmp *>(inst.get())) {
-                const auto offset = inner->offset;
-                std::advance(this->ip, offset);
-            } else if (const auto inner = dynamic_cast<ByteCode::Jz *>(inst.get())) {
-                auto back = pop();
-                assert(std::holds_alternative<Bool>(back));
-                spdlog::error(std::visit(PrintVisitor{}, back));
-                if (not std::get<Bool>(back)) {
-                    const auto offset = inner->offset;
-                    std::advance(this->ip, offset);
-                }
-            }
+#define DISPATCH() goto *dispatchTable[*ctx.ip++]
 
-            //perform(inst);
-
-
-            //switch (instruction = readInstruction()) {
-            //case ByteCode::Instruction::PRINT:
-                //std::cout << std::visit(PrintVisitor{}, pop()) << '\n';
-                //break;
-            //case ByteCode::Instruction::ADD:
-                //doBinaryOperation(BinaryOperators::ADD);
-                //break;
-            //case ByteCode::Instruction::SUB:
-                //doBinaryOperation(BinaryOperators::SUB);
-                //break;
-            //case ByteCode::Instruction::EQ:
-                //doBinaryOperation(BinaryOperators::EQ);
-                //break;
-            //case ByteCode::Instruction::NEQ:
-                //doBinaryOperation(BinaryOperators::NEQ);
-                //break;
-            //case ByteCode::Instruction::PUSH_INT:
-                //stack.push_back(readConstant<int>());
-                //break;
-            //case ByteCode::Instruction::PUSH_DOUBLE:
-                //stack.push_back(readConstant<double>());
-                //break;
-            //}
-        }
-
-        //fmt::print("end stack\n");
-        //for (auto dump = stack; not dump.empty(); dump.pop_back()) {
-            //fmt::print("[ {} ]", std::visit(PrintVisitor{}, dump.back()));
-        //}
-        //fmt::print("\n");
-    }
-    
-private:
+        DISPATCH();
 
-    [[nodiscard]] auto pop() -> Value {
-        auto v = stack.back();
-        stack.pop_back();
-        return v;
+    op_Halt:
+        return;
+#define X(name, operands, pops, pushes) op_##name: this->op##name(ctx); DISPATCH();
+        BYTECODE_INSTRUCTIONS(X)
+#undef X
+#undef DISPATCH
+    }
+#endif
+
+    // ------------------------------------------------------------------------
+    // Instruction handlers, entered with ip just past the opcode
+    // ------------------------------------------------------------------------
+    auto opPrint(ExecutionContext& ctx) const -> void {
+        *ctx.out << ctx.pop().visit(PrintVisitor{}) << '\n';
+    }
+
+    auto opPop(ExecutionContext& ctx) const -> void {
+        std::ignore = ctx.pop();
+    }
+
+    auto opDup(ExecutionContext& ctx) const -> void {
+        ctx.push(ctx.top());
+    }
+
+    auto opAdd(ExecutionContext& ctx) const -> void { doBinaryOperation(ctx, BinaryOperators::ADD); }
+    auto opSub(ExecutionContext& ctx) const -> void { doBinaryOperation(ctx, BinaryOperators::SUB); }
+    auto opMul(ExecutionContext& ctx) const -> void { doBinaryOperation(ctx, BinaryOperators::MUL); }
+    auto opDiv(ExecutionContext& ctx) const -> void { doBinaryOperation(ctx, BinaryOperators::DIV); }
+    auto opEq(ExecutionContext& ctx)  const -> void { doBinaryOperation(ctx, BinaryOperators::EQ); }
+    auto opNEq(ExecutionContext& ctx) const -> void { doBinaryOperation(ctx, BinaryOperators::NEQ); }
+
+    auto opAddI(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::ADD, int>(ctx); }
+    auto opSubI(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::SUB, int>(ctx); }
+    auto opMulI(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::MUL, int>(ctx); }
+    auto opDivI(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::DIV, int>(ctx); }
+    auto opEqI(ExecutionContext& ctx)  const -> void { doTypedOperation<BinaryOperators::EQ, int>(ctx); }
+    auto opNEqI(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::NEQ, int>(ctx); }
+
+    auto opAddD(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::ADD, double>(ctx); }
+    auto opSubD(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::SUB, double>(ctx); }
+    auto opMulD(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::MUL, double>(ctx); }
+    auto opDivD(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::DIV, double>(ctx); }
+    auto opEqD(ExecutionContext& ctx)  const -> void { doTypedOperation<BinaryOperators::EQ, double>(ctx); }
+    auto opNEqD(ExecutionContext& ctx) const -> void { doTypedOperation<BinaryOperators::NEQ, double>(ctx); }
+
+    auto opNeg(ExecutionContext& ctx) const -> void {
+        const auto value = ctx.pop();
+        TRACE(VM, "Neg on {}", value.visit(PrintVisitor{}));
+        if (value.isInt()) [[likely]] {
+            ctx.push(static_cast<int>(0u - static_cast<std::uint32_t>(value.asInt())));
+        } else if (value.isDouble()) {
+            ctx.push(-value.asDouble());
+        } else {
+            ctx.fail(fmt::format("Operand of Neg must be a number, got {}.", value.visit(PrintVisitor{})));
+        }
+    }
+
+    auto opNot(ExecutionContext& ctx) const -> void {
+        const auto value = ctx.pop();
+        TRACE(VM, "Not on {}", value.visit(PrintVisitor{}));
+        if (not value.isBool()) [[unlikely]] {
+            return ctx.fail(fmt::format("Operand of Not must be a bool, got {}.", value.visit(PrintVisitor{})));
+        }
+        ctx.push(not value.asBool());
+    }
+
+    // Multiplies by 2^count; the peephole pass emits it for x * 2^count, and
+    // x may still be a double input.
+    auto opShl(ExecutionContext& ctx) const -> void {
+        const auto count = ctx.readConstant<ByteCode::Index>();
+        const auto value = ctx.pop();
+        TRACE(VM, "Shl {} by {}", value.visit(PrintVisitor{}), count);
+        if (value.isInt()) [[likely]] {
+            ctx.push(static_cast<int>(static_cast<std::uint32_t>(value.asInt()) << count));
+        } else if (value.isDouble()) {
+            ctx.push(std::ldexp(value.asDouble(), count));
+        } else {
+            ctx.fail(fmt::format("Operand of Shl must be a number, got {}.", value.visit(PrintVisitor{})));
+        }
+    }
+
+    auto opJz(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        auto back = ctx.pop();
+        TRACE(VM, "Jz on {}", back.visit(PrintVisitor{}));
+        if (not back.isBool()) [[unlikely]] {
+            return ctx.fail(fmt::format("Condition must be a bool, got {}.", back.visit(PrintVisitor{})));
+        }
+        if (not back.asBool()) {
+            std::advance(ctx.ip, offset);
+        }
+    }
+
+    auto opJmp(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        std::advance(ctx.ip, offset);
+    }
+
+    auto opPushInt(ExecutionContext& ctx) const -> void {
+        const auto value = this->chunk.integers[ctx.readConstant<ByteCode::Index>()];
+        TRACE(VM, "PushInt [{}]", value);
+        ctx.push(value);
+    }
+
+    auto opPushDouble(ExecutionContext& ctx) const -> void {
+        const auto value = this->chunk.doubles[ctx.readConstant<ByteCode::Index>()];
+        TRACE(VM, "PushDouble [{}]", value);
+        ctx.push(value);
+    }
+
+    auto opPushTrue(ExecutionContext& ctx) const -> void {
+        ctx.push(true);
+    }
+
+    auto opPushFalse(ExecutionContext& ctx) const -> void {
+        ctx.push(false);
+    }
+
+    auto opStoreSlot(ExecutionContext& ctx) const -> void {
+        const auto slot = ctx.readConstant<ByteCode::Index>();
+        TRACE(VM, "Store [{}] to slot {}", ctx.top().visit(PrintVisitor{}), slot);
+        ctx.variables[slot] = ctx.pop();
+    }
+
+    auto opLoadSlot(ExecutionContext& ctx) const -> void {
+        const auto slot = ctx.readConstant<ByteCode::Index>();
+        TRACE(VM, "Load slot {}", slot);
+        ctx.push(ctx.variables[slot]);
+    }
+
+    // ------------------------------------------------------------------------
+    // Superinstructions
+    // ------------------------------------------------------------------------
+    // Nothing, after stopping the run, if a and b are not two numbers of the
+    // same type.
+    [[nodiscard]] static auto equal(ExecutionContext& ctx, const Value& a, const Value& b) -> std::optional<bool> {
+        if (Value::bothInts(a, b)) [[likely]] {
+            return a.asInt() == b.asInt();
+        }
+        if (Value::bothDoubles(a, b)) {
+            return a.asDouble() == b.asDouble();
+        }
+        ctx.fail(fmt::format("Operands of EQ must be two numbers of the same type, got {} and {}.", a.visit(PrintVisitor{}), b.visit(PrintVisitor{})));
+        return std::nullopt;
+    }
+
+    auto opEqJz(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+        TRACE(VM, "EqJz on {} {}", a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+        if (equal(ctx, a, b) == false) {
+            std::advance(ctx.ip, offset);
+        }
+    }
+
+    auto opNEqJz(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+        TRACE(VM, "NEqJz on {} {}", a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+        if (equal(ctx, a, b) == true) {
+            std::advance(ctx.ip, offset);
+        }
+    }
+
+    // Typed like EqI and NEqI, so the tags are not looked at.
+    auto opEqIJz(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+        TRACE(VM, "EqIJz on {} {}", a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+        if (a.asInt() != b.asInt()) {
+            std::advance(ctx.ip, offset);
+        }
+    }
+
+    auto opNEqIJz(ExecutionContext& ctx) const -> void {
+        const auto offset = ctx.readConstant<ByteCode::Offset>();
+        const auto b = ctx.pop();
+        const auto a = ctx.pop();
+        TRACE(VM, "NEqIJz on {} {}", a.visit(PrintVisitor{}), b.visit(PrintVisitor{}));
+        if (a.asInt() == b.asInt()) {
+            std::advance(ctx.ip, offset);
+        }
+    }
+
+    auto opAddSlotInt(ExecutionContext& ctx) const -> void {
+        const auto slot = ctx.readConstant<ByteCode::Index>();
+        const auto value = this->chunk.integers[ctx.readConstant<ByteCode::Index>()];
+        auto& variable = ctx.variables[slot];
+        TRACE(VM, "Add {} to slot {}", value, slot);
+        if (not variable.isInt()) [[unlikely]] {
+            return ctx.fail(fmt::format("Operands of ADD must be two numbers of the same type, got {} and {}.", variable.visit(PrintVisitor{}), value));
+        }
+        variable = apply(BinaryOperators::ADD, variable.asInt(), value);
+    }
+
+    auto opLoadLoad(ExecutionContext& ctx) const -> void {
+        const auto first = ctx.readConstant<ByteCode::Index>();
+        const auto second = ctx.readConstant<ByteCode::Index>();
+        TRACE(VM, "Load slots {} and {}", first, second);
+        ctx.push(ctx.variables[first]);
+        ctx.push(ctx.variables[second]);
+    }
+
+    auto opStoreKeep(ExecutionContext& ctx) const -> void {
+        const auto slot = ctx.readConstant<ByteCode::Index>();
+        TRACE(VM, "Store [{}] to slot {}, keeping it", ctx.top().visit(PrintVisitor{}), slot);
+        ctx.variables[slot] = ctx.top();
+    }
+
+    // Int arithmetic wraps, like opShl and the JIT's native code; the
+    // callers rule out division by zero.
+    template<typename T>
+    [[nodiscard]] static auto apply(const BinaryOperators op, const T a, const T b) -> Value {
+        if constexpr (std::is_same_v<T, int>) {
+            const auto ua = static_cast<std::uint32_t>(a);
+            const auto ub = static_cast<std::uint32_t>(b);
+            switch (op) {
+            case BinaryOperators::ADD: return static_cast<int>(ua + ub);
+            case BinaryOperators::SUB: return static_cast<int>(ua - ub);
+            case BinaryOperators::MUL: return static_cast<int>(ua * ub);
+            // INT_MIN / -1 is the one quotient that does not fit.
+            case BinaryOperators::DIV: return b == -1 ? static_cast<int>(0u - ua) : a / b;
+            default: break;
+            }
+        }
+        switch (op) {
+        case BinaryOperators::ADD: return a + b;
+        case BinaryOperators::SUB: return a - b;
+        case BinaryOperators::MUL: return a * b;
+        case BinaryOperators::DIV: return a / b;
+        case BinaryOperators::EQ:  return a == b;
+        case BinaryOperators::NEQ: return a != b;
+        }
+        assert(false && "unknown operator");
+        return {};
     }
 
 private:
-    std::span<std::unique_ptr<ByteCode::Instruction>> bytecode;
-    std::span<std::unique_ptr<ByteCode::Instruction>>::iterator ip;
-    std::vector<Value> stack;
-    std::unordered_map<std::string_view, Value> variables;
+    const ByteCode::Chunk& chunk;
+    std::optional<std::string> error;
+    // Only used by execute().
+    std::optional<ExecutionContext> context;
 };
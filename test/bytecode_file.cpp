@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <sstream>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "bytecode_file.h"
+#include "gen.h"
+#include "parser.h"
+#include "peephole.h"
+#include "source.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+static auto setup(const std::string_view code, std::span<const std::string_view> inputs = {}) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts, inputs);
+    auto chunk = g.generate();
+    ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(chunk);
+    return chunk;
+}
+
+static auto run(const ByteCode::Chunk& chunk) -> std::string {
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    return out.str();
+}
+
+static auto decodes(const std::string_view bytes) -> std::optional<std::string> {
+    ByteCode::Chunk chunk;
+    return ByteCode::decode(bytes, chunk);
+}
+
+template<typename T>
+static auto patch(std::string& bytes, const std::size_t offset, const T value) -> void {
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+TEST(bytecode_file, round_trips_a_chunk) {
+    constexpr std::array inputs = { "x"sv };
+    const auto chunk = setup("a := 2.5; b := x + 40; if b == 42 then print a * 2.0; else print b; end", inputs);
+    const auto bytes = ByteCode::encode(chunk);
+
+    EXPECT_TRUE(ByteCode::isBytecode(bytes));
+    EXPECT_FALSE(ByteCode::isBytecode("a := 1;"));
+
+    ByteCode::Chunk loaded;
+    ASSERT_EQ(ByteCode::decode(bytes, loaded), std::nullopt);
+    EXPECT_EQ(loaded.code, chunk.code);
+    EXPECT_EQ(loaded.integers, chunk.integers);
+    EXPECT_EQ(loaded.doubles, chunk.doubles);
+    EXPECT_EQ(loaded.slots, chunk.slots);
+    EXPECT_EQ(loaded.inputs, 1);
+    EXPECT_EQ(loaded.maxStack, chunk.maxStack);
+
+    std::ostringstream out;
+    ExecutionContext context(loaded, out);
+    context.setSlot(0, 2);
+    EXPECT_TRUE(VirtualMachine(loaded).run(context));
+    EXPECT_EQ(out.str(), "5\n");
+}
+
+TEST(bytecode_file, sections_are_aligned) {
+    const auto bytes = ByteCode::encode(setup("a := 1; b := 0.5; print a;"));
+
+    ByteCode::File::Header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    for (const auto& section : header.sections) {
+        EXPECT_EQ(section.offset % ByteCode::File::alignment, 0);
+    }
+    EXPECT_EQ(header.sections[ByteCode::File::Code].offset + header.sections[ByteCode::File::Code].size, bytes.size());
+}
+
+TEST(bytecode_file, loads_a_mapped_file) {
+    const auto chunk = setup("a := 6; print a * 7;");
+
+    char path[] = "/tmp/acompiler_hbc_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_TRUE(ByteCode::writeFile(chunk, path));
+
+    {
+        const auto file = SourceFile::open(path);
+        ASSERT_TRUE(file.has_value());
+        EXPECT_TRUE(file->isMapped());
+
+        ByteCode::Chunk loaded;
+        ASSERT_EQ(ByteCode::decode(file->view(), loaded), std::nullopt);
+        EXPECT_EQ(run(loaded), "42\n");
+    }
+
+    std::remove(path);
+}
+
+TEST(bytecode_file, rejects_malformed_files) {
+    const auto bytes = ByteCode::encode(setup("a := 1; print a + 2;"));
+    const auto code = offsetof(ByteCode::File::Header, sections) + ByteCode::File::Code * sizeof(ByteCode::File::Section);
+    const auto names = offsetof(ByteCode::File::Header, sections) + ByteCode::File::Names * sizeof(ByteCode::File::Section);
+
+    EXPECT_EQ(decodes("print 1;"), "not a bytecode file");
+    EXPECT_EQ(decodes(bytes.substr(0, 20)), "truncated header");
+    EXPECT_EQ(decodes(bytes.substr(0, bytes.size() - 1)), "section outside the file");
+
+    auto version = bytes;
+    patch<std::uint16_t>(version, offsetof(ByteCode::File::Header, version), ByteCode::formatVersion + 1);
+    EXPECT_EQ(decodes(version), fmt::format("bytecode format {} with {} opcodes, expected format {} with {}", ByteCode::formatVersion + 1, ByteCode::opCodeCount, ByteCode::formatVersion, ByteCode::opCodeCount));
+
+    auto misaligned = bytes;
+    patch<std::uint32_t>(misaligned, code, ByteCode::File::aligned(sizeof(ByteCode::File::Header)) + 1);
+    EXPECT_EQ(decodes(misaligned), "section outside the file");
+
+    auto partial = bytes;
+    patch<std::uint32_t>(partial, names + sizeof(std::uint32_t), 3);
+    EXPECT_EQ(decodes(partial), "section size is not a multiple of its element size");
+
+    auto deep = bytes;
+    patch<std::uint32_t>(deep, offsetof(ByteCode::File::Header, maxStack), 1'000'000);
+    EXPECT_EQ(decodes(deep), "maximum stack depth larger than the code can reach");
+}
+
+TEST(bytecode_file, verifier_rejects_corrupt_code) {
+    auto bytes = ByteCode::encode(setup("a := 1; print a + 2;"));
+    // Point the first LoadSlot/StoreSlot style operand past every slot.
+    ByteCode::File::Header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    patch<ByteCode::Index>(bytes, header.sections[ByteCode::File::Code].offset + 4, 7);
+
+    ByteCode::Chunk loaded;
+    ASSERT_EQ(ByteCode::decode(bytes, loaded), std::nullopt);
+    EXPECT_EQ(VirtualMachine(loaded).getError(), "0003: slot out of range");
+}
+
+TEST(bytecode_file, verifier_rejects_mistyped_code) {
+    auto bytes = ByteCode::encode(setup("print 1.5 + 2.5;"));
+    ByteCode::File::Header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    // PushDouble 0; PushDouble 1; Add: claim the doubles are ints.
+    const auto add = header.sections[ByteCode::File::Code].offset + 6;
+    ASSERT_EQ(static_cast<ByteCode::OpCode>(bytes[add]), ByteCode::OpCode::Add);
+    bytes[add] = static_cast<char>(ByteCode::OpCode::AddI);
+
+    ByteCode::Chunk loaded;
+    ASSERT_EQ(ByteCode::decode(bytes, loaded), std::nullopt);
+    EXPECT_EQ(VirtualMachine(loaded).getError(), "0006: AddI on operands not proven to be ints");
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "parser.h"
+
+static constexpr auto program = R"(
+    a := 10;
+    b := a * 2 - 3 / 1.5;
+    if a != 10 then
+        print a;
+    else
+        if b == 20 then print b + 1; end
+    end
+    c := -(a + 4) * 2;
+    print !(c == a);
+    print d := e := c + 1;
+)"sv;
+
+TEST(flat_ast, parses_like_the_tree) {
+    Lexer l(program);
+    const auto buffer = l.lexBuffer();
+
+    const auto tree = Parser(buffer).parse();
+    const auto flat = Parser(buffer, FlatAst::Builder {}).parse();
+
+    ASSERT_EQ(flat.roots.size(), tree.size());
+    for (std::size_t i = 0; i < tree.size(); ++i) {
+        EXPECT_EQ(flat.to_string(flat.roots[i]), tree[i]->to_string());
+    }
+}
+
+TEST(flat_ast, generates_the_same_chunk) {
+    Lexer l(program);
+    auto tokens = l.lex();
+
+    auto tree = Parser(tokens).parse();
+    const auto expected = BytecodeGenerator(tree).generate();
+
+    const auto flat = Parser(tokens, FlatAst::Builder {}).parse();
+    const auto got = BytecodeGenerator(flat).generate();
+
+    EXPECT_EQ(ByteCode::disassemble(got), ByteCode::disassemble(expected));
+    EXPECT_EQ(got.code, expected.code);
+    EXPECT_EQ(got.slots, expected.slots);
+    EXPECT_EQ(got.maxStack, expected.maxStack);
+}
+
+TEST(flat_ast, reports_errors_like_the_tree) {
+    Lexer l("a := 1;\nif a == 1 then c := 1; end print c; print d;");
+    auto tokens = l.lex();
+    const auto flat = Parser(tokens, FlatAst::Builder {}).parse();
+
+    BytecodeGenerator g(flat);
+    std::ignore = g.generate();
+
+    ASSERT_EQ(g.getErrors().size(), 2);
+    EXPECT_EQ(g.getErrors()[0], "[line 2] Error at 'c': Variable might not be defined on every path.");
+    EXPECT_EQ(g.getErrors()[1], "[line 2] Error at 'd': Undefined variable.");
+}
+
+TEST(flat_ast, reports_invalid_assignment_targets) {
+    Lexer l("1 := 2;\nprint (a + b) := 3;");
+    auto tokens = l.lex();
+
+    Parser p(tokens, FlatAst::Builder {});
+    const auto flat = p.parse();
+
+    ASSERT_EQ(p.getErrors().size(), 2);
+    EXPECT_EQ(p.getErrors()[0], "[line 1] Error at ':=': Invalid assignment target.");
+    EXPECT_EQ(p.getErrors()[1], "[line 2] Error at ':=': Invalid assignment target.");
+    EXPECT_EQ(flat.roots.size(), 2);
+}
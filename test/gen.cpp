@@ -1,10 +1,11 @@
 #include <cstdint>
 #include <gtest/gtest.h>
 #include "gen.h"
+#include "jit.h"
 #include "parser.h"
 #include "vm.h"
 
-static auto setup(const std::string_view code) -> std::vector<std::unique_ptr<ByteCode::Instruction>> {
+static auto setup(const std::string_view code) -> ByteCode::Chunk {
     Lexer l(code);
     auto tokens = l.lex();
 
@@ -16,27 +17,173 @@ static auto setup(const std::string_view code) -> std::vector<std::unique_ptr<By
     return g.generate();
 }
 
-TEST(gen, print_addition) {
-    auto got = setup("print 1 + 2;");
+// Every program is run on both backends; the JIT falls back to the
+// interpreter for what it cannot compile.
+enum class Backend {
+    Interpreter,
+    Jit,
+};
+
+class gen_run : public testing::TestWithParam<Backend> {
+protected:
+    auto run(const ByteCode::Chunk& chunk) -> std::string {
+        testing::internal::CaptureStdout();
+        if (GetParam() == Backend::Jit) {
+            JitMachine(chunk).execute();
+        } else {
+            VirtualMachine(chunk).execute();
+        }
+        return testing::internal::GetCapturedStdout();
+    }
+};
 
-    VirtualMachine vm(got);
+INSTANTIATE_TEST_SUITE_P(backends, gen_run, testing::Values(Backend::Interpreter, Backend::Jit));
 
-    testing::internal::CaptureStdout();
-    vm.execute();
-    std::string output = testing::internal::GetCapturedStdout();
+TEST_P(gen_run, print_addition) {
+    auto got = setup("print 1 + 2;");
 
-    EXPECT_EQ(output, "3\n");
+    EXPECT_EQ(run(got), "3\n");
 }
 
-TEST(gen, print_addition_double) {
+TEST_P(gen_run, print_addition_double) {
     auto got = setup("print 1.5 + 2.2;");
 
-    VirtualMachine vm(got);
+    EXPECT_EQ(run(got), "3.7\n");
+}
+
+TEST_P(gen_run, arithmetic) {
+    auto got = setup("print 7 - 10; print 6 * 7; print 7 / 2; print 0 - 7 / 2;");
+
+    EXPECT_EQ(run(got), "-3\n42\n3\n-3\n");
+}
+
+TEST_P(gen_run, comparisons) {
+    auto got = setup("print 1 == 1; print 1 != 1; a := 2 == 3; print a;");
+
+    EXPECT_EQ(run(got), "true\nfalse\nfalse\n");
+}
+
+TEST_P(gen_run, variables_and_branches) {
+    auto got = setup(R"(
+        a := 10;
+        b := a * 2;
+        if a != 10 then
+            print a;
+        else
+            if b == 20 then print b + 1; end
+        end
+        print a;
+    )");
+
+    EXPECT_EQ(run(got), "21\n10\n");
+}
+
+TEST(gen, assignment_value_is_kept_on_the_stack) {
+    using enum ByteCode::OpCode;
+    auto got = setup("print a := 5; b := c := 1;");
+
+    const auto expected = std::vector<ByteCode::Type> {
+        static_cast<ByteCode::Type>(PushInt), 0, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 0, 0,
+        static_cast<ByteCode::Type>(LoadSlot), 0, 0,
+        static_cast<ByteCode::Type>(Print),
+        static_cast<ByteCode::Type>(PushInt), 1, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 1, 0,
+        static_cast<ByteCode::Type>(LoadSlot), 1, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 2, 0,
+        static_cast<ByteCode::Type>(Halt),
+    };
+
+    EXPECT_EQ(got.code, expected);
+    EXPECT_EQ(got.maxStack, 1);
+}
+
+TEST_P(gen_run, unary_and_grouping) {
+    auto got = setup("a := 3; print -a * (2 + 1); print -(0 - a); print !(a == 3); print -1.5;");
+
+    EXPECT_EQ(run(got), "-9\n3\nfalse\n-1.5\n");
+}
+
+TEST_P(gen_run, assignments_used_as_values) {
+    auto got = setup("print a := 5; b := c := a + 1; print b * c; if (d := 2) == 2 then print d; end");
+
+    EXPECT_EQ(run(got), "5\n36\n2\n");
+}
+
+TEST(gen, encoding_is_flat) {
+    using enum ByteCode::OpCode;
+    auto got = setup("print 7 + 7;");
 
-    testing::internal::CaptureStdout();
-    vm.execute();
-    std::string output = testing::internal::GetCapturedStdout();
+    const auto expected = std::vector<ByteCode::Type> {
+        static_cast<ByteCode::Type>(PushInt), 0, 0,
+        static_cast<ByteCode::Type>(PushInt), 0, 0,
+        static_cast<ByteCode::Type>(Add),
+        static_cast<ByteCode::Type>(Print),
+        static_cast<ByteCode::Type>(Halt),
+    };
 
-    EXPECT_EQ(output, "3.7\n");
+    EXPECT_EQ(got.code, expected);
+    EXPECT_EQ(got.integers, std::vector<int> { 7 });
 }
 
+TEST(gen, variables_use_slots) {
+    using enum ByteCode::OpCode;
+    auto got = setup("a := 1; b := a; a := b;");
+
+    const auto expected = std::vector<ByteCode::Type> {
+        static_cast<ByteCode::Type>(PushInt), 0, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 0, 0,
+        static_cast<ByteCode::Type>(LoadSlot), 0, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 1, 0,
+        static_cast<ByteCode::Type>(LoadSlot), 1, 0,
+        static_cast<ByteCode::Type>(StoreSlot), 0, 0,
+        static_cast<ByteCode::Type>(Halt),
+    };
+
+    EXPECT_EQ(got.code, expected);
+    EXPECT_EQ(got.slots, (std::vector<std::string> { "a", "b" }));
+}
+
+TEST(gen, undefined_variable) {
+    Lexer l("a := b;");
+    auto tokens = l.lex();
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts);
+    std::ignore = g.generate();
+
+    ASSERT_TRUE(g.hadError());
+    EXPECT_EQ(g.getErrors().front(), "[line 1] Error at 'b': Undefined variable.");
+}
+
+TEST(gen, variable_defined_on_one_branch) {
+    Lexer l("if 1 == 1 then c := 1; end print c;");
+    auto tokens = l.lex();
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts);
+    std::ignore = g.generate();
+
+    ASSERT_TRUE(g.hadError());
+    EXPECT_EQ(g.getErrors().front(), "[line 1] Error at 'c': Variable might not be defined on every path.");
+}
+
+TEST(gen, if_else_jumps_are_patched) {
+    auto got = setup("if 1 == 2 then print 3; else print 4; end");
+
+    const auto expected =
+        "0000 PushInt    1\n"
+        "0003 PushInt    2\n"
+        "0006 Eq\n"
+        "0007 Jz         -> 0021\n"
+        "0012 PushInt    3\n"
+        "0015 Print\n"
+        "0016 Jmp        -> 0025\n"
+        "0021 PushInt    4\n"
+        "0024 Print\n"
+        "0025 Halt\n";
+
+    EXPECT_EQ(ByteCode::disassemble(got), expected);
+}
@@ -0,0 +1,112 @@
+#include <limits>
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "jit.h"
+#include "parser.h"
+
+using namespace std::string_view_literals;
+
+static auto setup(const std::string_view code, std::span<const std::string_view> inputs = {}) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts, inputs);
+    return g.generate();
+}
+
+TEST(jit, compiles_int_and_bool_programs) {
+    const auto program = setup("a := 1 + 2; b := a == 3; if b then print a; end");
+    const JitMachine jit(program);
+
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+}
+
+TEST(jit, compiles_unary_operators) {
+    const auto program = setup("a := -(2 * 3); b := !(a == 6); if b then print -a; end print !b;");
+    const JitMachine jit(program);
+
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), "6\nfalse\n");
+}
+
+TEST(jit, falls_back_for_doubles) {
+    const auto program = setup("print 1.5 * 2.0;");
+    const JitMachine jit(program);
+
+    EXPECT_FALSE(jit.isCompiled());
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), "3\n");
+}
+
+TEST(jit, inputs_and_results) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("y := x * 3; big := y == 30;", inputs);
+    const JitMachine jit(program);
+
+    ExecutionContext context(program);
+    for (const auto x : { 10, -4 }) {
+        context.setSlot(0, x);
+        EXPECT_TRUE(jit.run(context));
+        EXPECT_EQ(context.getSlot(*jit.slot("y")).asInt(), x * 3);
+        EXPECT_EQ(context.getSlot(*jit.slot("big")).asBool(), x == 10);
+    }
+}
+
+TEST(jit, double_input_uses_interpreter) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("y := x + x;", inputs);
+    const JitMachine jit(program);
+
+    ExecutionContext context(program);
+    context.setSlot(0, 1.25);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(context.getSlot(*jit.slot("y")).asDouble(), 2.5);
+}
+
+TEST(jit, slot_with_different_types_on_each_path) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("if x == 1 then y := 1; else y := 1 == 1; end", inputs);
+    const JitMachine jit(program);
+
+    EXPECT_FALSE(jit.isCompiled());
+
+    ExecutionContext context(program);
+    context.setSlot(0, 2);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_TRUE(context.getSlot(*jit.slot("y")).asBool());
+}
+
+TEST(jit, integer_division_stops_on_zero_and_wraps) {
+    constexpr std::array inputs = { "x"sv, "y"sv };
+    const auto program = setup("print 1; print x / y; z := x + y;", inputs);
+    const JitMachine jit(program);
+
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+
+    context.setSlot(0, 7);
+    context.setSlot(1, 0);
+    EXPECT_FALSE(jit.run(context));
+    EXPECT_EQ(context.getError(), "Division by zero.");
+
+    context.setSlot(0, std::numeric_limits<int>::min());
+    context.setSlot(1, -1);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(context.getError(), std::nullopt);
+    EXPECT_EQ(context.getSlot(*jit.slot("z")).asInt(), std::numeric_limits<int>::max());
+
+    EXPECT_EQ(out.str(), "1\n1\n-2147483648\n");
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "../src/lexer.h"
+#include "../src/token_source.h"
 
 using enum TokenType;
 using TokenList = Lexer::TokenList;
@@ -30,12 +31,45 @@ auto fmt::formatter<TokenList>::format(const TokenList& tl, FormatContext& ctx)
     return fmt::format_to(ctx.out(), "{}", ss.str());
 }
 
-static auto setup(const std::string_view code) -> TokenList {
-    Lexer l(code);
-    return l.lex();
-}
+// Every test runs on the list from Lexer::lex(), on tokens pulled one at a
+// time through the parser's TokenStream, and on tokens read back from a
+// TokenBuffer, whose positions are recomputed.
+enum class TokenMode {
+    Materialized,
+    Streamed,
+    Buffered,
+};
+
+class lexer : public testing::TestWithParam<TokenMode> {
+protected:
+    auto setup(const std::string_view code, const Lexer::Mode mode = Lexer::Mode::Fast) -> TokenList {
+        Lexer l(code, mode);
+        if (GetParam() == TokenMode::Materialized) {
+            return l.lex();
+        }
+
+        TokenList tokens;
+        if (GetParam() == TokenMode::Buffered) {
+            const auto buffer = l.lexBuffer();
+            for (std::size_t i = 0; i < buffer.size(); ++i) {
+                tokens.push_back(buffer.token(i));
+            }
+            return tokens;
+        }
+
+        TokenStream stream(l);
+        while (stream.peek().ttype != Eof) {
+            tokens.push_back(stream.peek());
+            stream.advance();
+        }
+        tokens.push_back(stream.peek());
+        return tokens;
+    }
+};
+
+INSTANTIATE_TEST_SUITE_P(tokens, lexer, testing::Values(TokenMode::Materialized, TokenMode::Streamed, TokenMode::Buffered));
 
-TEST(lexer, parens) {
+TEST_P(lexer, parens) {
     const auto expected = Lexer::TokenList {
         Token { .ttype = LeftParen, .lexeme = "(", .position = { 1, 1 } },
         Token { .ttype = RightParen, .lexeme = ")", .position = { 1, 2 } },
@@ -47,9 +81,8 @@ TEST(lexer, parens) {
     EXPECT_EQ(tokens, expected) << fmt::format("\nGot:      {}\nExpected: {}\n", tokens, expected);;
 }
 
-TEST(lexer, Inumbers) {
-    Lexer l("10 + 20"sv);
-    const auto tokens = l.lex();
+TEST_P(lexer, Inumbers) {
+    const auto tokens = setup("10 + 20"sv);
     const auto expected = Lexer::TokenList {
         Token { .ttype = INumber, .lexeme = "10", .position = { 1, 2 } },
         Token { .ttype = Plus, .lexeme = "+", .position = { 1, 4 } },
@@ -59,9 +92,8 @@ TEST(lexer, Inumbers) {
 
     EXPECT_EQ(tokens, expected) << fmt::format("\nGot:      {}\nExpected: {}\n", tokens, expected);;
 }
-TEST(lexer, Dnumbers) {
-    Lexer l("10.5"sv);
-    const auto tokens = l.lex();
+TEST_P(lexer, Dnumbers) {
+    const auto tokens = setup("10.5"sv);
     const auto expected = Lexer::TokenList {
         Token { .ttype = DNumber, .lexeme = "10.5", .position = { 1, 4 } },
         Token { .ttype = Eof, .lexeme = "", .position = { 1, 4 } },
@@ -70,9 +102,8 @@ TEST(lexer, Dnumbers) {
     EXPECT_EQ(tokens, expected) << fmt::format("\nGot:      {}\nExpected: {}\n", tokens, expected);;
 }
 
-TEST(lexer, Identifier) {
-    Lexer l("a"sv);
-    const auto tokens = l.lex();
+TEST_P(lexer, Identifier) {
+    const auto tokens = setup("a"sv);
     const auto expected = Lexer::TokenList {
         Token { .ttype = Identifier, .lexeme = "a", .position = { 1, 1 } },
         Token { .ttype = Eof, .lexeme = "", .position = { 1, 1 } },
@@ -80,3 +111,58 @@ TEST(lexer, Identifier) {
 
     EXPECT_EQ(tokens, expected) << fmt::format("\nGot:      {}\nExpected: {}\n", tokens, expected);;
 }
+
+TEST_P(lexer, fast_mode_matches_simple_mode) {
+    std::string source = "a := 10;\n\tif a != 10 then print a; else print 100; end\r\n";
+    // Runs longer than one vector, and runs ending on every offset within one.
+    source += "a_very_long_identifier_that_spans_more_than_one_vector := 12345678901234567890123456789012345;\n";
+    source += std::string(70, ' ') + "x\t\t\t\r  := 1.25 + 3.000000000000000000000000000000001;\n";
+    for (std::size_t length = 1; length < 40; ++length) {
+        source += std::string(length, 'q') + std::string(length, ' ') + std::string(length, '7') + ";";
+    }
+    source += "trailing_identifier_at_the_very_end";
+
+    const auto simple = setup(source, Lexer::Mode::Simple);
+    const auto fast = setup(source, Lexer::Mode::Fast);
+
+    EXPECT_EQ(fast, simple) << fmt::format("\nFast:   {}\nSimple: {}\n", fast, simple);
+}
+
+TEST_P(lexer, keywords) {
+    const auto tokens = setup("print if then else end printer iff End the e"sv);
+
+    const auto types = std::vector<TokenType> { Print, If, Then, Else, End, Identifier, Identifier, Identifier, Identifier, Identifier, Eof };
+    ASSERT_EQ(tokens.size(), types.size());
+    for (std::size_t i = 0; i < types.size(); ++i) {
+        EXPECT_EQ(tokens[i].ttype, types[i]) << tokens[i].lexeme;
+    }
+}
+
+TEST_P(lexer, positions_across_lines) {
+    const auto tokens = setup("a := 1;\nif a == 1 then\n  print a;\nend\nb := a != 2;\n\n  x\r\n"sv);
+    const auto expected = Lexer::TokenList {
+        Token { .ttype = Identifier, .lexeme = "a", .position = { 1, 1 } },
+        Token { .ttype = Assign, .lexeme = ":=", .position = { 1, 3 } },
+        Token { .ttype = INumber, .lexeme = "1", .position = { 1, 5 } },
+        Token { .ttype = Semicolon, .lexeme = ";", .position = { 1, 6 } },
+        Token { .ttype = If, .lexeme = "if", .position = { 2, 3 } },
+        Token { .ttype = Identifier, .lexeme = "a", .position = { 2, 5 } },
+        Token { .ttype = EqualEqual, .lexeme = "==", .position = { 2, 7 } },
+        Token { .ttype = INumber, .lexeme = "1", .position = { 2, 9 } },
+        Token { .ttype = Then, .lexeme = "then", .position = { 2, 14 } },
+        Token { .ttype = Print, .lexeme = "print", .position = { 3, 8 } },
+        Token { .ttype = Identifier, .lexeme = "a", .position = { 3, 10 } },
+        Token { .ttype = Semicolon, .lexeme = ";", .position = { 3, 11 } },
+        Token { .ttype = End, .lexeme = "end", .position = { 4, 4 } },
+        Token { .ttype = Identifier, .lexeme = "b", .position = { 5, 2 } },
+        Token { .ttype = Assign, .lexeme = ":=", .position = { 5, 4 } },
+        Token { .ttype = Identifier, .lexeme = "a", .position = { 5, 6 } },
+        Token { .ttype = BangEqual, .lexeme = "!=", .position = { 5, 8 } },
+        Token { .ttype = INumber, .lexeme = "2", .position = { 5, 10 } },
+        Token { .ttype = Semicolon, .lexeme = ";", .position = { 5, 11 } },
+        Token { .ttype = Identifier, .lexeme = "x", .position = { 7, 4 } },
+        Token { .ttype = Eof, .lexeme = "", .position = { 8, 1 } },
+    };
+
+    EXPECT_EQ(tokens, expected) << fmt::format("\nGot:      {}\nExpected: {}\n", tokens, expected);
+}
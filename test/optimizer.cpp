@@ -0,0 +1,131 @@
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "vm.h"
+
+static auto compile(const std::string_view code, const bool optimize = true) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    AstArena arena;
+    auto stmts = Parser(tokens, arena).parse();
+    if (optimize) {
+        AstOptimizer(&arena).run(stmts);
+    }
+
+    BytecodeGenerator g(stmts);
+    auto chunk = g.generate();
+    EXPECT_FALSE(g.hadError());
+    return chunk;
+}
+
+static auto run(const ByteCode::Chunk& chunk) -> std::string {
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    return out.str();
+}
+
+TEST(optimizer, folds_arithmetic) {
+    const auto expected =
+        "0000 PushInt    7\n"
+        "0003 Print\n"
+        "0004 PushDouble -5\n"
+        "0007 Print\n"
+        "0008 Halt\n";
+
+    EXPECT_EQ(ByteCode::disassemble(compile("print 1 + 2 * 3; print -(2.5 * 2.0);")), expected);
+}
+
+TEST(optimizer, folds_comparisons_to_booleans) {
+    const auto chunk = compile("print 1 == 1; print !(2.5 != 2.5);");
+
+    EXPECT_EQ(ByteCode::disassemble(chunk), "0000 PushTrue\n0001 Print\n0002 PushTrue\n0003 Print\n0004 Halt\n");
+    EXPECT_EQ(run(chunk), "true\ntrue\n");
+}
+
+TEST(optimizer, wraps_like_the_vm) {
+    EXPECT_EQ(run(compile("print 2147483647 + 1;")), run(compile("print 2147483647 + 1;", false)));
+}
+
+TEST(optimizer, divides_int_min_by_minus_one_like_the_vm) {
+    constexpr auto code = "print (0 - 2147483647 - 1) / (0 - 1);";
+
+    EXPECT_EQ(run(compile(code)), "-2147483648\n");
+    EXPECT_EQ(run(compile(code, false)), "-2147483648\n");
+}
+
+TEST(optimizer, leaves_runtime_failures_alone) {
+    using enum ByteCode::OpCode;
+    const auto chunk = compile("a := 7 / 0; b := 1 + 1.5;");
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    7\n"
+        "0003 PushInt    0\n"
+        "0006 Div\n"
+        "0007 StoreSlot  0 (a)\n"
+        "0010 PushInt    1\n"
+        "0013 PushDouble 1.5\n"
+        "0016 Add\n"
+        "0017 StoreSlot  1 (b)\n"
+        "0020 Halt\n");
+}
+
+TEST(optimizer, propagates_variables_assigned_once) {
+    const auto chunk = compile("a := 6; b := a * 7; print b; c := 1; c := 2; print c;");
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    6\n"
+        "0003 StoreSlot  0 (a)\n"
+        "0006 PushInt    42\n"
+        "0009 StoreSlot  1 (b)\n"
+        "0012 PushInt    42\n"
+        "0015 Print\n"
+        "0016 PushInt    1\n"
+        "0019 StoreSlot  2 (c)\n"
+        "0022 PushInt    2\n"
+        "0025 StoreSlot  2 (c)\n"
+        "0028 LoadSlot   2 (c)\n"
+        "0031 Print\n"
+        "0032 Halt\n");
+}
+
+TEST(optimizer, does_not_propagate_branch_assignments) {
+    const auto code = "x := 1; if x == 1 then y := 2; else y := 3; end print y;";
+
+    EXPECT_EQ(run(compile(code)), "2\n");
+    EXPECT_NE(ByteCode::disassemble(compile(code)).find("LoadSlot   1 (y)"), std::string::npos);
+}
+
+TEST(optimizer, removes_dead_branches) {
+    const auto code = R"(
+        debug := 1 == 2;
+        if debug then print 1; else print 2; end
+        if !debug then print 3; end
+        if debug then print 4; end
+        if 1 == 1 then if debug then print 5; end else print 6; end
+    )";
+
+    const auto chunk = compile(code);
+    const auto listing = ByteCode::disassemble(chunk);
+    EXPECT_EQ(listing.find("Jz"), std::string::npos);
+    EXPECT_EQ(listing.find("Jmp"), std::string::npos);
+    EXPECT_EQ(run(chunk), "2\n3\n");
+    EXPECT_EQ(run(chunk), run(compile(code, false)));
+}
+
+TEST(optimizer, keeps_heap_trees_working) {
+    Lexer l("a := 2 * 3; if a == 6 then print a; end");
+    auto tokens = l.lex();
+    auto stmts = Parser(tokens).parse();
+
+    AstOptimizer optimizer;
+    optimizer.run(stmts);
+
+    ASSERT_EQ(stmts.size(), 2);
+    EXPECT_EQ(stmts[1]->to_string(), "PrintStatement INumber 6");
+    EXPECT_EQ(optimizer.removedBranchCount(), 1);
+    EXPECT_EQ(optimizer.propagatedCount(), 2);
+}
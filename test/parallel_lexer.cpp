@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include "parallel_lexer.h"
+
+static auto makeSource(const std::size_t lines) -> std::string {
+    std::string source;
+    for (std::size_t i = 0; i < lines; ++i) {
+        switch (i % 4) {
+        case 0: source += fmt::format("value_{} := {} * 3 + 1.5;\n", i, i); break;
+        case 1: source += fmt::format("if value_{} != {} then print value_{}; end\n", i - 1, i, i - 1); break;
+        case 2: source += "\n\t  \r\n"; break;
+        case 3: source += fmt::format("  print value_{} == 2;", i - 3); break;
+        }
+    }
+    return source;
+}
+
+TEST(parallel_lexer, matches_single_threaded) {
+    ThreadPool pool(4);
+
+    for (const auto lines : { 0, 1, 2, 3, 10, 101, 1000 }) {
+        const auto source = makeSource(lines);
+        const auto expected = Lexer(source).lex();
+
+        for (const std::size_t pieces : { 1, 2, 3, 7, 64 }) {
+            EXPECT_EQ(lexParallel(source, pool, pieces, 1), expected) << lines << " lines in " << pieces << " pieces";
+        }
+    }
+}
+
+TEST(parallel_lexer, trailing_newline_at_a_cut) {
+    ThreadPool pool(2);
+    const std::string source = "a := 1;\nb := 2;\n";
+
+    EXPECT_EQ(lexParallel(source, pool, 2, 1), Lexer(source).lex());
+}
+
+TEST(parallel_lexer, runs_on_a_worker_of_its_own_pool) {
+    ThreadPool pool(1);
+    const auto source = makeSource(101);
+
+    auto lexed = pool.submit([&] { return lexParallel(source, pool, 7, 1); });
+    EXPECT_EQ(lexed.get(), Lexer(source).lex());
+}
@@ -4,13 +4,36 @@
 
 using StmtList = std::vector<std::unique_ptr<Statements::Statement>>;
 
-static auto setup(const std::string_view code) -> StmtList {
-    Lexer l(code);
-    auto tokens = l.lex();
+// Every test parses from a lexed TokenList, from a TokenBuffer, and
+// streaming tokens straight from the Lexer.
+enum class TokenMode {
+    Materialized,
+    Streamed,
+    Buffered,
+};
 
-    Parser p(tokens);
-    return p.parse();
-}
+class parser : public testing::TestWithParam<TokenMode> {
+protected:
+    auto setup(const std::string_view code) -> StmtList {
+        Lexer l(code);
+        if (GetParam() == TokenMode::Streamed) {
+            Parser p(l);
+            return p.parse();
+        }
+        if (GetParam() == TokenMode::Buffered) {
+            const auto buffer = l.lexBuffer();
+            Parser p(buffer);
+            return p.parse();
+        }
+
+        auto tokens = l.lex();
+
+        Parser p(tokens);
+        return p.parse();
+    }
+};
+
+INSTANTIATE_TEST_SUITE_P(tokens, parser, testing::Values(TokenMode::Materialized, TokenMode::Streamed, TokenMode::Buffered));
 
 
 [[nodiscard]] bool is_same(const StmtList& a, const StmtList& b) {
@@ -30,7 +53,7 @@ static auto setup(const std::string_view code) -> StmtList {
 }
 
 
-TEST(parser, plus) {
+TEST_P(parser, plus) {
     auto got = setup("1+2");
 
     auto n1 = std::make_unique<Expressions::INumber>("1");
@@ -43,7 +66,7 @@ TEST(parser, plus) {
     EXPECT_TRUE(is_same(got, expected));
 }
 
-TEST(parser, minus) {
+TEST_P(parser, minus) {
     auto got = setup("1-2");
 
     auto n1 = std::make_unique<Expressions::INumber>("1");
@@ -56,7 +79,7 @@ TEST(parser, minus) {
     EXPECT_TRUE(is_same(got, expected));
 }
 
-TEST(parser, minusDnumber) {
+TEST_P(parser, minusDnumber) {
     auto got = setup("1-1.5");
 
     auto n1 = std::make_unique<Expressions::INumber>("1");
@@ -69,10 +92,193 @@ TEST(parser, minusDnumber) {
     EXPECT_TRUE(is_same(got, expected));
 }
 
-TEST(parser, variable) {
+TEST_P(parser, variable) {
     auto got = setup("a");
     auto expr = std::make_unique<Expressions::Variable>(Token { .ttype = { TokenType::Identifier }, .lexeme = { "a" }, .position = { .line = 1, .column = 1 } });
     StmtList expected;
     expected.push_back(std::make_unique<Statements::ExpressionStatement>(std::move(expr)));
     EXPECT_TRUE(is_same(got, expected));
 }
+
+TEST_P(parser, precedence) {
+    auto got = setup("a := 1 + 2 * 3 == 7 - 4 / 2;");
+
+    ASSERT_EQ(got.size(), 1);
+    EXPECT_EQ(got[0]->to_string(),
+        "ExpressionStatement Assign a Logical BinaryOperator INumber 1 + BinaryOperator INumber 2 * INumber 3"
+        " == BinaryOperator INumber 7 - BinaryOperator INumber 4 / INumber 2");
+}
+
+TEST_P(parser, left_associative) {
+    auto got = setup("1 - 2 - 3;");
+
+    ASSERT_EQ(got.size(), 1);
+    EXPECT_EQ(got[0]->to_string(), "ExpressionStatement BinaryOperator BinaryOperator INumber 1 - INumber 2 - INumber 3");
+}
+
+TEST_P(parser, unary) {
+    auto got = setup("print -a * 2; print !(a == --1);");
+
+    ASSERT_EQ(got.size(), 2);
+    EXPECT_EQ(got[0]->to_string(), "PrintStatement BinaryOperator Unary - Variable a * INumber 2");
+    EXPECT_EQ(got[1]->to_string(), "PrintStatement Unary ! Logical Variable a == Unary - Unary - INumber 1");
+}
+
+TEST_P(parser, grouping) {
+    auto got = setup("b := (1 + 2) * ((3));");
+
+    ASSERT_EQ(got.size(), 1);
+    EXPECT_EQ(got[0]->to_string(), "ExpressionStatement Assign b BinaryOperator BinaryOperator INumber 1 + INumber 2 * INumber 3");
+}
+
+TEST(parser_errors, invalid_assignment_target) {
+    Lexer l("1 := 2;\na + b := 3; print -c := 4;\nd := 5;");
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    const auto got = p.parse();
+
+    ASSERT_EQ(p.getErrors().size(), 3);
+    EXPECT_EQ(p.getErrors()[0], "[line 1] Error at ':=': Invalid assignment target.");
+    EXPECT_EQ(p.getErrors()[1], "[line 2] Error at ':=': Invalid assignment target.");
+    EXPECT_EQ(p.getErrors()[2], "[line 2] Error at ':=': Invalid assignment target.");
+    ASSERT_EQ(got.size(), 4);
+    EXPECT_EQ(got[3]->to_string(), "ExpressionStatement Assign d INumber 5");
+}
+
+TEST(parser_errors, missing_expression) {
+    Lexer l("print ;\nprint 1 +;\nprint 2;\na := ) + 1; print 3;\nprint");
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    const auto got = p.parse();
+
+    ASSERT_EQ(p.getErrors().size(), 4);
+    EXPECT_EQ(p.getErrors()[0], "[line 1] Error at ';': Expect expression.");
+    EXPECT_EQ(p.getErrors()[1], "[line 2] Error at ';': Expect expression.");
+    EXPECT_EQ(p.getErrors()[2], "[line 4] Error at ')': Expect expression.");
+    EXPECT_EQ(p.getErrors()[3], "[line 5] Error at end: Expect expression.");
+    ASSERT_EQ(got.size(), 2);
+    EXPECT_EQ(got[0]->to_string(), "PrintStatement INumber 2");
+    EXPECT_EQ(got[1]->to_string(), "PrintStatement INumber 3");
+}
+
+TEST(parser_errors, missing_tokens) {
+    Lexer l("if a print a; end\nprint a\nprint b;\nprint (c;\nif b then print b;");
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    const auto got = p.parse();
+
+    ASSERT_EQ(p.getErrors().size(), 4);
+    EXPECT_EQ(p.getErrors()[0], "[line 1] Error at 'print': Expect 'then' after if statement.");
+    EXPECT_EQ(p.getErrors()[1], "[line 3] Error at 'print': Expect ';' after value.");
+    EXPECT_EQ(p.getErrors()[2], "[line 4] Error at ';': Expect ')' after expression.");
+    EXPECT_EQ(p.getErrors()[3], "[line 5] Error at end: Expect 'end' after if statement.");
+    // The statements are complete, so they are kept.
+    ASSERT_EQ(got.size(), 5);
+    EXPECT_EQ(got[1]->to_string(), "PrintStatement Variable a");
+    EXPECT_EQ(got[2]->to_string(), "PrintStatement Variable b");
+}
+
+TEST(parser_errors, recovers_with_every_builder_and_source) {
+    constexpr auto code = "print ;\nprint 1 +;\nx := (1 + ) * 2;\nprint 2;"sv;
+
+    Lexer streamed(code);
+    Parser fromLexer(streamed);
+    EXPECT_EQ(fromLexer.parse().size(), 1);
+    EXPECT_EQ(fromLexer.getErrors().size(), 3);
+
+    Lexer buffered(code);
+    const auto buffer = buffered.lexBuffer();
+    Parser flat(buffer, FlatAst::Builder {});
+    EXPECT_EQ(flat.parse().roots.size(), 1);
+    EXPECT_EQ(flat.getErrors().size(), 3);
+}
+
+TEST(token_stream, parses_like_a_token_list) {
+    constexpr auto code = "a := 1;\nif a == 1 then print a; else print 2.5; end\nb := a * 2 - 3;\nprint b;"sv;
+
+    Lexer materialized(code);
+    auto tokens = materialized.lex();
+    const auto expected = Parser(tokens).parse();
+
+    Lexer streamed(code);
+    const auto got = Parser(streamed).parse();
+
+    EXPECT_EQ(got.size(), 4);
+    EXPECT_TRUE(is_same(got, expected));
+
+    Lexer buffered(code);
+    const auto buffer = buffered.lexBuffer();
+    EXPECT_TRUE(is_same(Parser(buffer).parse(), expected));
+}
+
+TEST(token_stream, buffer_view_tracks_positions) {
+    constexpr auto code = "a := 1;\nif a == 1 then\n  print a != 2;\nend\n\nb := a;"sv;
+
+    Lexer reference(code);
+    const auto expected = reference.lex();
+
+    Lexer buffered(code);
+    const auto buffer = buffered.lexBuffer();
+    TokenBufferView view(buffer);
+
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(view.peek(), expected[i]) << fmt::format("{} != {}", view.peek(), expected[i]);
+        view.advance();
+    }
+}
+
+TEST(token_stream, buffer_view_positions_do_not_depend_on_read_order) {
+    constexpr auto code = "a := 1;\nif a == 1 then\n  print a != 2;\nend\n\nb := a;"sv;
+
+    Lexer reference(code);
+    const auto expected = reference.lex();
+
+    Lexer buffered(code);
+    const auto buffer = buffered.lexBuffer();
+    TokenBufferView view(buffer);
+
+    // Advance without reading, then look behind and ahead.
+    for (std::size_t i = 0; i + 1 < expected.size(); i += 3) {
+        EXPECT_EQ(view.peek(2), expected[std::min(i + 2, expected.size() - 1)]);
+        EXPECT_EQ(view.peek(), expected[i]);
+        view.advance();
+        view.advance();
+        view.advance();
+        EXPECT_EQ(view.previous(), expected[std::min(i + 2, expected.size() - 2)]);
+    }
+}
+
+TEST(ast_arena, parses_like_the_heap) {
+    constexpr auto code = "a := 1;\nif a == 1 then print a; else print 2.5; end\nb := a * 2 - 3;\nprint b;"sv;
+
+    Lexer l(code);
+    auto tokens = l.lex();
+    const auto expected = Parser(tokens).parse();
+
+    AstArena arena;
+    const auto got = Parser(tokens, arena).parse();
+
+    EXPECT_TRUE(is_same(got, expected));
+    EXPECT_GT(arena.bytes(), 0);
+    EXPECT_EQ(arena.blockCount(), 1);
+    for (const auto& statement : got) {
+        EXPECT_TRUE(statement->arenaOwned);
+    }
+    EXPECT_FALSE(expected.front()->arenaOwned);
+}
+
+TEST(ast_arena, grows_by_blocks) {
+    AstArena arena { 256 };
+
+    std::vector<std::unique_ptr<Expressions::Expression>> numbers;
+    for (int i = 0; i < 64; ++i) {
+        numbers.push_back(arena.make<Expressions::INumber>("42"));
+    }
+
+    EXPECT_GT(arena.blockCount(), 1);
+    EXPECT_EQ(arena.bytes(), 64 * sizeof(Expressions::INumber));
+    EXPECT_EQ(numbers.back()->to_string(), numbers.front()->to_string());
+}
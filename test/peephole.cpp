@@ -0,0 +1,371 @@
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "jit.h"
+#include "parser.h"
+#include "peephole.h"
+#include "type_checker.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+static auto compile(const std::string_view code, std::span<const std::string_view> inputs = {}) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts, inputs);
+    auto chunk = g.generate();
+    EXPECT_FALSE(g.hadError());
+    return chunk;
+}
+
+static auto typed(const std::string_view code) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+    auto stmts = Parser(tokens).parse();
+    TypeChecker().run(stmts);
+    return BytecodeGenerator(stmts).generate();
+}
+
+static auto optimized(ByteCode::Chunk chunk) -> ByteCode::Chunk {
+    ByteCode::Peephole().run(chunk);
+    return chunk;
+}
+
+static auto run(const ByteCode::Chunk& chunk) -> std::string {
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    return out.str();
+}
+
+TEST(peephole, removes_jump_to_next) {
+    constexpr std::array inputs = { "x"sv };
+    auto chunk = compile("if x == 1 then print 1; end print 2;", inputs);
+    ByteCode::Peephole peephole;
+
+    EXPECT_EQ(peephole.run(chunk), 1);
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 LoadSlot   0 (x)\n"
+        "0003 PushInt    1\n"
+        "0006 Eq\n"
+        "0007 Jz         -> 0016\n"
+        "0012 PushInt    1\n"
+        "0015 Print\n"
+        "0016 PushInt    2\n"
+        "0019 Print\n"
+        "0020 Halt\n");
+    EXPECT_EQ(peephole.ruleHits()[0], 1);
+}
+
+TEST(peephole, conditional_jump_to_next_pops_condition) {
+    using enum ByteCode::OpCode;
+    ByteCode::Chunk chunk;
+    chunk.write(PushTrue);
+    chunk.write(Jz);
+    chunk.writeOperand<ByteCode::Offset>(0);
+    chunk.write(Halt);
+    chunk.maxStack = 1;
+
+    EXPECT_EQ(ByteCode::Peephole().run(chunk), 0);
+    EXPECT_EQ(ByteCode::disassemble(chunk), "0000 PushTrue\n0001 Pop\n0002 Halt\n");
+    EXPECT_FALSE(ByteCode::verify(chunk).has_value());
+}
+
+TEST(peephole, threads_jumps_to_jumps) {
+    constexpr std::array inputs = { "x"sv };
+    const auto chunk = optimized(compile("if x == 1 then if x == 2 then print 1; else print 3; end else print 2; end", inputs));
+
+    // The inner then-branch jumps straight past the outer else-branch.
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 LoadSlot   0 (x)\n"
+        "0003 PushInt    1\n"
+        "0006 Eq\n"
+        "0007 Jz         -> 0042\n"
+        "0012 LoadSlot   0 (x)\n"
+        "0015 PushInt    2\n"
+        "0018 Eq\n"
+        "0019 Jz         -> 0033\n"
+        "0024 PushInt    1\n"
+        "0027 Print\n"
+        "0028 Jmp        -> 0046\n"
+        "0033 PushInt    3\n"
+        "0036 Print\n"
+        "0037 Jmp        -> 0046\n"
+        "0042 PushInt    2\n"
+        "0045 Print\n"
+        "0046 Halt\n");
+}
+
+TEST(peephole, store_then_load_keeps_value_on_stack) {
+    const auto chunk = optimized(compile("a := 3; print a;"));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    3\n"
+        "0003 Dup\n"
+        "0004 StoreSlot  0 (a)\n"
+        "0007 Print\n"
+        "0008 Halt\n");
+    EXPECT_EQ(chunk.maxStack, 2);
+}
+
+TEST(peephole, store_then_load_of_other_slot_is_kept) {
+    auto chunk = compile("a := 3; b := 4; print a;");
+
+    EXPECT_EQ(ByteCode::Peephole().run(chunk), 0);
+    EXPECT_EQ(chunk.maxStack, 1);
+}
+
+TEST(peephole, removes_arithmetic_identities) {
+    auto chunk = typed("a := 5; print a + 0; print a - 0; print a * 1; print a / 1; print 0 - a;");
+
+    EXPECT_EQ(ByteCode::Peephole().run(chunk), 8);
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    5\n"
+        "0003 Dup\n"
+        "0004 StoreSlot  0 (a)\n"
+        "0007 Print\n"
+        "0008 LoadSlot   0 (a)\n"
+        "0011 Print\n"
+        "0012 LoadSlot   0 (a)\n"
+        "0015 Print\n"
+        "0016 LoadSlot   0 (a)\n"
+        "0019 Print\n"
+        "0020 PushInt    0\n"
+        "0023 LoadSlot   0 (a)\n"
+        "0026 SubI\n"
+        "0027 Print\n"
+        "0028 Halt\n");
+    EXPECT_EQ(run(chunk), "5\n5\n5\n5\n-5\n");
+}
+
+TEST(peephole, keeps_generic_arithmetic_identities) {
+    constexpr std::array inputs = { "x"sv };
+    auto chunk = compile("print x + 0; print x * 1;", inputs);
+
+    EXPECT_EQ(ByteCode::Peephole().run(chunk), 0);
+
+    // x may not be a number, which the generic forms still report.
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    context.setSlot(0, true);
+    EXPECT_FALSE(VirtualMachine(chunk).run(context));
+}
+
+TEST(peephole, multiplication_by_power_of_two_becomes_shift) {
+    const auto chunk = optimized(typed("a := 5; print a * 8; print a * 6; print a * 1073741824;"));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    5\n"
+        "0003 Dup\n"
+        "0004 StoreSlot  0 (a)\n"
+        "0007 Shl        3\n"
+        "0010 Print\n"
+        "0011 LoadSlot   0 (a)\n"
+        "0014 PushInt    6\n"
+        "0017 MulI\n"
+        "0018 Print\n"
+        "0019 LoadSlot   0 (a)\n"
+        "0022 Shl        30\n"
+        "0025 Print\n"
+        "0026 Halt\n");
+    EXPECT_EQ(run(chunk), "40\n30\n1073741824\n");
+}
+
+TEST(peephole, shift_wraps_like_multiplication) {
+    const auto chunk = optimized(typed("a := -3; print a * 8; print a * 1073741824;"));
+
+    EXPECT_NE(ByteCode::disassemble(chunk).find("Shl"), std::string::npos);
+    EXPECT_EQ(run(chunk), "-24\n1073741824\n");
+}
+
+TEST(peephole, generic_multiplication_is_not_shifted) {
+    constexpr std::array inputs = { "x"sv };
+    const auto chunk = optimized(compile("print x * 8;", inputs));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk).find("Shl"), std::string::npos);
+
+    // x may not be an int, which Mul still reports.
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    context.setSlot(0, 1.5);
+    EXPECT_FALSE(VirtualMachine(chunk).run(context));
+    context.setSlot(0, 5);
+    EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    EXPECT_EQ(out.str(), "40\n");
+}
+
+TEST(peephole, custom_rule_table) {
+    auto chunk = compile("a := 3; print a;");
+    auto rules = ByteCode::Peephole::defaultRules();
+    std::erase_if(rules, [](const auto& rule) { return rule.name == "store then load"; });
+
+    EXPECT_EQ(ByteCode::Peephole(rules).run(chunk), 0);
+    EXPECT_EQ(ByteCode::disassemble(chunk), ByteCode::disassemble(compile("a := 3; print a;")));
+}
+
+class peephole_programs : public testing::TestWithParam<std::string_view> {};
+
+TEST_P(peephole_programs, same_output_and_valid) {
+    const auto original = compile(GetParam());
+    const auto chunk = optimized(original);
+
+    EXPECT_FALSE(ByteCode::verify(chunk).has_value());
+    EXPECT_LE(chunk.code.size(), original.code.size());
+    EXPECT_EQ(run(chunk), run(original));
+
+    const JitMachine jit(chunk);
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), run(original));
+}
+
+INSTANTIATE_TEST_SUITE_P(peephole, peephole_programs, testing::Values(
+    "a := 3; print a; b := a * 4; print b + 0;",
+    "a := 1; if a == 1 then print 1; end print 2;",
+    "a := 2; if a == 1 then if a == 2 then print 1; else print 3; end else print 2; end",
+    "a := 1; if a == 1 then if a == 2 then print 1; else print 3; end else print 2; end",
+    "a := -5; b := a * 2 * 2; c := b / 1 - 0; print c; print !(c == -20);",
+    "a := 7; b := a; a := b * 16; print a; print b;"
+));
+
+static auto fused(ByteCode::Chunk chunk) -> ByteCode::Chunk {
+    ByteCode::Peephole().run(chunk);
+    ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(chunk);
+    return chunk;
+}
+
+TEST(peephole, fuses_compare_and_branch) {
+    constexpr std::array inputs = { "x"sv };
+    const auto chunk = fused(compile("if x == 1 then print 1; end if x != 2 then print 2; end", inputs));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 LoadSlot   0 (x)\n"
+        "0003 PushInt    1\n"
+        "0006 EqJz       -> 0015\n"
+        "0011 PushInt    1\n"
+        "0014 Print\n"
+        "0015 LoadSlot   0 (x)\n"
+        "0018 PushInt    2\n"
+        "0021 NEqJz      -> 0030\n"
+        "0026 PushInt    2\n"
+        "0029 Print\n"
+        "0030 Halt\n");
+}
+
+TEST(peephole, fuses_typed_compare_and_branch_into_typed_forms) {
+    const auto chunk = fused(typed("a := 1; if a == 1 then print 1; end if a != 2 then print 2; end d := 1.5; if d == 1.5 then print 3; end"));
+
+    const auto code = ByteCode::disassemble(chunk);
+    EXPECT_NE(code.find("EqIJz"), std::string::npos);
+    EXPECT_NE(code.find("NEqIJz"), std::string::npos);
+    // Doubles keep the plain compare, which does not look at the tags either.
+    EXPECT_NE(code.find("EqD"), std::string::npos);
+    EXPECT_EQ(code.find("EqJz"), std::string::npos);
+    EXPECT_FALSE(ByteCode::verify(chunk).has_value());
+    EXPECT_EQ(run(chunk), "1\n2\n3\n");
+
+    // The JIT compiles them like the generic forms.
+    const auto intChunk = fused(typed("a := 1; if a == 1 then print 1; end if a != 1 then print 2; end"));
+    const JitMachine jit(intChunk);
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+
+    std::ostringstream out;
+    ExecutionContext context(intChunk, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), "1\n");
+}
+
+TEST(peephole, fuses_add_to_slot) {
+    constexpr std::array inputs = { "x"sv };
+    const auto chunk = fused(compile("i := 0; if x == 1 then i := i + 1; end print i;", inputs));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    0\n"
+        "0003 StoreSlot  1 (i)\n"
+        "0006 LoadSlot   0 (x)\n"
+        "0009 PushInt    1\n"
+        "0012 EqJz       -> 0022\n"
+        "0017 AddSlotInt 1 (i) 1\n"
+        "0022 LoadSlot   1 (i)\n"
+        "0025 Print\n"
+        "0026 Halt\n");
+
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    for (const auto x : { 1, 2 }) {
+        context.setSlot(0, x);
+        EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    }
+    EXPECT_EQ(out.str(), "1\n0\n");
+}
+
+TEST(peephole, fuses_add_to_slot_keeping_the_sum) {
+    auto chunk = compile("i := 1; i := i + 2; print i;");
+    ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(chunk);
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 PushInt    1\n"
+        "0003 StoreSlot  0 (i)\n"
+        "0006 AddSlotInt 0 (i) 2\n"
+        "0011 LoadSlot   0 (i)\n"
+        "0014 Print\n"
+        "0015 Halt\n");
+    EXPECT_EQ(run(chunk), "3\n");
+}
+
+TEST(peephole, fuses_loads_and_stores) {
+    constexpr std::array inputs = { "a"sv, "b"sv };
+    const auto chunk = fused(compile("c := a * b; print c;", inputs));
+
+    EXPECT_EQ(ByteCode::disassemble(chunk),
+        "0000 LoadLoad   0 (a) 1 (b)\n"
+        "0005 Mul\n"
+        "0006 StoreKeep  2 (c)\n"
+        "0009 Print\n"
+        "0010 Halt\n");
+}
+
+TEST(peephole, does_not_fuse_across_jump_target) {
+    constexpr std::array inputs = { "x"sv };
+    auto chunk = compile("if x == 1 then y := 1; else y := 2; end print y;", inputs);
+    ByteCode::Peephole().run(chunk);
+    const auto before = ByteCode::disassemble(chunk);
+
+    ByteCode::Peephole(ByteCode::Peephole::fusionRules()).run(chunk);
+
+    // The compare still fuses; the StoreSlot after each branch and the load
+    // at the join stay apart.
+    EXPECT_NE(ByteCode::disassemble(chunk).find("EqJz"), std::string::npos);
+    EXPECT_NE(ByteCode::disassemble(chunk).find("LoadSlot   1 (y)"), std::string::npos);
+    EXPECT_FALSE(ByteCode::verify(chunk).has_value());
+}
+
+class fused_programs : public testing::TestWithParam<std::string_view> {};
+
+TEST_P(fused_programs, same_output_and_valid) {
+    const auto original = compile(GetParam());
+    const auto chunk = fused(original);
+
+    EXPECT_FALSE(ByteCode::verify(chunk).has_value());
+    EXPECT_EQ(run(chunk), run(original));
+
+    const JitMachine jit(chunk);
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), run(original));
+}
+
+INSTANTIATE_TEST_SUITE_P(peephole, fused_programs, testing::Values(
+    "a := 3; b := 4; print a + b; a := a + 1; print a; b := b + 2; print a * b;",
+    "a := 1; if a == 1 then print 1; end if a != 1 then print 2; end",
+    "a := 2; b := 2; if a == b then a := a + 5; else print b; end print a;",
+    "a := 1; if a == 1 then if a == 2 then print 1; else print 3; end else print 2; end"
+));
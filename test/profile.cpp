@@ -0,0 +1,76 @@
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "parser.h"
+#include "profile.h"
+#include "vm.h"
+
+static auto compile(const std::string_view code) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts);
+    return g.generate();
+}
+
+TEST(profile, counts_executed_sequences) {
+    using enum ByteCode::OpCode;
+    const auto chunk = compile("a := 1; a := a + 1; a := a + 1;");
+    const VirtualMachine vm(chunk);
+    ExecutionContext context(chunk);
+
+    ByteCode::OpcodeProfile profile;
+    EXPECT_TRUE(vm.profile(context, profile));
+    EXPECT_TRUE(vm.profile(context, profile));
+
+    EXPECT_EQ(profile.instructions(), 20);
+
+    const auto pairs = profile.top(2, 1);
+    ASSERT_EQ(pairs.size(), 1);
+    // Four pairs run four times; ties go to the lowest opcodes.
+    EXPECT_EQ(pairs[0].ops, (std::vector { Add, StoreSlot }));
+    EXPECT_EQ(pairs[0].count, 4);
+
+    const auto fours = profile.top(4, 1);
+    ASSERT_EQ(fours.size(), 1);
+    EXPECT_EQ(fours[0].ops, (std::vector { StoreSlot, LoadSlot, PushInt, Add }));
+    EXPECT_EQ(fours[0].count, 4);
+}
+
+TEST(profile, sequences_do_not_span_runs) {
+    using enum ByteCode::OpCode;
+    const auto chunk = compile("print 1;");
+    const VirtualMachine vm(chunk);
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+
+    ByteCode::OpcodeProfile profile;
+    EXPECT_TRUE(vm.profile(context, profile));
+    EXPECT_TRUE(vm.profile(context, profile));
+
+    EXPECT_EQ(out.str(), "1\n1\n");
+    const auto pairs = profile.top(2, 10);
+    ASSERT_EQ(pairs.size(), 1);
+    EXPECT_EQ(pairs[0].count, 2);
+    EXPECT_TRUE(profile.top(3, 10).empty());
+}
+
+TEST(profile, report_lists_shares) {
+    const auto chunk = compile("print 1;");
+    ExecutionContext context(chunk, std::cerr);
+    std::ostringstream out;
+    context.setOutput(out);
+
+    ByteCode::OpcodeProfile profile;
+    EXPECT_TRUE(VirtualMachine(chunk).profile(context, profile));
+
+    EXPECT_EQ(profile.report(5),
+        "2 instructions executed\n"
+        "2-grams:\n"
+        "           1  50.0%  PushInt Print\n"
+        "3-grams:\n"
+        "4-grams:\n");
+}
@@ -0,0 +1,229 @@
+#include <limits>
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "register_gen.h"
+#include "register_vm.h"
+#include "type_checker.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+struct Generated {
+    RegisterCode::Chunk chunk;
+    std::vector<std::string> errors;
+};
+
+static auto generate(const std::string_view code, std::span<const std::string_view> inputs = {}) -> Generated {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    auto stmts = Parser(tokens).parse();
+    TypeChecker checker;
+    checker.run(stmts);
+    EXPECT_FALSE(checker.hadError());
+
+    RegisterGenerator g(stmts, inputs);
+    auto chunk = g.generate();
+    return { std::move(chunk), g.getErrors() };
+}
+
+static auto run(const RegisterCode::Chunk& chunk, RegisterMachine::Dispatch dispatch = RegisterMachine::defaultDispatch) -> std::string {
+    std::ostringstream out;
+    RegisterContext context(chunk, out);
+    EXPECT_TRUE(RegisterMachine(chunk).run(context, dispatch));
+    return out.str();
+}
+
+TEST(register_vm, operators_write_their_destination) {
+    const auto generated = generate("a := 1; b := 2; c := a + b * 3; a := a + 1; print c;");
+
+    ASSERT_TRUE(generated.errors.empty());
+    EXPECT_EQ(RegisterCode::disassemble(generated.chunk),
+        "0000 Move  r0(a) k3(1)\n"
+        "0001 Move  r1(b) k4(2)\n"
+        "0002 MulI  t6 r1(b) k5(3)\n"
+        "0003 AddI  r2(c) r0(a) t6\n"
+        "0004 AddI  r0(a) r0(a) k3(1)\n"
+        "0005 Print r2(c)\n"
+        "0006 Halt\n");
+    EXPECT_EQ(generated.chunk.registers, 7);
+    EXPECT_EQ(run(generated.chunk), "7\n");
+}
+
+TEST(register_vm, branches) {
+    const auto generated = generate("a := 1; if a == 2 then print 1; else print 2; end");
+
+    ASSERT_TRUE(generated.errors.empty());
+    EXPECT_EQ(RegisterCode::disassemble(generated.chunk),
+        "0000 Move  r0(a) k1(1)\n"
+        "0001 EqI   t3 r0(a) k2(2)\n"
+        "0002 Jz    t3 -> 0005\n"
+        "0003 Print k1(1)\n"
+        "0004 Jmp   -> 0006\n"
+        "0005 Print k2(2)\n"
+        "0006 Halt\n");
+    EXPECT_EQ(run(generated.chunk), "2\n");
+}
+
+TEST(register_vm, folded_booleans_are_constants) {
+    Lexer l("t := 1 == 1; if t then print 2.5; end");
+    auto tokens = l.lex();
+    auto stmts = Parser(tokens).parse();
+    AstOptimizer().run(stmts);
+    TypeChecker().run(stmts);
+
+    RegisterGenerator g(stmts);
+    const auto chunk = g.generate();
+    ASSERT_FALSE(g.hadError());
+    EXPECT_NE(RegisterCode::disassemble(chunk).find("Move  r0(t) k1(true)"), std::string::npos);
+    EXPECT_EQ(run(chunk), "2.5\n");
+}
+
+// Every program prints the same on both machines, with both dispatch loops.
+class register_vm_matches_stack : public testing::TestWithParam<std::string_view> {};
+
+INSTANTIATE_TEST_SUITE_P(programs, register_vm_matches_stack, testing::Values(
+    "print 1 + 2; print 1.5 + 2.2;"sv,
+    "print 7 - 10; print 6 * 7; print 7 / 2; print 0 - 7 / 2;"sv,
+    "print 1 == 1; print 1 != 1; a := 2 == 3; print a; print 2.5 != 2.5;"sv,
+    "a := 3; print -a * (2 + 1); print -(0 - a); print !(a == 3); print -1.5;"sv,
+    "a := 10; b := a * 2; if a != 10 then print a; else if b == 20 then print b + 1; end end print a;"sv,
+    "a := 1; b := a; a := 2; print b; c := (a + b) * (a - b) / (b + 1); print c; t := a == 2; print t;"sv,
+    "x := 1.5; if x == 1.5 then y := x * 2.0; else y := 0.5; end print y; print y / 4.0;"sv));
+
+TEST_P(register_vm_matches_stack, prints_the_same) {
+    Lexer l(GetParam());
+    auto tokens = l.lex();
+    auto stmts = Parser(tokens).parse();
+    TypeChecker().run(stmts);
+
+    const auto bytecode = BytecodeGenerator(stmts).generate();
+    std::ostringstream expected;
+    ExecutionContext context(bytecode, expected);
+    ASSERT_TRUE(VirtualMachine(bytecode).run(context));
+
+    RegisterGenerator g(stmts);
+    const auto registers = g.generate();
+    ASSERT_FALSE(g.hadError());
+
+    EXPECT_EQ(run(registers, RegisterMachine::Dispatch::Switch), expected.str());
+#if ACOMPILER_COMPUTED_GOTO
+    EXPECT_EQ(run(registers, RegisterMachine::Dispatch::Threaded), expected.str());
+#endif
+}
+
+TEST(register_vm, inputs) {
+    constexpr std::array inputs = { "x"sv, "y"sv };
+    const auto generated = generate("if x == y then print 1; else print x - y; end z := x * y;", inputs);
+    ASSERT_TRUE(generated.errors.empty());
+
+    const RegisterMachine vm(generated.chunk);
+    ASSERT_EQ(vm.slot("x"), 0);
+    ASSERT_EQ(vm.slot("y"), 1);
+    ASSERT_EQ(vm.slot("z"), 2);
+
+    std::ostringstream out;
+    RegisterContext context(generated.chunk, out);
+
+    for (const auto& [x, y] : { std::pair { 3, 3 }, std::pair { 10, 4 }, std::pair { 4, 10 } }) {
+        context.setSlot(0, x);
+        context.setSlot(1, y);
+        EXPECT_TRUE(vm.run(context));
+        EXPECT_EQ(context.getSlot(2).asInt(), x * y);
+    }
+
+    EXPECT_EQ(out.str(), "1\n6\n-6\n");
+}
+
+TEST(register_vm, stops_on_inputs_of_the_wrong_type) {
+    constexpr std::array inputs = { "x"sv };
+    const auto generated = generate("print x + 1; print 7;", inputs);
+    ASSERT_TRUE(generated.errors.empty());
+
+    const RegisterMachine vm(generated.chunk);
+    std::ostringstream out;
+    RegisterContext context(generated.chunk, out);
+
+    for (const auto dispatch : { RegisterMachine::Dispatch::Switch, RegisterMachine::defaultDispatch }) {
+        context.setSlot(0, true);
+        EXPECT_FALSE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), "Operands of ADD must be two numbers of the same type, got true and 1.");
+
+        context.setSlot(0, 2);
+        EXPECT_TRUE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), std::nullopt);
+    }
+
+    EXPECT_EQ(out.str(), "3\n7\n3\n7\n");
+}
+
+TEST(register_vm, integer_division_stops_on_zero_and_wraps) {
+    constexpr std::array inputs = { "x"sv, "y"sv };
+    const auto generated = generate("print 1; print x / y; print x + y;", inputs);
+    ASSERT_TRUE(generated.errors.empty());
+
+    const RegisterMachine vm(generated.chunk);
+    for (const auto dispatch : { RegisterMachine::Dispatch::Switch, RegisterMachine::defaultDispatch }) {
+        std::ostringstream out;
+        RegisterContext context(generated.chunk, out);
+
+        context.setSlot(0, 7);
+        context.setSlot(1, 0);
+        EXPECT_FALSE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), "Division by zero.");
+
+        context.setSlot(0, std::numeric_limits<int>::min());
+        context.setSlot(1, -1);
+        EXPECT_TRUE(vm.run(context, dispatch));
+
+        EXPECT_EQ(out.str(), "1\n1\n-2147483648\n2147483647\n");
+    }
+}
+
+TEST(register_vm, reports_undefined_variables) {
+    const auto generated = generate("a := 1;\nif a == 1 then b := 2; end\nprint b + c;");
+
+    ASSERT_EQ(generated.errors.size(), 2);
+    EXPECT_EQ(generated.errors[0], "[line 3] Error at 'b': Variable might not be defined on every path.");
+    EXPECT_EQ(generated.errors[1], "[line 3] Error at 'c': Undefined variable.");
+}
+
+TEST(register_vm, reports_too_many_registers) {
+    // Every distinct literal takes a constant register.
+    std::string code;
+    for (int i = 0; i <= std::numeric_limits<RegisterCode::Register>::max(); ++i) {
+        code += fmt::format("print {};\n", i);
+    }
+    const auto generated = generate(code);
+
+    ASSERT_EQ(generated.errors.size(), 1);
+    EXPECT_EQ(generated.errors[0], "Error: Program needs 65536 registers, at most 65535 are supported.");
+}
+
+TEST(register_vm, verifier_rejects_malformed_chunks) {
+    using enum RegisterCode::OpCode;
+    const auto rejects = [](RegisterCode::Chunk chunk) {
+        const RegisterMachine vm(chunk);
+        EXPECT_TRUE(vm.hadError());
+        RegisterContext context(chunk);
+        EXPECT_FALSE(vm.run(context));
+        return vm.getError().value_or("");
+    };
+
+    // One slot, one constant, one temporary.
+    const auto chunk = [](std::vector<RegisterCode::Instruction> code) {
+        return RegisterCode::Chunk { std::move(code), { Value { 1 } }, { "a" }, 0, 3 };
+    };
+
+    EXPECT_EQ(rejects(chunk({})), "empty chunk");
+    EXPECT_EQ(rejects(chunk({ { Move, 1, 0 }, { Halt } })), "0000: Move writes a constant register");
+    EXPECT_EQ(rejects(chunk({ { Add, 0, 1, 3 }, { Halt } })), "0000: register out of range");
+    EXPECT_EQ(rejects(chunk({ { Print, 2 } })), "execution can run off the end of the code");
+    EXPECT_EQ(rejects(chunk({ { Jmp, 0, 2 }, { Halt } })), "0000: jump out of the code");
+    EXPECT_EQ(rejects(chunk({ { static_cast<RegisterCode::OpCode>(RegisterCode::opCodeCount) }, { Halt } })), "0000: invalid opcode 25");
+
+    EXPECT_FALSE(RegisterMachine(chunk({ { Move, 0, 1 }, { Add, 2, 0, 1 }, { Print, 2 }, { Halt } })).hadError());
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "lexer.h"
+#include "source.h"
+
+static auto writeTemporary(const std::string_view content) -> std::string {
+    char path[] = "/tmp/acompiler_source_XXXXXX";
+    const int fd = mkstemp(path);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, content.data(), content.size()), static_cast<ssize_t>(content.size()));
+    close(fd);
+    return path;
+}
+
+TEST(source, maps_regular_files) {
+    const auto path = writeTemporary("a := 1;\nprint a;\n");
+
+    {
+        const auto source = SourceFile::open(path);
+        ASSERT_TRUE(source.has_value());
+        EXPECT_TRUE(source->isMapped());
+        EXPECT_EQ(source->view(), "a := 1;\nprint a;\n");
+
+        // Lexemes point straight into the mapping.
+        Lexer l(source->view());
+        const auto tokens = l.lex();
+        EXPECT_EQ(tokens.front().lexeme.data(), source->view().data());
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(source, empty_file) {
+    const auto path = writeTemporary("");
+
+    const auto source = SourceFile::open(path);
+    ASSERT_TRUE(source.has_value());
+    EXPECT_EQ(source->view(), "");
+
+    std::remove(path.c_str());
+}
+
+TEST(source, missing_file) {
+    EXPECT_FALSE(SourceFile::open("/nonexistent/script.hub").has_value());
+}
+
+TEST(source, reads_pipes) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    constexpr std::string_view content = "print 1 + 2;";
+    ASSERT_EQ(write(fds[1], content.data(), content.size()), static_cast<ssize_t>(content.size()));
+    close(fds[1]);
+
+    const auto source = SourceFile::fromDescriptor(fds[0], "<pipe>");
+    close(fds[0]);
+
+    ASSERT_TRUE(source.has_value());
+    EXPECT_FALSE(source->isMapped());
+    EXPECT_EQ(source->view(), content);
+}
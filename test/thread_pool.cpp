@@ -0,0 +1,104 @@
+#include <atomic>
+#include <gtest/gtest.h>
+#include "execution_service.h"
+#include "gen.h"
+#include "parser.h"
+#include "thread_pool.h"
+
+using namespace std::string_view_literals;
+
+static auto setup(const std::string_view code, std::span<const std::string_view> inputs = {}) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts, inputs);
+    return g.generate();
+}
+
+TEST(thread_pool, runs_every_task) {
+    std::atomic<int> counter { 0 };
+    std::vector<std::future<int>> results;
+
+    {
+        ThreadPool pool(4);
+        EXPECT_EQ(pool.size(), 4);
+
+        for (int i = 0; i < 1000; ++i) {
+            results.push_back(pool.submit([&counter, i] {
+                counter.fetch_add(1, std::memory_order_relaxed);
+                return i * 2;
+            }));
+        }
+    }
+
+    EXPECT_EQ(counter.load(), 1000);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(results[i].get(), i * 2);
+    }
+}
+
+TEST(thread_pool, tasks_submitted_from_workers) {
+    ThreadPool pool(2);
+
+    auto outer = pool.submit([&pool] {
+        EXPECT_TRUE(pool.currentWorker().has_value());
+        return pool.submit([] { return 42; });
+    });
+
+    EXPECT_FALSE(pool.currentWorker().has_value());
+    EXPECT_EQ(outer.get().get(), 42);
+}
+
+TEST(execution_service, runs_jobs_with_their_own_inputs) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("y := x * 2; if y == 10 then print 1; else print y; end", inputs);
+    const VirtualMachine vm(program);
+
+    ExecutionService service(4);
+
+    std::vector<std::future<JobResult>> jobs;
+    for (int x = 0; x < 200; ++x) {
+        jobs.push_back(service.submit(vm, { x }));
+    }
+
+    for (int x = 0; x < 200; ++x) {
+        const auto result = jobs[x].get();
+        ASSERT_FALSE(result.error.has_value());
+        EXPECT_EQ(result.output, x == 5 ? "1\n" : fmt::format("{}\n", x * 2));
+        EXPECT_EQ(result.slots[*vm.slot("y")].asInt(), x * 2);
+    }
+}
+
+TEST(execution_service, runs_different_programs) {
+    constexpr std::array inputs = { "x"sv };
+    const auto first = setup("print x + 1;", inputs);
+    const auto second = setup("a := 1; b := 2; c := 3; print a + b + c;");
+    const VirtualMachine firstVm(first);
+    const VirtualMachine secondVm(second);
+
+    ExecutionService service(2);
+
+    std::vector<std::future<JobResult>> jobs;
+    for (int i = 0; i < 100; ++i) {
+        jobs.push_back(i % 2 == 0 ? service.submit(firstVm, { i }) : service.submit(secondVm, {}));
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(jobs[i].get().output, i % 2 == 0 ? fmt::format("{}\n", i + 1) : "6\n");
+    }
+}
+
+TEST(execution_service, rejects_wrong_input_count) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("print x;", inputs);
+    const VirtualMachine vm(program);
+
+    ExecutionService service(1);
+
+    const auto result = service.submit(vm, {}).get();
+    ASSERT_TRUE(result.error.has_value());
+    EXPECT_EQ(*result.error, "expected 1 inputs, got 0");
+}
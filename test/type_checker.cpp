@@ -0,0 +1,174 @@
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "jit.h"
+#include "parser.h"
+#include "type_checker.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+struct Checked {
+    ByteCode::Chunk chunk;
+    std::vector<std::string> errors;
+};
+
+static auto check(const std::string_view code, std::span<const std::string_view> inputs = {}) -> Checked {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    auto stmts = Parser(tokens).parse();
+    TypeChecker checker;
+    checker.run(stmts);
+    if (checker.hadError()) {
+        return { {}, checker.getErrors() };
+    }
+
+    BytecodeGenerator g(stmts, inputs);
+    auto chunk = g.generate();
+    EXPECT_FALSE(g.hadError());
+    return { std::move(chunk), {} };
+}
+
+static auto run(const ByteCode::Chunk& chunk) -> std::string {
+    std::ostringstream out;
+    ExecutionContext context(chunk, out);
+    EXPECT_TRUE(VirtualMachine(chunk).run(context));
+    return out.str();
+}
+
+TEST(type_checker, specializes_int_and_double_arithmetic) {
+    const auto checked = check("a := 1 + 2; b := 1.5 * 2.0; print a == 3; print b != 3.0;");
+
+    ASSERT_TRUE(checked.errors.empty());
+    EXPECT_EQ(ByteCode::disassemble(checked.chunk),
+        "0000 PushInt    1\n"
+        "0003 PushInt    2\n"
+        "0006 AddI\n"
+        "0007 StoreSlot  0 (a)\n"
+        "0010 PushDouble 1.5\n"
+        "0013 PushDouble 2\n"
+        "0016 MulD\n"
+        "0017 StoreSlot  1 (b)\n"
+        "0020 LoadSlot   0 (a)\n"
+        "0023 PushInt    3\n"
+        "0026 EqI\n"
+        "0027 Print\n"
+        "0028 LoadSlot   1 (b)\n"
+        "0031 PushDouble 3\n"
+        "0034 NEqD\n"
+        "0035 Print\n"
+        "0036 Halt\n");
+    EXPECT_EQ(run(checked.chunk), "true\nfalse\n");
+}
+
+TEST(type_checker, types_flow_through_variables_and_unary) {
+    const auto checked = check("a := -4; b := a / 2; c := !(b == -2); print c;");
+
+    ASSERT_TRUE(checked.errors.empty());
+    const auto code = ByteCode::disassemble(checked.chunk);
+    EXPECT_NE(code.find("DivI"), std::string::npos);
+    EXPECT_NE(code.find("EqI"), std::string::npos);
+    EXPECT_EQ(run(checked.chunk), "false\n");
+}
+
+TEST(type_checker, inputs_stay_generic) {
+    constexpr std::array inputs = { "x"sv };
+    const auto checked = check("y := x * x; z := 2 * 3;", inputs);
+
+    ASSERT_TRUE(checked.errors.empty());
+    EXPECT_EQ(ByteCode::disassemble(checked.chunk),
+        "0000 LoadSlot   0 (x)\n"
+        "0003 LoadSlot   0 (x)\n"
+        "0006 Mul\n"
+        "0007 StoreSlot  1 (y)\n"
+        "0010 PushInt    2\n"
+        "0013 PushInt    3\n"
+        "0016 MulI\n"
+        "0017 StoreSlot  2 (z)\n"
+        "0020 Halt\n");
+
+    ExecutionContext context(checked.chunk);
+    context.setSlot(0, 1.5);
+    EXPECT_TRUE(VirtualMachine(checked.chunk).run(context));
+    EXPECT_EQ(context.getSlot(1).asDouble(), 2.25);
+    EXPECT_EQ(context.getSlot(2).asInt(), 6);
+}
+
+TEST(type_checker, variable_with_different_types_on_each_path_stays_generic) {
+    constexpr std::array inputs = { "x"sv };
+    const auto checked = check("if x == 1 then y := 1; else y := 2.5; end print y + y; y := 3; print y + y;", inputs);
+
+    ASSERT_TRUE(checked.errors.empty());
+    const auto code = ByteCode::disassemble(checked.chunk);
+    EXPECT_NE(code.find("Add\n"), std::string::npos);
+    EXPECT_NE(code.find("AddI\n"), std::string::npos);
+}
+
+TEST(type_checker, branch_keeps_type_assigned_on_both_paths) {
+    constexpr std::array inputs = { "x"sv };
+    const auto checked = check("a := 1.0; if x == 1 then a := 2.0; end print a * a;", inputs);
+
+    ASSERT_TRUE(checked.errors.empty());
+    EXPECT_NE(ByteCode::disassemble(checked.chunk).find("MulD"), std::string::npos);
+}
+
+TEST(type_checker, input_assigned_on_one_path_stays_generic) {
+    constexpr std::array inputs = { "x"sv, "c"sv };
+    const auto checked = check("if c == 1 then x := 1.5; end print x + 2.5;", inputs);
+
+    ASSERT_TRUE(checked.errors.empty());
+    EXPECT_EQ(ByteCode::disassemble(checked.chunk).find("AddD"), std::string::npos);
+
+    const VirtualMachine vm(checked.chunk);
+    std::ostringstream out;
+    ExecutionContext context(checked.chunk, out);
+    context.setSlot(0, 0.5);
+    context.setSlot(1, 1);
+    EXPECT_TRUE(vm.run(context));
+    context.setSlot(0, 0.5);
+    context.setSlot(1, 0);
+    EXPECT_TRUE(vm.run(context));
+    EXPECT_EQ(out.str(), "4\n3\n");
+
+    // An int input may still be added to an int after the other path.
+    EXPECT_TRUE(check("if c == 1 then c := 0; else x := 1.5; end print x + 1;", inputs).errors.empty());
+}
+
+TEST(type_checker, reports_mixed_arithmetic) {
+    const auto checked = check("a := 1;\nb := a + 2.5;");
+
+    ASSERT_EQ(checked.errors.size(), 1);
+    EXPECT_EQ(checked.errors[0], "[line 2] Error at '+': Operands must be two ints or two doubles.");
+}
+
+TEST(type_checker, reports_bool_operands) {
+    const auto checked = check("a := 1 == 1; print a * 2; print a == a; print -a; print !3;");
+
+    ASSERT_EQ(checked.errors.size(), 4);
+    EXPECT_EQ(checked.errors[0], "[line 1] Error at '*': Operands must be numbers.");
+    EXPECT_EQ(checked.errors[1], "[line 1] Error at '==': Operands must be numbers.");
+    EXPECT_EQ(checked.errors[2], "[line 1] Error at '-': Operand must be a number.");
+    EXPECT_EQ(checked.errors[3], "[line 1] Error at '!': Operand must be a bool.");
+}
+
+TEST(type_checker, reports_non_bool_condition) {
+    const auto checked = check("a := 1; if a then print a; end if 2 then print 2; end");
+
+    ASSERT_EQ(checked.errors.size(), 2);
+    EXPECT_EQ(checked.errors[0], "[line 1] Error at 'a': Condition must be a bool.");
+    EXPECT_EQ(checked.errors[1], "Error: Condition must be a bool.");
+}
+
+TEST(type_checker, jit_compiles_specialized_ints) {
+    const auto checked = check("a := 6 * 7; b := a - 2; if b != 40 then print 0; else print a / 2; end");
+    ASSERT_TRUE(checked.errors.empty());
+
+    const JitMachine jit(checked.chunk);
+    EXPECT_EQ(jit.isCompiled(), ACOMPILER_JIT != 0);
+
+    std::ostringstream out;
+    ExecutionContext context(checked.chunk, out);
+    EXPECT_TRUE(jit.run(context));
+    EXPECT_EQ(out.str(), "21\n");
+}
@@ -0,0 +1,52 @@
+#include <cmath>
+#include <limits>
+#include <gtest/gtest.h>
+#include "value.h"
+
+template<typename T>
+class value : public testing::Test {};
+
+using Representations = testing::Types<Values::Variant, Values::Boxed>;
+TYPED_TEST_SUITE(value, Representations);
+
+TYPED_TEST(value, ints) {
+    for (const auto i : { 0, 1, -1, std::numeric_limits<int>::min(), std::numeric_limits<int>::max() }) {
+        const TypeParam v { i };
+        EXPECT_TRUE(v.isInt());
+        EXPECT_FALSE(v.isBool());
+        EXPECT_FALSE(v.isDouble());
+        EXPECT_EQ(v.asInt(), i);
+    }
+}
+
+TYPED_TEST(value, doubles) {
+    for (const auto d : { 0.0, -0.0, 1.5, -2.25, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() }) {
+        const TypeParam v { d };
+        EXPECT_TRUE(v.isDouble());
+        EXPECT_FALSE(v.isInt());
+        EXPECT_EQ(std::signbit(v.asDouble()), std::signbit(d));
+        EXPECT_EQ(v.asDouble(), d);
+    }
+
+    const TypeParam nan { -std::numeric_limits<double>::quiet_NaN() };
+    EXPECT_TRUE(nan.isDouble());
+    EXPECT_TRUE(std::isnan(nan.asDouble()));
+}
+
+TYPED_TEST(value, bools) {
+    const TypeParam t { true };
+    const TypeParam f { false };
+    EXPECT_TRUE(t.isBool());
+    EXPECT_FALSE(t.isInt());
+    EXPECT_TRUE(t.asBool());
+    EXPECT_FALSE(f.asBool());
+    EXPECT_FALSE(TypeParam {}.asBool());
+}
+
+TYPED_TEST(value, pairs) {
+    EXPECT_TRUE(TypeParam::bothInts(TypeParam { 1 }, TypeParam { -2 }));
+    EXPECT_FALSE(TypeParam::bothInts(TypeParam { 1 }, TypeParam { 2.0 }));
+    EXPECT_FALSE(TypeParam::bothInts(TypeParam { true }, TypeParam { 2 }));
+    EXPECT_TRUE(TypeParam::bothDoubles(TypeParam { 1.0 }, TypeParam { -0.0 }));
+    EXPECT_FALSE(TypeParam::bothDoubles(TypeParam { 1.0 }, TypeParam { 1 }));
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "parser.h"
+#include "verifier.h"
+#include "vm.h"
+
+using enum ByteCode::OpCode;
+
+static auto setup(const std::string_view code) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts);
+    return g.generate();
+}
+
+static auto op(const ByteCode::OpCode op) -> ByteCode::Type {
+    return static_cast<ByteCode::Type>(op);
+}
+
+TEST(verifier, generated_code_is_valid) {
+    const auto chunk = setup("a := 1 + 2 * 3; if a == 7 then print a; else 1 + a; end print 2.5;");
+
+    EXPECT_EQ(ByteCode::verify(chunk), std::nullopt);
+    EXPECT_EQ(chunk.maxStack, 3);
+}
+
+TEST(verifier, expression_statement_is_popped) {
+    const auto chunk = setup("1 + 2;");
+
+    EXPECT_EQ(chunk.code[chunk.code.size() - 2], op(Pop));
+    EXPECT_EQ(chunk.maxStack, 2);
+}
+
+TEST(verifier, rejects_underflow) {
+    ByteCode::Chunk chunk;
+    chunk.code = { op(Add), op(Halt) };
+    chunk.maxStack = 2;
+
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: Add underflows the stack");
+}
+
+TEST(verifier, rejects_overflow) {
+    ByteCode::Chunk chunk;
+    chunk.integers = { 1 };
+    chunk.code = { op(PushInt), 0, 0, op(PushInt), 0, 0, op(Add), op(Pop), op(Halt) };
+    chunk.maxStack = 1;
+
+    EXPECT_EQ(ByteCode::verify(chunk), "0003: PushInt exceeds the maximum stack depth 1");
+}
+
+TEST(verifier, rejects_bad_constant) {
+    ByteCode::Chunk chunk;
+    chunk.code = { op(PushInt), 0, 0, op(Pop), op(Halt) };
+    chunk.maxStack = 1;
+
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: integer constant out of range");
+}
+
+TEST(verifier, rejects_jump_into_instruction) {
+    ByteCode::Chunk chunk;
+    chunk.code = { op(Jmp), 0, 0, 0, 0, op(Halt) };
+    chunk.patchOperand<ByteCode::Offset>(1, -3);
+
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: control flow leaves the code or enters an instruction");
+}
+
+TEST(verifier, rejects_running_off_the_end) {
+    ByteCode::Chunk chunk;
+    chunk.code = { op(Print) };
+    chunk.maxStack = 1;
+
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: Print underflows the stack");
+
+    chunk.integers = { 1 };
+    chunk.code = { op(PushInt), 0, 0, op(Pop) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0003: control flow leaves the code or enters an instruction");
+}
+
+TEST(verifier, rejects_mistyped_operands) {
+    ByteCode::Chunk chunk;
+    chunk.integers = { 1 };
+    chunk.doubles = { 1.5 };
+    chunk.slots = { "a" };
+    chunk.maxStack = 2;
+
+    chunk.code = { op(PushDouble), 0, 0, op(PushInt), 0, 0, op(AddI), op(Pop), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0006: AddI on operands not proven to be ints");
+
+    chunk.code = { op(PushInt), 0, 0, op(PushInt), 0, 0, op(MulD), op(Pop), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0006: MulD on operands not proven to be doubles");
+
+    chunk.code = { op(PushDouble), 0, 0, op(PushInt), 0, 0, op(Add), op(Pop), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0006: Add on operands that are not two numbers of the same type");
+
+    chunk.code = { op(PushInt), 0, 0, op(Jz), 0, 0, 0, 0, op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0003: Jz on a value that is not a bool");
+
+    chunk.code = { op(PushDouble), 0, 0, op(StoreSlot), 0, 0, op(AddSlotInt), 0, 0, 0, 0, op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0006: AddSlotInt on a slot that is not an int");
+}
+
+TEST(verifier, rejects_reading_unset_slots) {
+    ByteCode::Chunk chunk;
+    chunk.integers = { 1 };
+    chunk.slots = { "a" };
+    chunk.maxStack = 2;
+
+    chunk.code = { op(LoadSlot), 0, 0, op(LoadSlot), 0, 0, op(Add), op(Print), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: LoadSlot of a slot that may not be set");
+
+    chunk.code = { op(LoadLoad), 0, 0, 0, 0, op(Add), op(Print), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: LoadLoad of a slot that may not be set");
+
+    chunk.code = { op(AddSlotInt), 0, 0, 0, 0, op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), "0000: AddSlotInt of a slot that may not be set");
+
+    // Inputs are set by the caller.
+    chunk.inputs = 1;
+    chunk.code = { op(LoadSlot), 0, 0, op(LoadSlot), 0, 0, op(Add), op(Print), op(Halt) };
+    EXPECT_EQ(ByteCode::verify(chunk), std::nullopt);
+}
+
+TEST(verifier, slots_set_on_one_path_stay_unset) {
+    ByteCode::Chunk chunk;
+    chunk.integers = { 1 };
+    chunk.slots = { "c", "a" };
+    chunk.inputs = 1;
+    chunk.maxStack = 1;
+
+    // if c then a := 1; end print a;
+    chunk.code = {
+        op(LoadSlot), 0, 0,
+        op(Jz), 6, 0, 0, 0,
+        op(PushInt), 0, 0,
+        op(StoreSlot), 1, 0,
+        op(LoadSlot), 1, 0,
+        op(Print), op(Halt),
+    };
+    EXPECT_EQ(ByteCode::verify(chunk), "0014: LoadSlot of a slot that may not be set");
+}
+
+TEST(verifier, types_join_where_paths_meet) {
+    ByteCode::Chunk chunk;
+    chunk.integers = { 1 };
+    chunk.doubles = { 1.5 };
+    chunk.slots = { "c", "a" };
+    chunk.inputs = 1;
+    chunk.maxStack = 2;
+
+    // a := c ? 1 : 1.5; print a + 1;
+    chunk.code = {
+        op(LoadSlot), 0, 0,
+        op(Jz), 8, 0, 0, 0,
+        op(PushInt), 0, 0,
+        op(Jmp), 3, 0, 0, 0,
+        op(PushDouble), 0, 0,
+        op(StoreSlot), 1, 0,
+        op(LoadSlot), 1, 0,
+        op(PushInt), 0, 0,
+        op(AddI), op(Print), op(Halt),
+    };
+    EXPECT_EQ(ByteCode::verify(chunk), "0028: AddI on operands not proven to be ints");
+
+    // The generic Add checks the tags, so it may see either.
+    chunk.code[28] = op(Add);
+    EXPECT_EQ(ByteCode::verify(chunk), std::nullopt);
+}
+
+TEST(verifier, vm_refuses_malformed_chunk) {
+    ByteCode::Chunk chunk;
+    chunk.code = { op(Add), op(Halt) };
+    chunk.maxStack = 2;
+
+    VirtualMachine vm(chunk);
+    EXPECT_TRUE(vm.hadError());
+}
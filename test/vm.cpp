@@ -0,0 +1,127 @@
+#include <limits>
+#include <sstream>
+#include <gtest/gtest.h>
+#include "gen.h"
+#include "parser.h"
+#include "vm.h"
+
+using namespace std::string_view_literals;
+
+static auto setup(const std::string_view code, std::span<const std::string_view> inputs = {}) -> ByteCode::Chunk {
+    Lexer l(code);
+    auto tokens = l.lex();
+
+    Parser p(tokens);
+    auto stmts = p.parse();
+
+    BytecodeGenerator g(stmts, inputs);
+    return g.generate();
+}
+
+TEST(vm, runs_repeatedly) {
+    const auto program = setup("a := 2; print a * 21;");
+    const VirtualMachine vm(program);
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+
+    EXPECT_TRUE(vm.run(context));
+    EXPECT_TRUE(vm.run(context));
+    EXPECT_TRUE(vm.run(context));
+
+    EXPECT_EQ(out.str(), "42\n42\n42\n");
+}
+
+TEST(vm, inputs) {
+    constexpr std::array inputs = { "x"sv, "y"sv };
+    const auto program = setup("if x == y then print 1; else print x - y; end", inputs);
+    const VirtualMachine vm(program);
+
+    ASSERT_EQ(vm.slot("x"), 0);
+    ASSERT_EQ(vm.slot("y"), 1);
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+
+    for (const auto& [x, y] : { std::pair { 3, 3 }, std::pair { 10, 4 }, std::pair { 4, 10 } }) {
+        context.setSlot(0, x);
+        context.setSlot(1, y);
+        EXPECT_TRUE(vm.run(context));
+    }
+
+    EXPECT_EQ(out.str(), "1\n6\n-6\n");
+}
+
+TEST(vm, contexts_are_independent) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("y := x + x;", inputs);
+    const VirtualMachine vm(program);
+
+    ExecutionContext first(program);
+    ExecutionContext second(program);
+    first.setSlot(0, 1);
+    second.setSlot(0, 1.5);
+
+    EXPECT_TRUE(vm.run(first));
+    EXPECT_TRUE(vm.run(second));
+
+    EXPECT_EQ(first.getSlot(*vm.slot("y")).asInt(), 2);
+    EXPECT_EQ(second.getSlot(*vm.slot("y")).asDouble(), 3.0);
+}
+
+TEST(vm, context_fits_the_chunk_it_was_bound_to) {
+    const auto small = setup("a := 1;");
+    const auto large = setup("a := 1; b := 2; c := a + b * a - b; print c;");
+
+    ExecutionContext context(small);
+    EXPECT_TRUE(context.fits(small));
+    EXPECT_FALSE(context.fits(large));
+
+    context.bind(large);
+    EXPECT_TRUE(context.fits(large));
+    EXPECT_TRUE(context.fits(small));
+}
+
+TEST(vm, stops_on_inputs_of_the_wrong_type) {
+    constexpr std::array inputs = { "x"sv };
+    const auto program = setup("print x + 1; print 7;", inputs);
+    const VirtualMachine vm(program);
+
+    std::ostringstream out;
+    ExecutionContext context(program, out);
+
+    for (const auto dispatch : { VirtualMachine::Dispatch::Switch, VirtualMachine::defaultDispatch }) {
+        context.setSlot(0, true);
+        EXPECT_FALSE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), "Operands of ADD must be two numbers of the same type, got true and 1.");
+
+        // The context is usable again once the input is fixed.
+        context.setSlot(0, 2);
+        EXPECT_TRUE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), std::nullopt);
+    }
+
+    EXPECT_EQ(out.str(), "3\n7\n3\n7\n");
+}
+
+TEST(vm, integer_division_stops_on_zero_and_wraps) {
+    constexpr std::array inputs = { "x"sv, "y"sv };
+    const auto program = setup("print 1; print x / y; print x + y;", inputs);
+    const VirtualMachine vm(program);
+
+    for (const auto dispatch : { VirtualMachine::Dispatch::Switch, VirtualMachine::defaultDispatch }) {
+        std::ostringstream out;
+        ExecutionContext context(program, out);
+
+        context.setSlot(0, 7);
+        context.setSlot(1, 0);
+        EXPECT_FALSE(vm.run(context, dispatch));
+        EXPECT_EQ(context.getError(), "Division by zero.");
+
+        context.setSlot(0, std::numeric_limits<int>::min());
+        context.setSlot(1, -1);
+        EXPECT_TRUE(vm.run(context, dispatch));
+
+        EXPECT_EQ(out.str(), "1\n1\n-2147483648\n2147483647\n");
+    }
+}